@@ -0,0 +1,70 @@
+# Build com PGO treinado no benchmark padrão (src/bench.hpp):
+#
+#    cmake -DSOURCE_DIR=. -DBINARY_DIR=_pgo -P cmake/pgo.cmake
+#
+# 1. BINARY_DIR/o2: o build de referência (-O2), e a vazão dele em bench-o2.txt;
+# 2. BINARY_DIR/pgo com PGO=GENERATE: uma rodada do benchmark como carga de
+#    treino grava os perfis em BINARY_DIR/pgo/profiles (as rodadas são iguais);
+# 3. o mesmo diretório com PGO=USE: otimcore, main, otim, ... são recompilados
+#    com os perfis e o benchmark compara a vazão com a de bench-o2.txt.
+#
+# A saída do último passo (e bench-pgo.txt) tem o ganho: "gain=+X%". Opções:
+# ROUNDS (rodadas de cada benchmark, padrão 10), LTO (ON/OFF, padrão OFF; vale
+# para os dois builds) e JOBS (paralelismo da compilação).
+#
+# Os perfis são por arquivo objeto, e o treino só roda o otim: a libunrestricted,
+# que compila lib.cpp de novo como outro objeto, sai sem perfis (como no -O2).
+
+cmake_minimum_required(VERSION 3.9)
+
+if (NOT SOURCE_DIR)
+  set(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/..")
+endif()
+if (NOT BINARY_DIR)
+  set(BINARY_DIR "${SOURCE_DIR}/_pgo")
+endif()
+if (NOT ROUNDS)
+  set(ROUNDS 10)
+endif()
+if (NOT LTO)
+  set(LTO OFF)
+endif()
+get_filename_component(SOURCE_DIR "${SOURCE_DIR}" ABSOLUTE)
+get_filename_component(BINARY_DIR "${BINARY_DIR}" ABSOLUTE)
+set(PROFILES "${BINARY_DIR}/pgo/profiles")
+set(BUILD_ARGS)
+if (JOBS)
+  set(BUILD_ARGS -j ${JOBS})
+endif()
+
+# Executa o comando e para tudo se ele falhar.
+function(run step)
+  message(STATUS "pgo: ${step}")
+  execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    message(FATAL_ERROR "pgo: ${step} failed (${result})")
+  endif()
+endfunction()
+
+# Configura e compila o build em dir com as opções dadas.
+function(build dir)
+  run("configure ${dir}" ${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${dir}" -DTEST=OFF -DLTO=${LTO} ${ARGN})
+  run("build ${dir}" ${CMAKE_COMMAND} --build "${dir}" ${BUILD_ARGS})
+endfunction()
+
+# Roda rounds rodadas do benchmark com o otim de dir e grava a saída em output.
+function(bench dir rounds output)
+  run("bench ${dir}" "${dir}/otim" bench -n ${rounds} ${ARGN} OUTPUT_FILE "${output}")
+  file(READ "${output}" text)
+  message("${text}")
+endfunction()
+
+build("${BINARY_DIR}/o2" -DPGO=OFF)
+bench("${BINARY_DIR}/o2" ${ROUNDS} "${BINARY_DIR}/bench-o2.txt")
+
+file(REMOVE_RECURSE "${PROFILES}")
+build("${BINARY_DIR}/pgo" -DPGO=GENERATE -DPGO_DIR=${PROFILES})
+bench("${BINARY_DIR}/pgo" 1 "${BINARY_DIR}/bench-train.txt")
+
+build("${BINARY_DIR}/pgo" -DPGO=USE -DPGO_DIR=${PROFILES})
+bench("${BINARY_DIR}/pgo" ${ROUNDS} "${BINARY_DIR}/bench-pgo.txt" -r "${BINARY_DIR}/bench-o2.txt")
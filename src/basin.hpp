@@ -0,0 +1,231 @@
+#ifndef _BASIN_HPP_
+#define _BASIN_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "multistart.hpp"
+#include "pool.hpp"
+
+/**
+ * Bacias de atração: um método roda a partir de cada ponto de uma grade nx x ny
+ * (com o BatchSolver, sem alocações por ponto inicial) e o mapa guarda, por
+ * célula, o ponto final, o número de iterações e o motivo de parada.
+ *
+ * Arquivo (.bsn), mapeado com mmap:
+ *    cabeçalho (192 bytes): BasinHeader
+ *    x1 final: float[nx * ny]
+ *    x2 final: float[nx * ny]
+ *    iterações: uint16_t[nx * ny] (saturadas em 65535)
+ *    motivo de parada: uint8_t[nx * ny] (Termination)
+ * As células estão em ordem de linha: a célula (i, j) é a de índice j * nx + i,
+ * com o ponto inicial (x1min + i (x1max - x1min) / (nx - 1), x2min + j (x2max - x2min) / (ny - 1)).
+ */
+
+#define BASIN_MAGIC "OTIMBSN1"
+#define BASIN_REASONS 8
+
+struct BasinHeader {
+  char magic[8];
+  uint64_t nx, ny;
+  double x1min, x1max, x2min, x2max;
+  int32_t function, method;
+  double epsilon;
+  uint32_t max_iterations, reserved;
+  uint64_t count[BASIN_REASONS];    // células por motivo de parada
+  uint64_t total_iterations;
+  char padding[40];
+};
+
+/// Qual método rodar e em que grade.
+struct BasinSpec {
+  int function, method;
+  double epsilon;
+  unsigned max_iterations;
+  double x1min, x1max, x2min, x2max;
+  size_t nx, ny;
+
+  BasinSpec() :
+    function(FA), method(NEWTON), epsilon(1e-6), max_iterations(1000),
+    x1min(-4.0), x1max(4.0), x2min(-4.0), x2max(4.0), nx(512), ny(512) {}
+};
+
+/// Mapa de bacias gravado em disco, mapeado só para leitura.
+class BasinFile {
+  public:
+    explicit BasinFile(const std::string& path) {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+          close(fd);
+        throw std::runtime_error("ERROR: can't open " + path);
+      }
+      size = st.st_size;
+      void* p = size >= sizeof(BasinHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+      close(fd);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("ERROR: can't map " + path);
+      base = (char*) p;
+      // Divide em vez de multiplicar: um cabeçalho corrompido não estoura a conta.
+      const size_t data = size - sizeof(BasinHeader), cell = basin_file_size(1) - sizeof(BasinHeader);
+      const uint64_t nx = header().nx, ny = header().ny;
+      if (memcmp(header().magic, BASIN_MAGIC, 8) != 0 || data % cell != 0 ||
+          (nx == 0 ? data != 0 : (data / cell) % nx != 0 || (data / cell) / nx != ny)) {
+        munmap(base, size);
+        throw std::runtime_error("ERROR: " + path + " is not a valid basin file");
+      }
+    }
+
+    ~BasinFile() { munmap(base, size); }
+
+    BasinFile(const BasinFile&) = delete;
+    BasinFile& operator=(const BasinFile&) = delete;
+
+    /// Tamanho do arquivo para n células.
+    static size_t basin_file_size(size_t n) {
+      return sizeof(BasinHeader) + n * (2 * sizeof(float) + sizeof(uint16_t) + sizeof(uint8_t));
+    }
+
+    const BasinHeader& header() const { return *(const BasinHeader*) base; }
+    size_t cells() const { return header().nx * header().ny; }
+    const float* x1() const { return (const float*) (base + sizeof(BasinHeader)); }
+    const float* x2() const { return x1() + cells(); }
+    const uint16_t* iterations() const { return (const uint16_t*) (x2() + cells()); }
+    const uint8_t* reason() const { return (const uint8_t*) (iterations() + cells()); }
+
+  private:
+    char* base;
+    size_t size;
+};
+
+/**
+ * Roda o método a partir de cada célula da grade e grava o mapa em path.
+ * Cada tarefa do pool resolve um bloco de linhas com um BatchSolver e buffers
+ * próprios, alocados uma vez por tarefa.
+ */
+inline BasinHeader compute_basin(const BasinSpec& spec, const std::string& path, ThreadPool& pool) {
+  if (spec.nx < 2 || spec.ny < 2)
+    throw std::invalid_argument("ERROR: basin map needs nx, ny >= 2");
+  BatchSolver check(spec.function, spec.method, spec.epsilon);
+
+  BasinHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BASIN_MAGIC, 8);
+  h.nx = spec.nx;
+  h.ny = spec.ny;
+  h.x1min = spec.x1min;
+  h.x1max = spec.x1max;
+  h.x2min = spec.x2min;
+  h.x2max = spec.x2max;
+  h.function = spec.function;
+  h.method = spec.method;
+  h.epsilon = spec.epsilon;
+  h.max_iterations = spec.max_iterations;
+
+  const size_t n = spec.nx * spec.ny;
+  const size_t size = BasinFile::basin_file_size(n);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("ERROR: can't create " + path);
+  void* p = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("ERROR: can't map " + path);
+  char* base = (char*) p;
+  float* end1 = (float*) (base + sizeof(BasinHeader));
+  float* end2 = end1 + n;
+  uint16_t* iterations = (uint16_t*) (end2 + n);
+  uint8_t* reason = (uint8_t*) (iterations + n);
+
+  const double dx = (spec.x1max - spec.x1min) / (spec.nx - 1);
+  const double dy = (spec.x2max - spec.x2min) / (spec.ny - 1);
+  // Linhas por tarefa: blocos de umas 16 mil células.
+  const size_t rows = std::max((size_t) 1, (size_t) 16384 / spec.nx);
+  std::mutex mutex;
+
+  parallel_for(pool, spec.ny, rows, [&](size_t begin, size_t end) {
+    Budget budget;
+    budget.max_iterations = spec.max_iterations;
+    BatchSolver solver(spec.function, spec.method, spec.epsilon);
+    solver.setBudget(budget);
+    std::vector<double> x01(spec.nx), x02(spec.nx);
+    std::vector<StartResult> r(spec.nx);
+    uint64_t count[BASIN_REASONS] = {0};
+    uint64_t total = 0;
+    for (size_t i = 0; i < spec.nx; ++i)
+      x01[i] = spec.x1min + i * dx;
+
+    for (size_t j = begin; j < end; ++j) {
+      std::fill(x02.begin(), x02.end(), spec.x2min + j * dy);
+      solver.solve(x01.data(), x02.data(), spec.nx, r.data());
+      for (size_t i = 0; i < spec.nx; ++i) {
+        size_t c = j * spec.nx + i;
+        end1[c] = r[i].x1;
+        end2[c] = r[i].x2;
+        iterations[c] = std::min(r[i].iterations, 65535u);
+        reason[c] = r[i].reason;
+        ++count[r[i].reason % BASIN_REASONS];
+        total += r[i].iterations;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (unsigned k = 0; k < BASIN_REASONS; ++k)
+      h.count[k] += count[k];
+    h.total_iterations += total;
+  });
+
+  memcpy(base, &h, sizeof(h));
+  msync(base, size, MS_SYNC);
+  munmap(base, size);
+  return h;
+}
+
+/**
+ * Grava o mapa como imagem PPM (P6), com x2 crescendo para cima. Convergiu:
+ * verde, mais claro quanto menos iterações; passo pequeno: azul; iterações
+ * esgotadas: vermelho; hessiana singular ou valor não finito: preto; outros: cinza.
+ */
+inline void basin_to_ppm(const BasinFile& in, const std::string& path) {
+  const BasinHeader& h = in.header();
+  std::ofstream out(path.c_str(), std::ios::binary);
+  if (!out)
+    throw std::runtime_error("ERROR: can't create " + path);
+  out << "P6\n" << h.nx << " " << h.ny << "\n255\n";
+
+  unsigned most = 1;
+  for (size_t c = 0; c < in.cells(); ++c)
+    if (in.reason()[c] == CONVERGED)
+      most = std::max(most, (unsigned) in.iterations()[c]);
+
+  std::vector<unsigned char> row(3 * h.nx);
+  for (size_t r = 0; r < h.ny; ++r) {
+    size_t j = h.ny - 1 - r;
+    for (size_t i = 0; i < h.nx; ++i) {
+      size_t c = j * h.nx + i;
+      unsigned char rgb[3] = {128, 128, 128};
+      switch (in.reason()[c]) {
+        case CONVERGED:
+          rgb[0] = rgb[2] = 0;
+          rgb[1] = 255 - 191 * in.iterations()[c] / most;
+          break;
+        case STEP_TOO_SMALL: rgb[0] = rgb[1] = 0; rgb[2] = 255; break;
+        case TOO_MANY_ITERATIONS: rgb[0] = 255; rgb[1] = rgb[2] = 0; break;
+        case SINGULAR_HESSIAN:
+        case NOT_FINITE: rgb[0] = rgb[1] = rgb[2] = 0; break;
+      }
+      memcpy(&row[3 * i], rgb, 3);
+    }
+    out.write((const char*) row.data(), row.size());
+  }
+}
+
+#endif // _BASIN_HPP_
@@ -0,0 +1,131 @@
+#ifndef _BENCH_HPP_
+#define _BENCH_HPP_
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "lib.hpp"
+
+/**
+ * Benchmark padrão: solve_it e os métodos sozinhos para cada (função, método),
+ * a partir de uma grade fixa de pontos iniciais e com sementes fixas, então
+ * toda rodada faz exatamente o mesmo trabalho. Os laços quentes são os do
+ * solve_it, da busca de Armijo e das operações de Matrix.
+ *
+ * É a carga de treino do PGO (cmake/pgo.cmake) e a medida para comparar
+ * builds: a vazão é a de resoluções por segundo na rodada mais rápida.
+ * OTIM_BUILD (definido pelo CMake) identifica o build na saída.
+ */
+
+#ifndef OTIM_BUILD
+#define OTIM_BUILD "default"
+#endif
+
+// Pontos iniciais por (função, método) em cada rodada.
+#define BENCH_STARTS 8
+
+struct BenchResult {
+  std::string build;
+  unsigned rounds;
+  unsigned solves;          // resoluções por rodada
+  uint64_t evaluations;     // avaliações de f por rodada
+  double seconds;           // a rodada mais rápida
+  double throughput;        // solves / seconds
+
+  BenchResult() : rounds(0), solves(0), evaluations(0), seconds(0.0), throughput(0.0) {}
+};
+
+/// Uma rodada do benchmark; retorna o número de resoluções e soma as avaliações de f em evaluations.
+inline unsigned bench_round(uint64_t& evaluations) {
+  const int functions[] = {FA, FB, FC};
+  const int methods[] = {GRADIENT, NEWTON, NEWTONPURE, QUASINEWTON};
+  unsigned solves = 0;
+  evaluations = 0;
+  for (unsigned f = 0; f < 3; ++f)
+    for (unsigned m = 0; m < 4; ++m) {
+      int function = functions[f], method = methods[m];
+      if ((method == NEWTON || method == NEWTONPURE) && function != FA)
+        continue;
+      for (unsigned k = 0; k < BENCH_STARTS; ++k) {
+        Matrix x0(vector<double>{-2.0 + 0.5 * k, 3.0 - 0.75 * k});
+        // Limites em iterações e avaliações (não em tempo): alguns pares não
+        // convergem destes pontos, e a rodada tem que fazer sempre o mesmo trabalho.
+        Budget budget;
+        budget.max_iterations = 2000;
+        budget.max_evaluations = 50000;
+
+        SolveIt outer(function, x0, 4, 1e-7, 1e-2, method, budget);
+        outer.setSeed(k + 1);
+        evaluations += outer.run().n_evaluations;
+
+        // O método sozinho: o subproblema com lambdak = 0 é a própria f.
+        std::unique_ptr<Method> alone(subproblem_method(function, method, 0.0, x0, x0, 1e-6, budget));
+        evaluations += alone->run().n_evaluations;
+        solves += 2;
+      }
+    }
+  return solves;
+}
+
+/// rounds rodadas do benchmark, sem os relatórios dos métodos.
+inline BenchResult run_bench(unsigned rounds) {
+  if (rounds == 0)
+    throw std::invalid_argument("ERROR: the benchmark needs at least one round");
+  bool verbose = VERBOSE;
+  VERBOSE = false;
+  BenchResult r;
+  r.build = OTIM_BUILD;
+  r.rounds = rounds;
+  for (unsigned i = 0; i < rounds; ++i) {
+    Timer timer;
+    r.solves = bench_round(r.evaluations);
+    double seconds = timer.elapsed();
+    if (i == 0 || seconds < r.seconds)
+      r.seconds = seconds;
+  }
+  VERBOSE = verbose;
+  r.throughput = r.solves / r.seconds;
+  return r;
+}
+
+/// Uma linha "build=... rounds=... solves=... evaluations=... seconds=... throughput=...".
+inline std::string format_bench(const BenchResult& r) {
+  std::ostringstream out;
+  out << "build=" << r.build << " rounds=" << r.rounds << " solves=" << r.solves
+    << " evaluations=" << r.evaluations << " seconds=" << r.seconds << " throughput=" << r.throughput;
+  return out.str();
+}
+
+/// Lê a última linha de format_bench de path (a saída de outro otim bench). Lança std::runtime_error se não há.
+inline BenchResult load_bench(const std::string& path) {
+  std::ifstream in(path.c_str());
+  if (!in)
+    throw std::runtime_error("ERROR: can't open " + path);
+  BenchResult r;
+  bool found = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 6, "build=") != 0)
+      continue;
+    std::istringstream fields(line);
+    std::string field;
+    while (fields >> field) {
+      size_t eq = field.find('=');
+      std::string key = field.substr(0, eq), value = field.substr(eq + 1);
+      if (key == "build") r.build = value;
+      else if (key == "rounds") r.rounds = atoi(value.c_str());
+      else if (key == "solves") r.solves = atoi(value.c_str());
+      else if (key == "evaluations") r.evaluations = strtoull(value.c_str(), NULL, 10);
+      else if (key == "seconds") r.seconds = atof(value.c_str());
+      else if (key == "throughput") r.throughput = atof(value.c_str());
+    }
+    found = true;
+  }
+  if (!found || !(r.throughput > 0))
+    throw std::runtime_error("ERROR: " + path + " has no benchmark result");
+  return r;
+}
+
+#endif // _BENCH_HPP_
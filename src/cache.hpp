@@ -0,0 +1,260 @@
+#ifndef _CACHE_HPP_
+#define _CACHE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lib.hpp"
+
+/**
+ * Cache de resultados em disco: uma tabela hash (endereçamento aberto, sondagem
+ * linear) dentro de um arquivo mapeado com mmap.
+ *
+ *    cabeçalho (64 bytes): "OTIMCAC1", capacidade (uint64), entradas ocupadas (uint64)
+ *    entradas: capacidade x CacheEntry
+ *
+ * A chave é um hash de 64 bits das entradas do problema e de LIB_VERSION
+ * (ver solve_key), então uma versão nova não reaproveita resultados antigos.
+ * A tabela dobra de tamanho quando passa da metade da capacidade.
+ * Várias threads podem usar o mesmo Cache; vários processos no mesmo arquivo, não.
+ */
+
+#define CACHE_MAGIC "OTIMCAC1"
+
+struct CacheHeader {
+  char magic[8];
+  uint64_t capacity;
+  uint64_t count;
+  char reserved[40];
+};
+
+struct CacheEntry {
+  uint64_t key;               // 0 = vazia
+  double x1, x2, fx;
+  uint32_t reason;
+  uint32_t iterations;
+  uint32_t n_call_armijo;
+  uint32_t n_evaluations;
+};
+
+/// Hash FNV-1a de 64 bits, acumulado em h.
+inline uint64_t fnv1a(const void* data, size_t n, uint64_t h = 14695981039346656037ULL) {
+  const unsigned char* p = (const unsigned char*) data;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/**
+ * Chave de um problema: tipo (solve_it ou minimização direta), função (o nome,
+ * se for uma função registrada), método, ponto inicial, limitx0, epsilons,
+ * semente, limites de execução e parâmetros de Armijo do perfil carregado,
+ * mais LIB_VERSION.
+ */
+inline uint64_t solve_key(int kind, int function, int method, const Matrix& x0, int limitx0,
+    double epsilonSub, double epsilonMeth, unsigned seed, const Budget& budget) {
+  uint64_t h = fnv1a(LIB_VERSION, strlen(LIB_VERSION));
+  double x1 = x0.x1(), x2 = x0.x2();
+  h = fnv1a(&kind, sizeof(kind), h);
+  // Os índices das funções registradas dependem da ordem de carga: vale o nome.
+  if (const UserFunction* user = user_function(function))
+    h = fnv1a(user->name.data(), user->name.size(), h);
+  else
+    h = fnv1a(&function, sizeof(function), h);
+  h = fnv1a(&method, sizeof(method), h);
+  h = fnv1a(&x1, sizeof(x1), h);
+  h = fnv1a(&x2, sizeof(x2), h);
+  h = fnv1a(&limitx0, sizeof(limitx0), h);
+  h = fnv1a(&epsilonSub, sizeof(epsilonSub), h);
+  h = fnv1a(&epsilonMeth, sizeof(epsilonMeth), h);
+  h = fnv1a(&seed, sizeof(seed), h);
+  h = fnv1a(&budget.max_iterations, sizeof(budget.max_iterations), h);
+  h = fnv1a(&budget.max_evaluations, sizeof(budget.max_evaluations), h);
+  h = fnv1a(&budget.max_seconds, sizeof(budget.max_seconds), h);
+  ArmijoParams armijo = armijo_params(function, method);
+  h = fnv1a(&armijo, sizeof(armijo), h);
+  return h == 0 ? 1 : h;
+}
+
+class Cache {
+  public:
+    /// Abre (ou cria, com a capacidade dada) o cache em path.
+    explicit Cache(const std::string& path, size_t capacity = 1 << 16);
+    ~Cache();
+
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
+
+    /// Procura key; se achar, preenche r e conta um acerto, senão conta uma falha.
+    bool lookup(uint64_t key, SolveResult& r);
+
+    /**
+     * Guarda o resultado de key. Resultados que dependem do momento da execução
+     * (TIME_LIMIT, CANCELLED) não são guardados.
+     */
+    void store(uint64_t key, const SolveResult& r);
+
+    size_t size();
+    size_t capacity();
+    size_t hits() const { return n_hits; }
+    size_t misses() const { return n_misses; }
+
+    /// Grava as páginas alteradas no disco.
+    void sync();
+
+  private:
+    void map(size_t capacity, bool create);
+    void grow();
+    CacheEntry* slot(uint64_t key);
+
+    std::string path;
+    int fd;
+    char* base;
+    size_t bytes;
+    CacheHeader* header;
+    CacheEntry* entries;
+    std::mutex mutex;
+    std::atomic<size_t> n_hits, n_misses;
+};
+
+inline Cache::Cache(const std::string& path, size_t capacity) :
+  path(path),
+  fd(-1),
+  base(NULL),
+  bytes(0),
+  header(NULL),
+  entries(NULL),
+  n_hits(0),
+  n_misses(0) {
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0)
+    throw std::runtime_error("ERROR: can't open cache " + path);
+
+  if (st.st_size == 0) {
+    size_t c = 16;
+    while (c < capacity)
+      c *= 2;
+    map(c, true);
+    return;
+  }
+
+  CacheHeader h;
+  if (st.st_size < (off_t) sizeof(h) || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+      memcmp(h.magic, CACHE_MAGIC, 8) != 0 ||
+      h.capacity == 0 || (h.capacity & (h.capacity - 1)) != 0 ||
+      (off_t) (sizeof(h) + h.capacity * sizeof(CacheEntry)) != st.st_size) {
+    close(fd);
+    throw std::runtime_error("ERROR: " + path + " is not a valid cache file");
+  }
+  map(h.capacity, false);
+}
+
+inline Cache::~Cache() {
+  if (base != NULL) {
+    msync(base, bytes, MS_SYNC);
+    munmap(base, bytes);
+  }
+  if (fd >= 0)
+    close(fd);
+}
+
+inline void Cache::map(size_t capacity, bool create) {
+  if (base != NULL)
+    munmap(base, bytes);
+  bytes = sizeof(CacheHeader) + capacity * sizeof(CacheEntry);
+  if (create && ftruncate(fd, bytes) != 0)
+    throw std::runtime_error("ERROR: can't resize cache " + path);
+  void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("ERROR: can't map cache " + path);
+  base = (char*) p;
+  header = (CacheHeader*) base;
+  entries = (CacheEntry*) (base + sizeof(CacheHeader));
+  if (create) {
+    memset(base, 0, bytes);
+    memcpy(header->magic, CACHE_MAGIC, 8);
+    header->capacity = capacity;
+  }
+}
+
+inline CacheEntry* Cache::slot(uint64_t key) {
+  size_t mask = header->capacity - 1;
+  size_t i = key & mask;
+  while (entries[i].key != 0 && entries[i].key != key)
+    i = (i + 1) & mask;
+  return &entries[i];
+}
+
+inline void Cache::grow() {
+  std::vector<CacheEntry> old;
+  old.reserve(header->count);
+  for (size_t i = 0; i < header->capacity; ++i)
+    if (entries[i].key != 0)
+      old.push_back(entries[i]);
+  map(2 * header->capacity, true);
+  for (size_t i = 0; i < old.size(); ++i)
+    *slot(old[i].key) = old[i];
+  header->count = old.size();
+}
+
+inline bool Cache::lookup(uint64_t key, SolveResult& r) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const CacheEntry* e = slot(key);
+  if (e->key == 0) {
+    ++n_misses;
+    return false;
+  }
+  r.x = Matrix(vector<double>{e->x1, e->x2});
+  r.fx = e->fx;
+  r.reason = (Termination) e->reason;
+  r.iterations = e->iterations;
+  r.n_call_armijo = e->n_call_armijo;
+  r.n_evaluations = e->n_evaluations;
+  ++n_hits;
+  return true;
+}
+
+inline void Cache::store(uint64_t key, const SolveResult& r) {
+  if (r.reason == TIME_LIMIT || r.reason == CANCELLED || r.x.length() != 2)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (2 * (header->count + 1) > header->capacity)
+    grow();
+  CacheEntry* e = slot(key);
+  if (e->key == 0)
+    ++header->count;
+  e->key = key;
+  e->x1 = r.x.x1();
+  e->x2 = r.x.x2();
+  e->fx = r.fx;
+  e->reason = r.reason;
+  e->iterations = r.iterations;
+  e->n_call_armijo = r.n_call_armijo;
+  e->n_evaluations = r.n_evaluations;
+}
+
+inline size_t Cache::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return header->count;
+}
+
+inline size_t Cache::capacity() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return header->capacity;
+}
+
+inline void Cache::sync() {
+  std::lock_guard<std::mutex> lock(mutex);
+  msync(base, bytes, MS_SYNC);
+}
+
+#endif // _CACHE_HPP_
@@ -0,0 +1,168 @@
+#ifndef _CHECKPOINT_HPP_
+#define _CHECKPOINT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "cache.hpp"
+#include "lib.hpp"
+
+/**
+ * Checkpoints: o estado de uma execução longa em um arquivo binário pequeno,
+ * para retomá-la depois de uma queda ou interrupção.
+ *
+ *    cabeçalho (32 bytes): "OTIMCKP1", tipo (uint32), reservado, tamanho (uint64), FNV-1a dos dados (uint64)
+ *    dados: SolveItState, ou MultiStartProgress
+ *
+ * O arquivo é escrito em path.tmp e renomeado, então um checkpoint nunca fica pela metade.
+ */
+
+#define CHECKPOINT_MAGIC "OTIMCKP1"
+
+/// Tipo do conteúdo do checkpoint.
+enum {CHECKPOINT_SOLVE_IT = 1, CHECKPOINT_MULTISTART = 2};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+/// Grava o checkpoint de forma atômica (arquivo temporário + rename).
+inline void save_checkpoint(const std::string& path, uint32_t kind, const void* data, size_t size) {
+  CheckpointHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CHECKPOINT_MAGIC, 8);
+  h.kind = kind;
+  h.size = size;
+  h.checksum = fnv1a(data, size);
+
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0 &&
+    write(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+    write(fd, data, size) == (ssize_t) size &&
+    fsync(fd) == 0;
+  if (fd >= 0)
+    close(fd);
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    throw std::runtime_error("ERROR: can't write checkpoint " + path);
+  }
+}
+
+/**
+ * Lê um checkpoint do tipo kind. Retorna false se o arquivo não existe;
+ * lança std::runtime_error se ele está corrompido ou é de outro tipo.
+ */
+inline bool load_checkpoint(const std::string& path, uint32_t kind, std::vector<char>& data) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  CheckpointHeader h;
+  bool ok = read(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+    memcmp(h.magic, CHECKPOINT_MAGIC, 8) == 0 && h.kind == kind && h.size < (1ULL << 32);
+  if (ok) {
+    data.resize(h.size);
+    ok = read(fd, data.data(), h.size) == (ssize_t) h.size && fnv1a(data.data(), h.size) == h.checksum;
+  }
+  close(fd);
+  if (!ok)
+    throw std::runtime_error("ERROR: " + path + " is not a valid checkpoint");
+  return true;
+}
+
+inline void save_checkpoint(const std::string& path, const SolveItState& state) {
+  save_checkpoint(path, CHECKPOINT_SOLVE_IT, &state, sizeof(state));
+}
+
+inline bool load_checkpoint(const std::string& path, SolveItState& state) {
+  std::vector<char> data;
+  if (!load_checkpoint(path, CHECKPOINT_SOLVE_IT, data))
+    return false;
+  if (data.size() != sizeof(state))
+    throw std::runtime_error("ERROR: " + path + " is not a valid checkpoint");
+  memcpy(&state, data.data(), sizeof(state));
+  return true;
+}
+
+/**
+ * Roda o solver até o fim, gravando um checkpoint em path a cada interval
+ * segundos. No fim, o checkpoint é apagado.
+ */
+inline SolveResult run_checkpointed(SolveIt& solver, const std::string& path, double interval) {
+  Timer timer;
+  while (solver.step()) {
+    if (timer.elapsed() >= interval) {
+      save_checkpoint(path, solver.checkpoint());
+      timer.reset();
+    }
+  }
+  unlink(path.c_str());
+  return solver.result();
+}
+
+/**
+ * Progresso de um multi-start dividido em blocos de pontos iniciais: um byte
+ * por bloco, 1 quando os resultados do bloco já estão no arquivo de saída.
+ */
+class MultiStartProgress {
+  public:
+    MultiStartProgress(size_t rows, size_t chunk, int function, int method, double epsilon) :
+      flags((rows + chunk - 1) / chunk, 0) {
+      memset(&info, 0, sizeof(info));
+      info.rows = rows;
+      info.chunk = chunk;
+      info.function = function;
+      info.method = method;
+      info.epsilon = epsilon;
+    }
+
+    /**
+     * Carrega o progresso salvo em path. Retorna false se não há checkpoint;
+     * lança std::runtime_error se ele é de outra execução (outros parâmetros).
+     */
+    bool load(const std::string& path) {
+      std::vector<char> data;
+      if (!load_checkpoint(path, CHECKPOINT_MULTISTART, data))
+        return false;
+      if (data.size() != sizeof(info) + flags.size() || memcmp(data.data(), &info, sizeof(info)) != 0)
+        throw std::runtime_error("ERROR: checkpoint " + path + " belongs to a different run");
+      memcpy(flags.data(), data.data() + sizeof(info), flags.size());
+      return true;
+    }
+
+    void save(const std::string& path) const {
+      std::vector<char> data(sizeof(info) + flags.size());
+      memcpy(data.data(), &info, sizeof(info));
+      memcpy(data.data() + sizeof(info), flags.data(), flags.size());
+      save_checkpoint(path, CHECKPOINT_MULTISTART, data.data(), data.size());
+    }
+
+    size_t chunks() const { return flags.size(); }
+    bool done(size_t chunk) const { return flags[chunk] != 0; }
+    void mark(size_t chunk) { flags[chunk] = 1; }
+
+    size_t completed() const {
+      size_t n = 0;
+      for (size_t i = 0; i < flags.size(); ++i)
+        n += flags[i];
+      return n;
+    }
+
+  private:
+    struct {
+      uint64_t rows, chunk;
+      int32_t function, method;
+      double epsilon;
+    } info;
+    std::vector<uint8_t> flags;
+};
+
+#endif // _CHECKPOINT_HPP_
@@ -0,0 +1,784 @@
+/**
+ * otim: linha de comando para rodar vários problemas sem recompilar.
+ *
+ * Uso:
+ *    otim run [-t threads] [-b lote] [-w janela] [-o saída] [-c cache] [jobs.txt]
+ *    otim solve [-k checkpoint] [-i segundos] job
+ *    otim min [-f função] [-m método] [-e epsilon] [-t threads] [-b lote] [-k checkpoint] [-i segundos]
+ *             pontos.col resultados.col
+ *    otim convert entrada saída
+ *    otim landscape [-f função] [-L lambdak] [-x xkk1,xkk2] [-r x1min,x1max,x2min,x2max] [-n nx[,ny]]
+ *                   [-g] [-T bloco] [-t threads] [-p imagem.pgm] [-s passo] saída.lnd
+ *    otim basin [-f função] [-m método] [-e epsilon] [-i iterações] [-r x1min,x1max,x2min,x2max]
+ *               [-n nx[,ny]] [-t threads] [-p imagem.ppm] saída.bsn
+ *    otim sweep [-f função] [-m método] [opções da varredura]
+ *    otim tune [-f funções] [-m métodos] [opções da varredura] perfil.txt
+ *    otim expr [-m método] [-e epsilon] [-x x1,x2,...] [-i iterações] [-d] [-c] expressão
+ *    otim expr [-m método] [-e epsilon] [-x x1,x2,...] [-i iterações] -f função
+ *    otim functions
+ *    otim bench [-n rodadas] [-r referência]
+ *    otim fit [-m método] [-e epsilon] [-x x1,x2,...] [-i iterações] [-t threads] [-y coluna] [-s] dados.col
+ *
+ * Opções da varredura: [-e epsilon] [-n pontos] [-l limite] [-S semente] [-i iterações]
+ *    [-s s1,s2,...] [-B beta1,...] [-g sigma1,...] [-R combinações sorteadas] [-t threads]
+ *
+ * Antes do comando, -P perfil.txt carrega os parâmetros de Armijo de um perfil (tune.hpp)
+ * e cada -L plugin.so carrega um plugin de funções objetivo (plugin.hpp); as
+ * funções do plugin valem pelo nome em solve, run e expr -f.
+ *
+ * run lê um job por linha (formato em jobs.hpp; "-" ou nada = entrada padrão)
+ * e escreve um resultado por linha, na mesma ordem. Com -c, os resultados
+ * ficam guardados no arquivo de cache (cache.hpp) e jobs repetidos não rodam de novo.
+ *
+ * solve roda um único job kind=solve (a linha vai como argumento).
+ *
+ * min minimiza f a partir de cada ponto (colunas x1, x2) de um arquivo colunar
+ * (columnar.hpp) e escreve os resultados (RESULT_COLUMNS) em outro, ambos mapeados em memória.
+ *
+ * landscape avalia f (ou g, com -L e -x) em uma grade (landscape.hpp); -g também
+ * grava |grad|, -p gera uma imagem PGM do valor (um ponto a cada -s em cada direção).
+ *
+ * basin roda o método a partir de cada ponto de uma grade e grava o mapa das
+ * bacias de atração (basin.hpp); -p gera uma imagem PPM colorida pelo motivo de parada.
+ *
+ * sweep roda o BatchSolver com cada combinação (s, beta, sigma) da grade -s x -B x -g
+ * (ou -R combinações sorteadas) a partir dos mesmos pontos iniciais e lista as
+ * combinações da melhor para a pior; tune faz o mesmo para cada (função, método)
+ * (-f e -m aceitam listas; por padrão, todos) e grava o perfil com as melhores.
+ *
+ * expr minimiza uma função dada por uma expressão (expr.hpp), como
+ * "x1^2 + (exp(x1) - x2)^2", a partir de -x (padrão: a origem), com o gradiente
+ * e a hessiana derivados simbolicamente; -d lista o bytecode na saída de erro;
+ * -c compila a expressão para código nativo (codegen.hpp) em vez de interpretá-la.
+ * Com -f, minimiza uma função registrada (de um plugin) em vez de uma expressão.
+ *
+ * functions lista as funções registradas, com a dimensão e se têm hessiana.
+ *
+ * bench roda o benchmark padrão (bench.hpp) e escreve a vazão; com -r, compara
+ * com a saída de outro bench (de outro build) e escreve o ganho.
+ *
+ * fit ajusta por mínimos quadrados (finitesum.hpp) a coluna -y (padrão: y) de
+ * um arquivo colunar às outras colunas, na ordem do arquivo: minimiza a soma de
+ * (a.x - y)^2 / 2 sobre as linhas, com as somas divididas entre -t threads.
+ * Com -s, o arquivo é lido em trechos a cada avaliação (stream.hpp), para dados
+ * maiores que a memória.
+ *
+ * Com -k, solve e min gravam um checkpoint (checkpoint.hpp) a cada -i segundos;
+ * se o checkpoint já existe, a execução continua de onde parou.
+ *
+ * convert converte entre CSV e o formato colunar (pela extensão .csv da entrada
+ * ou da saída; saída "-" escreve CSV na saída padrão).
+ */
+#include <fstream>
+#include <getopt.h>
+#include "basin.hpp"
+#include "bench.hpp"
+#include "checkpoint.hpp"
+#include "codegen.hpp"
+#include "columnar.hpp"
+#include "expr.hpp"
+#include "finitesum.hpp"
+#include "jobs.hpp"
+#include "landscape.hpp"
+#include "plugin.hpp"
+#include "pool.hpp"
+#include "stream.hpp"
+#include "tune.hpp"
+using namespace std;
+
+static int usage() {
+  std::cerr << "usage:" << std::endl
+    << "  otim run [-t threads] [-b batch] [-w window] [-o output] [-c cache] [jobs.txt]" << std::endl
+    << "  otim solve [-k checkpoint] [-i seconds] job" << std::endl
+    << "  otim min [-f function] [-m method] [-e epsilon] [-t threads] [-b batch] [-k checkpoint] [-i seconds]"
+    << " starts.col results.col" << std::endl
+    << "  otim convert input output" << std::endl
+    << "  otim landscape [-f function] [-L lambdak] [-x xkk1,xkk2] [-r x1min,x1max,x2min,x2max] [-n nx[,ny]]"
+    << " [-g] [-T tile] [-t threads] [-p image.pgm] [-s stride] output.lnd" << std::endl
+    << "  otim basin [-f function] [-m method] [-e epsilon] [-i iterations] [-r x1min,x1max,x2min,x2max]"
+    << " [-n nx[,ny]] [-t threads] [-p image.ppm] output.bsn" << std::endl
+    << "  otim sweep [-f function] [-m method] [sweep options]" << std::endl
+    << "  otim tune [-f functions] [-m methods] [sweep options] profile.txt" << std::endl
+    << "  otim expr [-m method] [-e epsilon] [-x x1,x2,...] [-i iterations] [-d] [-c] expression" << std::endl
+    << "  otim expr [-m method] [-e epsilon] [-x x1,x2,...] [-i iterations] -f function" << std::endl
+    << "  otim functions" << std::endl
+    << "  otim bench [-n rounds] [-r reference]" << std::endl
+    << "  otim fit [-m method] [-e epsilon] [-x x1,x2,...] [-i iterations] [-t threads] [-y column] [-s]"
+    << " data.col" << std::endl
+    << "sweep options: [-e epsilon] [-n starts] [-l limit] [-S seed] [-i iterations]"
+    << " [-s s1,s2,...] [-B beta1,...] [-g sigma1,...] [-R samples] [-t threads]" << std::endl
+    << "global options: otim [-P profile.txt] [-L plugin.so]... <command> ... load Armijo parameters"
+    << " and objective plugins" << std::endl;
+  return 2;
+}
+
+static int cmd_run(int argc, char **argv) {
+  unsigned threads = 0;
+  size_t batch = 64;
+  size_t window = 1 << 16;
+  string output = "-";
+  string cache_path;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:b:w:o:c:")) != -1) {
+    switch (opt) {
+      case 't': threads = atoi(optarg); break;
+      case 'b': batch = std::max(1, atoi(optarg)); break;
+      case 'w': window = std::max(1, atoi(optarg)); break;
+      case 'o': output = optarg; break;
+      case 'c': cache_path = optarg; break;
+      default: return usage();
+    }
+  }
+  string input = optind < argc ? argv[optind] : "-";
+
+  std::ifstream fin;
+  if (input != "-") {
+    fin.open(input.c_str());
+    if (!fin) {
+      std::cerr << "ERROR: can't open " << input << std::endl;
+      return 1;
+    }
+  }
+  std::ofstream fout;
+  if (output != "-") {
+    fout.open(output.c_str());
+    if (!fout) {
+      std::cerr << "ERROR: can't create " << output << std::endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<Cache> cache;
+  if (!cache_path.empty())
+    cache.reset(new Cache(cache_path));
+
+  ThreadPool pool(threads);
+  Timer timer;
+  JobStats stats = process_jobs(input == "-" ? std::cin : fin, output == "-" ? std::cout : fout,
+      pool, batch, window, cache.get());
+  std::cerr << "INFO: " << stats.jobs << " jobs (" << stats.errors << " invalid lines) in "
+    << timer.elapsed() << "s with " << pool.size() << " threads" << std::endl;
+  if (cache) {
+    std::cerr << "INFO: cache " << cache_path << ": " << cache->hits() << " hits, "
+      << cache->misses() << " misses, " << cache->size() << " entries" << std::endl;
+  }
+  return stats.errors == 0 ? 0 : 1;
+}
+
+static int cmd_solve(int argc, char **argv) {
+  string checkpoint;
+  double interval = 10.0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "k:i:")) != -1) {
+    switch (opt) {
+      case 'k': checkpoint = optarg; break;
+      case 'i': interval = atof(optarg); break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != 1)
+    return usage();
+
+  Job job;
+  string error;
+  if (!parse_job(argv[optind], job, error) || job.kind != SOLVE) {
+    std::cerr << "ERROR: " << (error.empty() ? "not a kind=solve job" : error) << std::endl;
+    return 2;
+  }
+
+  Timer timer;
+  JobResult r;
+  SolveItState state;
+  if (!checkpoint.empty() && load_checkpoint(checkpoint, state)) {
+    std::cerr << "INFO: resuming from " << checkpoint << " at iteration " << state.iter << std::endl;
+    SolveIt solver(state, job.budget);
+    solver.setPortfolio(job.portfolio);
+    solver.setAnderson(job.anderson);
+    solver.setHessianReuse(job.hessian_reuse);
+    r.result = run_checkpointed(solver, checkpoint, interval);
+    r.wins = portfolio_wins(job, solver);
+  }
+  else {
+    SolveIt solver(job.function, Matrix(vector<double>{job.x1, job.x2}), job.limitx0,
+        job.epsilonSub, job.epsilonMeth, job.method, job.budget);
+    solver.setSeed(job.seed);
+    solver.setPortfolio(job.portfolio);
+    solver.setAnderson(job.anderson);
+    solver.setHessianReuse(job.hessian_reuse);
+    r.result = checkpoint.empty() ? solver.run() : run_checkpointed(solver, checkpoint, interval);
+    r.wins = portfolio_wins(job, solver);
+  }
+  r.seconds = timer.elapsed();
+  std::cout << format_result(job, r) << std::endl;
+  return 0;
+}
+
+static int cmd_min(int argc, char **argv) {
+  int function = FA;
+  int method = GRADIENT;
+  double epsilon = 1e-6;
+  unsigned threads = 0;
+  size_t batch = 4096;
+  string checkpoint;
+  double interval = 10.0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:m:e:t:b:k:i:")) != -1) {
+    switch (opt) {
+      case 'f': function = parse_function(optarg); break;
+      case 'm': method = parse_method(optarg); break;
+      case 'e': epsilon = atof(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'b': batch = std::max(1, atoi(optarg)); break;
+      case 'k': checkpoint = optarg; break;
+      case 'i': interval = atof(optarg); break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != 2 || function < 0 || method < 0)
+    return usage();
+  BatchSolver check(function, method, epsilon);   // valida a combinação antes de criar as threads
+
+  ColumnFile starts(argv[optind]);
+  const double* x01 = starts.column("x1");
+  const double* x02 = starts.column("x2");
+  size_t n = starts.rows();
+
+  // Com checkpoint, os blocos já resolvidos ficam no arquivo de saída e são pulados.
+  MultiStartProgress progress(n, batch, function, method, epsilon);
+  bool resume = !checkpoint.empty() && progress.load(checkpoint);
+  std::unique_ptr<ColumnWriter> out(resume ? new ColumnWriter(argv[optind + 1]) :
+      new ColumnWriter(argv[optind + 1], n, RESULT_COLUMNS));
+  if (out->rows() != n)
+    throw std::runtime_error("ERROR: " + string(argv[optind + 1]) + " doesn't match the checkpoint");
+  if (resume) {
+    std::cerr << "INFO: resuming from " << checkpoint << ": " << progress.completed() << " of "
+      << progress.chunks() << " batches done" << std::endl;
+  }
+  double* x1 = out->column("x1");
+  double* x2 = out->column("x2");
+  double* f = out->column("f");
+  double* status = out->column("status");
+  double* iterations = out->column("iterations");
+  double* evaluations = out->column("evaluations");
+
+  ThreadPool pool(threads);
+  Timer timer, last_checkpoint;
+  std::mutex mutex;
+  std::atomic<size_t> converged(0);
+  parallel_for(pool, n, batch, [&](size_t begin, size_t end) {
+    if (progress.done(begin / batch)) {
+      size_t ok = 0;
+      for (size_t k = begin; k < end; ++k)
+        ok += status[k] == CONVERGED;
+      converged += ok;
+      return;
+    }
+    BatchSolver solver(function, method, epsilon);
+    vector<StartResult> r(end - begin);
+    solver.solve(x01 + begin, x02 + begin, end - begin, r.data());
+    size_t ok = 0;
+    for (size_t k = 0; k < r.size(); ++k) {
+      x1[begin + k] = r[k].x1;
+      x2[begin + k] = r[k].x2;
+      f[begin + k] = r[k].f;
+      status[begin + k] = r[k].reason;
+      iterations[begin + k] = r[k].iterations;
+      evaluations[begin + k] = r[k].evaluations;
+      ok += r[k].converged();
+    }
+    converged += ok;
+
+    if (!checkpoint.empty()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      progress.mark(begin / batch);
+      if (last_checkpoint.elapsed() >= interval) {
+        out->sync();
+        progress.save(checkpoint);
+        last_checkpoint.reset();
+      }
+    }
+  });
+  out->close();
+  if (!checkpoint.empty())
+    unlink(checkpoint.c_str());
+  std::cerr << "INFO: " << n << " starts (" << converged << " converged) in "
+    << timer.elapsed() << "s with " << pool.size() << " threads" << std::endl;
+  return 0;
+}
+
+static bool is_csv(const string& path) {
+  return path == "-" || (path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0);
+}
+
+static int cmd_convert(int argc, char **argv) {
+  if (argc != 3)
+    return usage();
+  string input = argv[1], output = argv[2];
+  size_t rows;
+  if (is_csv(input) && !is_csv(output))
+    rows = csv_to_columns(input, output);
+  else if (!is_csv(input) && is_csv(output)) {
+    std::ofstream fout;
+    if (output != "-") {
+      fout.open(output.c_str());
+      if (!fout) {
+        std::cerr << "ERROR: can't create " << output << std::endl;
+        return 1;
+      }
+    }
+    rows = columns_to_csv(input, output == "-" ? std::cout : fout);
+  }
+  else {
+    std::cerr << "ERROR: exactly one of input and output must be a .csv file" << std::endl;
+    return 2;
+  }
+  std::cerr << "INFO: converted " << rows << " rows" << std::endl;
+  return 0;
+}
+
+static int cmd_landscape(int argc, char **argv) {
+  LandscapeSpec spec;
+  unsigned threads = 0;
+  string pgm;
+  size_t stride = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:L:x:r:n:gT:t:p:s:")) != -1) {
+    switch (opt) {
+      case 'f':
+        if ((spec.function = parse_function(optarg)) < 0)
+          return usage();
+        break;
+      case 'L': spec.lambdak = atof(optarg); break;
+      case 'x':
+        if (sscanf(optarg, "%lf,%lf", &spec.xkk1, &spec.xkk2) != 2)
+          return usage();
+        break;
+      case 'r':
+        if (sscanf(optarg, "%lf,%lf,%lf,%lf", &spec.x1min, &spec.x1max, &spec.x2min, &spec.x2max) != 4)
+          return usage();
+        break;
+      case 'n':
+        if (sscanf(optarg, "%zu,%zu", &spec.nx, &spec.ny) == 1)
+          spec.ny = spec.nx;
+        break;
+      case 'g': spec.gradient = true; break;
+      case 'T': spec.tile = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'p': pgm = optarg; break;
+      case 's': stride = std::max(1, atoi(optarg)); break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != 1)
+    return usage();
+
+  ThreadPool pool(threads);
+  Timer timer;
+  LandscapeHeader h = compute_landscape(spec, argv[optind], pool);
+  double seconds = timer.elapsed();
+  std::cerr << "INFO: " << h.nx * h.ny << " points in " << seconds << "s ("
+    << h.nx * h.ny / seconds / 1e6 << " Mpoints/s) with " << pool.size() << " threads" << std::endl;
+  std::cerr << "INFO: f in [" << h.vmin[0] << ", " << h.vmax[0] << "]";
+  if (spec.gradient)
+    std::cerr << ", |grad| in [" << h.vmin[1] << ", " << h.vmax[1] << "]";
+  std::cerr << std::endl;
+
+  if (!pgm.empty()) {
+    LandscapeFile in(argv[optind]);
+    landscape_to_pgm(in, 0, pgm, stride);
+  }
+  return 0;
+}
+
+static int cmd_basin(int argc, char **argv) {
+  BasinSpec spec;
+  unsigned threads = 0;
+  string ppm;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:m:e:i:r:n:t:p:")) != -1) {
+    switch (opt) {
+      case 'f':
+        if ((spec.function = parse_function(optarg)) < 0)
+          return usage();
+        break;
+      case 'm':
+        if ((spec.method = parse_method(optarg)) < 0)
+          return usage();
+        break;
+      case 'e': spec.epsilon = atof(optarg); break;
+      case 'i': spec.max_iterations = atoi(optarg); break;
+      case 'r':
+        if (sscanf(optarg, "%lf,%lf,%lf,%lf", &spec.x1min, &spec.x1max, &spec.x2min, &spec.x2max) != 4)
+          return usage();
+        break;
+      case 'n':
+        if (sscanf(optarg, "%zu,%zu", &spec.nx, &spec.ny) == 1)
+          spec.ny = spec.nx;
+        break;
+      case 't': threads = atoi(optarg); break;
+      case 'p': ppm = optarg; break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != 1)
+    return usage();
+
+  ThreadPool pool(threads);
+  Timer timer;
+  BasinHeader h = compute_basin(spec, argv[optind], pool);
+  double seconds = timer.elapsed();
+  size_t n = h.nx * h.ny;
+  std::cerr << "INFO: " << n << " starts in " << seconds << "s (" << n / seconds << " starts/s) with "
+    << pool.size() << " threads, " << (double) h.total_iterations / n << " iterations on average" << std::endl;
+  for (unsigned k = 0; k < BASIN_REASONS; ++k)
+    if (h.count[k] > 0)
+      std::cerr << "INFO: " << status_name((Termination) k) << ": " << h.count[k] << std::endl;
+
+  if (!ppm.empty()) {
+    BasinFile in(argv[optind]);
+    basin_to_ppm(in, ppm);
+  }
+  return 0;
+}
+
+/// Lista de números separados por vírgula.
+static vector<double> parse_list(const char* text) {
+  vector<double> values;
+  std::istringstream in(text);
+  string item;
+  while (std::getline(in, item, ','))
+    values.push_back(atof(item.c_str()));
+  return values;
+}
+
+/**
+ * Lê as opções de sweep e tune. As de função e método ficam em functions e
+ * methods (listas separadas por vírgula). Retorna false em opção inválida.
+ */
+static bool parse_sweep_options(int argc, char **argv, SweepSpec& spec, vector<ArmijoParams>& params,
+    vector<int>& functions, vector<int>& methods, unsigned& threads) {
+  vector<double> s = {0.5, 1.0, 2.0}, beta = {0.3, 0.5, 0.7}, sigma = {1e-4, 1e-2, 0.1, 0.3};
+  size_t samples = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:m:e:n:l:S:i:s:B:g:R:t:")) != -1) {
+    std::istringstream names(opt == 'f' || opt == 'm' ? optarg : "");
+    string name;
+    switch (opt) {
+      case 'f':
+        while (std::getline(names, name, ',')) {
+          functions.push_back(parse_function(name));
+          if (functions.back() < 0)
+            return false;
+        }
+        break;
+      case 'm':
+        while (std::getline(names, name, ',')) {
+          methods.push_back(parse_method(name));
+          if (methods.back() < 0)
+            return false;
+        }
+        break;
+      case 'e': spec.epsilon = atof(optarg); break;
+      case 'n': spec.starts = std::max(1, atoi(optarg)); break;
+      case 'l': spec.limit = atof(optarg); break;
+      case 'S': spec.seed = atoi(optarg); break;
+      case 'i': spec.budget.max_iterations = atoi(optarg); break;
+      case 's': s = parse_list(optarg); break;
+      case 'B': beta = parse_list(optarg); break;
+      case 'g': sigma = parse_list(optarg); break;
+      case 'R': samples = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      default: return false;
+    }
+  }
+  params = samples > 0 ? sweep_random(samples, spec.seed) : sweep_grid(s, beta, sigma);
+  return true;
+}
+
+static int cmd_sweep(int argc, char **argv) {
+  SweepSpec spec;
+  vector<ArmijoParams> params;
+  vector<int> functions, methods;
+  unsigned threads = 0;
+  if (!parse_sweep_options(argc, argv, spec, params, functions, methods, threads) || optind != argc ||
+      functions.size() > 1 || methods.size() > 1)
+    return usage();
+  if (!functions.empty())
+    spec.function = functions[0];
+  if (!methods.empty())
+    spec.method = methods[0];
+
+  ThreadPool pool(threads);
+  Timer timer;
+  vector<SweepResult> results = sweep(spec, params, pool);
+  std::cerr << "INFO: " << params.size() << " parameter sets x " << spec.starts << " starts in "
+    << timer.elapsed() << "s with " << pool.size() << " threads" << std::endl;
+  for (size_t i = 0; i < results.size(); ++i)
+    cout << "s=" << results[i].params.s << " beta=" << results[i].params.beta
+      << " sigma=" << results[i].params.sigma << " converged=" << results[i].converged
+      << " evaluations=" << results[i].evaluations << " iterations=" << results[i].iterations
+      << " seconds=" << results[i].seconds << std::endl;
+  return 0;
+}
+
+static int cmd_tune(int argc, char **argv) {
+  SweepSpec spec;
+  vector<ArmijoParams> params;
+  vector<int> functions, methods;
+  unsigned threads = 0;
+  if (!parse_sweep_options(argc, argv, spec, params, functions, methods, threads) || argc - optind != 1)
+    return usage();
+  if (functions.empty())
+    functions = {FA, FB, FC};
+  if (methods.empty())
+    methods = {GRADIENT, NEWTON, NEWTONPURE, QUASINEWTON};
+
+  ThreadPool pool(threads);
+  Timer timer;
+  vector<ProfileEntry> profile = autotune(spec, functions, methods, params, pool, &std::cerr);
+  save_profile(argv[optind], profile);
+  std::cerr << "INFO: " << profile.size() << " profile entries written to " << argv[optind]
+    << " in " << timer.elapsed() << "s" << std::endl;
+  return 0;
+}
+
+/// Uma função registrada com a interface de objetivo que expr_method usa.
+struct RegisteredObjective {
+  const UserFunction* fn;
+  unsigned dimension() const { return fn->dimension; }
+  std::function<double(Matrix)> f() const { return fn->f; }
+  std::function<Matrix(Matrix)> gradf() const { return fn->gradf; }
+  std::function<Matrix(Matrix)> hessf() const {
+    if (!fn->hessf)
+      throw std::invalid_argument("ERROR: " + fn->name + " has no hessian");
+    return fn->hessf;
+  }
+};
+
+static int cmd_expr(int argc, char **argv) {
+  int method = GRADIENT;
+  double epsilon = 1e-6;
+  vector<double> x0;
+  Budget budget;
+  bool listing = false, native = false;
+  string function;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:e:x:i:dcf:")) != -1) {
+    switch (opt) {
+      case 'm': method = parse_method(optarg); break;
+      case 'e': epsilon = atof(optarg); break;
+      case 'x': x0 = parse_list(optarg); break;
+      case 'i': budget.max_iterations = atoi(optarg); break;
+      case 'd': listing = true; break;
+      case 'c': native = true; break;
+      case 'f': function = optarg; break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != (function.empty() ? 1 : 0) || method < 0)
+    return usage();
+
+  std::unique_ptr<ExprObjective> obj;
+  RegisteredObjective registered = {NULL};
+  if (function.empty())
+    obj.reset(new ExprObjective(argv[optind]));
+  else if ((registered.fn = user_function(parse_function(function))) == NULL)
+    throw std::invalid_argument("ERROR: unknown function '" + function + "' (only registered functions work with -f)");
+  unsigned dimension = obj ? obj->dimension() : registered.dimension();
+  if (x0.empty())
+    x0.assign(dimension, 0.0);
+  if (x0.size() != dimension)
+    throw std::invalid_argument("ERROR: -x needs " + std::to_string(dimension) + " coordinates");
+  if (listing && obj) {
+    std::cerr << "INFO: " << obj->dag().size() << " DAG nodes" << std::endl
+      << "# f" << std::endl << obj->valueProgram().disassemble()
+      << "# f, gradient" << std::endl << obj->gradientProgram().disassemble()
+      << "# hessian" << std::endl << obj->hessianProgram().disassemble();
+  }
+
+  Timer timer;
+  std::unique_ptr<Method> m;
+  if (!obj)
+    m.reset(expr_method(registered, method, Matrix(x0), epsilon, budget));
+  else if (native) {
+    NativeObjective compiled(*obj);
+    std::cerr << "INFO: " << (compiled.cached() ? "cached " : "compiled ") << compiled.path()
+      << " (" << timer.elapsed() << " s)" << std::endl;
+    m.reset(expr_method(compiled, method, Matrix(x0), epsilon, budget));
+  }
+  else
+    m.reset(expr_method(*obj, method, Matrix(x0), epsilon, budget));
+  SolveResult r = m->run();
+  std::cout << std::setprecision(17) << "status=" << status_name(r.reason);
+  for (unsigned i = 1; i <= dimension; ++i)
+    std::cout << " x" << i << "=" << r.x.get(i);
+  std::cout << " f=" << r.fx
+    << " iterations=" << r.iterations
+    << " evaluations=" << r.n_evaluations
+    << " seconds=" << std::setprecision(6) << timer.elapsed() << std::endl;
+  return r.converged() ? 0 : 1;
+}
+
+static int cmd_functions(int argc, char **argv) {
+  if (argc != 1)
+    return usage();
+  std::cout << "FA dimension=2 hessian=yes" << std::endl
+    << "FB dimension=2 hessian=no" << std::endl
+    << "FC dimension=2 hessian=no" << std::endl;
+  for (size_t i = 0; i < USER_FUNCTIONS.size(); ++i)
+    std::cout << USER_FUNCTIONS[i].name << " dimension=" << USER_FUNCTIONS[i].dimension
+      << " hessian=" << (USER_FUNCTIONS[i].numeric_hessian ? "fd" : "yes") << std::endl;
+  return 0;
+}
+
+static int cmd_bench(int argc, char **argv) {
+  unsigned rounds = 5;
+  string reference;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+      case 'n': rounds = atoi(optarg); break;
+      case 'r': reference = optarg; break;
+      default: return usage();
+    }
+  }
+  if (optind != argc)
+    return usage();
+
+  BenchResult base;
+  if (!reference.empty())
+    base = load_bench(reference);
+  BenchResult r = run_bench(rounds);
+  std::cout << format_bench(r) << std::endl;
+  if (!reference.empty()) {
+    if (base.evaluations != r.evaluations)
+      std::cerr << "WARNING: " << reference << " did " << base.evaluations << " evaluations per round, this build "
+        << r.evaluations << ": the builds don't compute the same thing" << std::endl;
+    std::cout << "reference=" << base.build << " reference_throughput=" << base.throughput
+      << " gain=" << std::showpos << std::setprecision(3) << 100.0 * (r.throughput / base.throughput - 1.0)
+      << std::noshowpos << "%" << std::endl;
+  }
+  return 0;
+}
+
+static int cmd_fit(int argc, char **argv) {
+  int method = GRADIENT;
+  double epsilon = 1e-6;
+  vector<double> x0;
+  Budget budget;
+  unsigned threads = 0;
+  string target = "y";
+  bool streaming = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:e:x:i:t:y:s")) != -1) {
+    switch (opt) {
+      case 'm': method = parse_method(optarg); break;
+      case 'e': epsilon = atof(optarg); break;
+      case 'x': x0 = parse_list(optarg); break;
+      case 'i': budget.max_iterations = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'y': target = optarg; break;
+      case 's': streaming = true; break;
+      default: return usage();
+    }
+  }
+  if (argc - optind != 1 || method < 0)
+    return usage();
+
+  ColumnFile data(argv[optind]);
+  const double* y = data.column(target);
+  vector<const double*> features;
+  vector<string> names;
+  for (unsigned c = 0; c < data.cols(); ++c)
+    if (data.name(c) != target) {
+      features.push_back(data.column(c));
+      names.push_back(data.name(c));
+    }
+  if (x0.empty())
+    x0.assign(features.size(), 0.0);
+  if (x0.size() != features.size())
+    throw std::invalid_argument("ERROR: -x needs " + std::to_string(features.size()) + " coordinates");
+
+  Timer timer;
+  LeastSquares terms(features, y, data.rows());
+  std::unique_ptr<Method> m;
+  if (streaming) {
+    names.push_back(target);
+    StreamObjective obj(argv[optind], names, least_squares_chunk, threads);
+    m.reset(expr_method(obj, method, Matrix(x0), epsilon, budget));
+  }
+  else
+    m.reset(expr_method(SumObjective(terms, threads), method, Matrix(x0), epsilon, budget));
+  SolveResult r = m->run();
+  std::cout << std::setprecision(17) << "status=" << status_name(r.reason);
+  for (unsigned c = 0, i = 1; c < data.cols(); ++c)
+    if (data.name(c) != target)
+      std::cout << " " << data.name(c) << "=" << r.x.get(i++);
+  std::cout << " f=" << r.fx
+    << " rows=" << data.rows()
+    << " iterations=" << r.iterations
+    << " evaluations=" << r.n_evaluations
+    << " seconds=" << std::setprecision(6) << timer.elapsed() << std::endl;
+  return r.converged() ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  // Os relatórios dos métodos não fazem sentido com milhares de jobs.
+  VERBOSE = false;
+
+  try {
+    while (argc >= 3 && (string(argv[1]) == "-P" || string(argv[1]) == "-L")) {
+      if (string(argv[1]) == "-P") {
+        size_t n = load_profile(argv[2]);
+        std::cerr << "INFO: " << n << " Armijo profile entries loaded from " << argv[2] << std::endl;
+      }
+      else {
+        size_t n = load_plugin(argv[2]).size();
+        std::cerr << "INFO: " << n << " objectives loaded from " << argv[2] << std::endl;
+      }
+      argc -= 2;
+      argv += 2;
+    }
+    if (argc < 2)
+      return usage();
+
+    string command = argv[1];
+    if (command == "run")
+      return cmd_run(argc - 1, argv + 1);
+    if (command == "solve")
+      return cmd_solve(argc - 1, argv + 1);
+    if (command == "min")
+      return cmd_min(argc - 1, argv + 1);
+    if (command == "convert")
+      return cmd_convert(argc - 1, argv + 1);
+    if (command == "landscape")
+      return cmd_landscape(argc - 1, argv + 1);
+    if (command == "basin")
+      return cmd_basin(argc - 1, argv + 1);
+    if (command == "sweep")
+      return cmd_sweep(argc - 1, argv + 1);
+    if (command == "tune")
+      return cmd_tune(argc - 1, argv + 1);
+    if (command == "expr")
+      return cmd_expr(argc - 1, argv + 1);
+    if (command == "functions")
+      return cmd_functions(argc - 1, argv + 1);
+    if (command == "bench")
+      return cmd_bench(argc - 1, argv + 1);
+    if (command == "fit")
+      return cmd_fit(argc - 1, argv + 1);
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return usage();
+}
@@ -0,0 +1,324 @@
+#ifndef _CODEGEN_HPP_
+#define _CODEGEN_HPP_
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <pwd.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "cache.hpp"
+#include "expr.hpp"
+
+/**
+ * Código nativo para objetivos do expr.hpp: o DAG vira uma função C++ em linha
+ * reta (um temporário por nó, então as subexpressões comuns são calculadas uma
+ * vez, e f, gradiente e hessiana saem da mesma passada), compilada pelo
+ * compilador instalado em um .so e carregada com dlopen.
+ *
+ * Os .so ficam em um diretório de cache com o nome dado pelo hash FNV-1a do
+ * código, do compilador, das opções e de LIB_VERSION: a mesma expressão só é
+ * compilada uma vez. Variáveis de ambiente:
+ *    OTIM_CXX          compilador (padrão: c++)
+ *    OTIM_CXXFLAGS     opções, separadas por espaços (padrão: -O2)
+ *    OTIM_JIT_CACHE    diretório do cache (padrão: $XDG_CACHE_HOME/otim-jit ou ~/.cache/otim-jit)
+ *
+ * Como o .so é carregado no processo, o cache só é usado se o diretório e o
+ * .so são do usuário e ninguém mais pode escrever neles.
+ *
+ * O .so exporta, em C:
+ *    unsigned otim_dimension();
+ *    void otim_values(const double* const* x, size_t count, double* const* y);      // f
+ *    void otim_gradients(const double* const* x, size_t count, double* const* y);   // f, gradiente
+ *    void otim_hessians(const double* const* x, size_t count, double* const* y);    // triângulo superior
+ * com as mesmas convenções de ExprProgram::run.
+ */
+
+typedef unsigned (*NativeDimension)();
+typedef void (*NativeKernel)(const double* const*, size_t, double* const*);
+
+/// Literal C++ que reproduz v exatamente.
+inline std::string cpp_literal(double v) {
+  if (std::isnan(v))
+    return "NAN";
+  if (std::isinf(v))
+    return v > 0 ? "INFINITY" : "(-INFINITY)";
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.17g", v);
+  std::string s = buffer;
+  if (s.find_first_of(".en") == std::string::npos)
+    s += ".0";
+  return v < 0 ? "(" + s + ")" : s;
+}
+
+/// Corpo de uma função que calcula os nós outputs, ponto a ponto.
+inline void emit_kernel(std::ostream& out, const ExprGraph& graph, const std::vector<int>& outputs, const char* name) {
+  std::vector<bool> needed(graph.size(), false);
+  for (size_t i = 0; i < outputs.size(); ++i)
+    needed[outputs[i]] = true;
+  for (int k = graph.size() - 1; k >= 0; --k)
+    if (needed[k]) {
+      if (graph.node(k).a >= 0)
+        needed[graph.node(k).a] = true;
+      if (graph.node(k).b >= 0)
+        needed[graph.node(k).b] = true;
+    }
+
+  out << "void " << name << "(const double* const* x, size_t count, double* const* y) {\n"
+    << "  for (size_t i = 0; i < count; ++i) {\n";
+  for (size_t k = 0; k < graph.size(); ++k) {
+    if (!needed[k])
+      continue;
+    const ExprNode& e = graph.node(k);
+    std::string a = "t" + std::to_string(e.a), b = "t" + std::to_string(e.b);
+    out << "    const double t" << k << " = ";
+    switch (e.op) {
+      case OP_CONST: out << cpp_literal(e.value); break;
+      case OP_VAR: out << "x[" << (unsigned) e.value << "][i]"; break;
+      case OP_ADD: out << a << " + " << b; break;
+      case OP_SUB: out << a << " - " << b; break;
+      case OP_MUL: out << a << " * " << b; break;
+      case OP_DIV: out << a << " / " << b; break;
+      case OP_POW: out << "std::pow(" << a << ", " << b << ")"; break;
+      case OP_NEG: out << "-" << a; break;
+      case OP_EXP: out << "std::exp(" << a << ")"; break;
+      case OP_LOG: out << "std::log(" << a << ")"; break;
+      case OP_SQRT: out << "std::sqrt(" << a << ")"; break;
+      case OP_SIN: out << "std::sin(" << a << ")"; break;
+      case OP_COS: out << "std::cos(" << a << ")"; break;
+    }
+    out << ";\n";
+  }
+  for (size_t o = 0; o < outputs.size(); ++o)
+    out << "    y[" << o << "][i] = t" << outputs[o] << ";\n";
+  out << "  }\n}\n\n";
+}
+
+/// s em uma linha de comentário //: sem quebras de linha, '\\' (continuaria a linha) ou '?' (trígrafos).
+inline std::string comment_text(const std::string& s) {
+  std::string text = s;
+  for (size_t i = 0; i < text.size(); ++i)
+    if (text[i] < ' ' || text[i] > '~' || text[i] == '\\' || text[i] == '?')
+      text[i] = ' ';
+  return text;
+}
+
+/// Código C++ do .so de obj.
+inline std::string native_source(const ExprObjective& obj) {
+  std::ostringstream out;
+  out << "// Gerado por otim " << LIB_VERSION << " a partir de: " << comment_text(obj.source()) << "\n"
+    << "#include <cmath>\n#include <cstddef>\n\n"
+    << "extern \"C\" {\n\n"
+    << "unsigned otim_dimension() { return " << obj.dimension() << "; }\n\n";
+  emit_kernel(out, obj.dag(), obj.valueNodes(), "otim_values");
+  emit_kernel(out, obj.dag(), obj.gradientNodes(), "otim_gradients");
+  emit_kernel(out, obj.dag(), obj.hessianNodes(), "otim_hessians");
+  out << "}\n";
+  return out.str();
+}
+
+/// Diretório do cache de .so (OTIM_JIT_CACHE, $XDG_CACHE_HOME/otim-jit ou ~/.cache/otim-jit).
+inline std::string native_cache_dir() {
+  const char* dir = getenv("OTIM_JIT_CACHE");
+  if (dir != NULL && *dir)
+    return dir;
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  if (xdg != NULL && *xdg == '/')
+    return std::string(xdg) + "/otim-jit";
+  const char* home = getenv("HOME");
+  if (home == NULL || !*home) {
+    struct passwd* pw = getpwuid(geteuid());
+    home = pw != NULL ? pw->pw_dir : NULL;
+  }
+  if (home == NULL || !*home)
+    throw std::runtime_error("ERROR: no home directory for the native code cache, set OTIM_JIT_CACHE");
+  std::string cache = std::string(home) + "/.cache";
+  mkdir(cache.c_str(), 0700);
+  return cache + "/otim-jit";
+}
+
+/**
+ * Lança std::runtime_error se path não é um arquivo (ou diretório, se directory)
+ * do usuário efetivo em que só ele pode escrever. Links simbólicos são recusados.
+ */
+inline void check_private(const std::string& path, bool directory) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0)
+    throw std::runtime_error("ERROR: can't stat " + path);
+  if (directory ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode))
+    throw std::runtime_error("ERROR: " + path + (directory ? " is not a directory" : " is not a regular file"));
+  if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+    throw std::runtime_error("ERROR: " + path + " must be owned by the user and writable only by them");
+}
+
+/// As palavras de s, separadas por espaços.
+inline std::vector<std::string> split_words(const std::string& s) {
+  std::istringstream in(s);
+  std::vector<std::string> words;
+  std::string word;
+  while (in >> word)
+    words.push_back(word);
+  return words;
+}
+
+/**
+ * Objetivo compilado: a mesma interface de ExprObjective, com as funções do
+ * .so. As cópias compartilham o .so, que é descarregado com a última delas.
+ */
+class NativeObjective {
+  public:
+    /**
+     * Acha o .so de obj no cache ou o compila. Lança std::runtime_error se o
+     * cache ou o .so dele não são privados (check_private) ou se o compilador
+     * falhar (a saída dele fica em <hash>.log no cache).
+     */
+    explicit NativeObjective(const ExprObjective& obj, const std::string& cache = native_cache_dir()) :
+      n(obj.dimension()), hit(false) {
+      const char* cxx = getenv("OTIM_CXX");
+      const char* flags = getenv("OTIM_CXXFLAGS");
+      std::string compiler = cxx != NULL && *cxx ? cxx : "c++";
+      std::string options = std::string(flags != NULL && *flags ? flags : "-O2") + " -std=c++11 -shared -fPIC";
+      std::string source = native_source(obj);
+
+      uint64_t h = fnv1a(source.data(), source.size());
+      h = fnv1a(compiler.data(), compiler.size(), h);
+      h = fnv1a(options.data(), options.size(), h);
+      char name[17];
+      snprintf(name, sizeof(name), "%016llx", (unsigned long long) h);
+      std::string base = cache + "/" + name;
+      so = base + ".so";
+
+      if (mkdir(cache.c_str(), 0700) != 0 && errno != EEXIST)
+        throw std::runtime_error("ERROR: can't create " + cache);
+      check_private(cache, true);
+      struct stat st;
+      hit = lstat(so.c_str(), &st) == 0;
+      if (!hit)
+        compile(source, base, compiler, options);
+      check_private(so, false);
+
+      void* p = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if (p == NULL)
+        throw std::runtime_error("ERROR: can't load " + so + ": " + dlerror());
+      handle = std::shared_ptr<void>(p, dlclose);
+      NativeDimension dimension = (NativeDimension) dlsym(p, "otim_dimension");
+      values_fn = (NativeKernel) dlsym(p, "otim_values");
+      gradients_fn = (NativeKernel) dlsym(p, "otim_gradients");
+      hessians_fn = (NativeKernel) dlsym(p, "otim_hessians");
+      if (dimension == NULL || values_fn == NULL || gradients_fn == NULL || hessians_fn == NULL || dimension() != n)
+        throw std::runtime_error("ERROR: " + so + " is not a compiled objective for this expression");
+    }
+
+    unsigned dimension() const { return n; }
+    const std::string& path() const { return so; }
+
+    /// true se o .so já estava no cache.
+    bool cached() const { return hit; }
+
+    double value(const Matrix& x) const {
+      return run_at(Kernel(values_fn), x, n, 1)[0];
+    }
+
+    Matrix gradient(const Matrix& x) const {
+      std::vector<double> y = run_at(Kernel(gradients_fn), x, n, n + 1);
+      return Matrix(std::vector<double>(y.begin() + 1, y.end()));
+    }
+
+    Matrix hessian(const Matrix& x) const {
+      return unpack_hessian(run_at(Kernel(hessians_fn), x, n, n * (n + 1) / 2), n);
+    }
+
+    void values(const double* const* x, size_t count, double* f) const {
+      values_fn(x, count, &f);
+    }
+
+    void gradients(const double* const* x, size_t count, double* f, double* const* g) const {
+      std::vector<double*> out(1, f);
+      out.insert(out.end(), g, g + n);
+      gradients_fn(x, count, out.data());
+    }
+
+    std::function<double(Matrix)> f() const {
+      NativeObjective self(*this);
+      return [self](Matrix x) { return self.value(x); };
+    }
+    std::function<Matrix(Matrix)> gradf() const {
+      NativeObjective self(*this);
+      return [self](Matrix x) { return self.gradient(x); };
+    }
+    std::function<Matrix(Matrix)> hessf() const {
+      NativeObjective self(*this);
+      return [self](Matrix x) { return self.hessian(x); };
+    }
+
+  private:
+    /// Uma função do .so com a interface de ExprProgram::run.
+    struct Kernel {
+      NativeKernel fn;
+      explicit Kernel(NativeKernel fn) : fn(fn) {}
+      void run(const double* const* x, size_t count, double* const* y) const { fn(x, count, y); }
+    };
+
+    /// Compila em um arquivo temporário e renomeia, para que outro processo nunca carregue um .so pela metade.
+    static void compile(const std::string& source, const std::string& base,
+        const std::string& compiler, const std::string& options) {
+      std::string tmp = base + "." + std::to_string(getpid());
+      std::string cpp = tmp + ".cpp", log = base + ".log";
+      {
+        std::ofstream out(cpp.c_str());
+        out << source;
+        if (!out)
+          throw std::runtime_error("ERROR: can't write " + cpp);
+      }
+
+      // Sem shell: compilador, opções e caminhos vão para o execvp como estão.
+      std::vector<std::string> words = split_words(compiler + " " + options);
+      words.push_back("-o");
+      words.push_back(tmp + ".so");
+      words.push_back(cpp);
+      std::vector<char*> argv;
+      for (size_t i = 0; i < words.size(); ++i)
+        argv.push_back(&words[i][0]);
+      argv.push_back(NULL);
+
+      int status = -1;
+      pid_t pid = fork();
+      if (pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+          dup2(fd, STDOUT_FILENO);
+          dup2(fd, STDERR_FILENO);
+          close(fd);
+        }
+        execvp(argv[0], argv.data());
+        _exit(127);
+      }
+      if (pid > 0)
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+      unlink(cpp.c_str());
+      if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+          rename((tmp + ".so").c_str(), (base + ".so").c_str()) != 0) {
+        unlink((tmp + ".so").c_str());
+        throw std::runtime_error("ERROR: can't compile the objective (see " + log + ")");
+      }
+      unlink(log.c_str());
+    }
+
+    unsigned n;
+    bool hit;
+    std::string so;
+    std::shared_ptr<void> handle;
+    NativeKernel values_fn, gradients_fn, hessians_fn;
+};
+
+#endif // _CODEGEN_HPP_
@@ -0,0 +1,275 @@
+#ifndef _COLUMNAR_HPP_
+#define _COLUMNAR_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "lib.hpp"
+
+/**
+ * Formato binário colunar para conjuntos grandes de pontos iniciais e resultados.
+ *
+ *    cabeçalho (64 bytes): "OTIMCOL1", linhas (uint64), colunas (uint32), início dos dados (uint32)
+ *    nomes das colunas: 32 bytes cada, completados com '\0'
+ *    dados: cada coluna é um array contíguo de double, uma após a outra,
+ *           a partir de um deslocamento múltiplo de 64
+ *
+ * Os arquivos são lidos e escritos com mmap: column() aponta direto para o arquivo.
+ * Os inteiros usam a ordem de bytes da máquina.
+ */
+
+#define COLUMN_MAGIC "OTIMCOL1"
+#define COLUMN_NAME_SIZE 32
+
+struct ColumnHeader {
+  char magic[8];
+  uint64_t rows;
+  uint32_t cols;
+  uint32_t data_offset;
+  char reserved[40];
+};
+
+/// Colunas de um arquivo de pontos iniciais.
+const std::vector<std::string> START_COLUMNS = {"x1", "x2"};
+
+/// Colunas de um arquivo de resultados; status é o valor de Termination.
+const std::vector<std::string> RESULT_COLUMNS = {"x1", "x2", "f", "status", "iterations", "evaluations"};
+
+/// Base dos arquivos colunares mapeados em memória.
+class ColumnMap {
+  public:
+    size_t rows() const { return header()->rows; }
+    unsigned cols() const { return header()->cols; }
+
+    std::string name(unsigned c) const {
+      const char* p = base + sizeof(ColumnHeader) + c * COLUMN_NAME_SIZE;
+      return std::string(p, strnlen(p, COLUMN_NAME_SIZE));
+    }
+
+    /// Índice da coluna com esse nome, -1 se não existe.
+    int find(const std::string& name) const {
+      for (unsigned c = 0; c < cols(); ++c)
+        if (this->name(c) == name)
+          return c;
+      return -1;
+    }
+
+    ColumnMap(const ColumnMap&) = delete;
+    ColumnMap& operator=(const ColumnMap&) = delete;
+
+  protected:
+    ColumnMap() : base(NULL), size(0) {}
+    ~ColumnMap() { unmap(); }
+
+    const ColumnHeader* header() const { return (const ColumnHeader*) base; }
+
+    double* data(unsigned c) const {
+      if (c >= cols())
+        throw std::invalid_argument("ERROR: column index out of range");
+      return (double*) (base + header()->data_offset) + (size_t) c * rows();
+    }
+
+    unsigned index(const std::string& name) const {
+      int c = find(name);
+      if (c < 0)
+        throw std::invalid_argument("ERROR: no column named '" + name + "'");
+      return c;
+    }
+
+    /// Mapeia um arquivo existente, verificando o cabeçalho.
+    void map(const std::string& path, bool writable) {
+      int fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+          ::close(fd);
+        throw std::runtime_error("ERROR: can't open " + path);
+      }
+      size = st.st_size;
+      int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+      void* p = size >= sizeof(ColumnHeader) ? mmap(NULL, size, prot, MAP_SHARED, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("ERROR: can't map " + path);
+      base = (char*) p;
+
+      const ColumnHeader* h = header();
+      if (memcmp(h->magic, COLUMN_MAGIC, 8) != 0 ||
+          h->data_offset < sizeof(ColumnHeader) + (size_t) h->cols * COLUMN_NAME_SIZE ||
+          h->data_offset > size ||
+          (h->cols > 0 && h->rows > (size - h->data_offset) / (h->cols * sizeof(double)))) {
+        unmap();
+        throw std::runtime_error("ERROR: " + path + " is not a valid column file");
+      }
+    }
+
+    void unmap() {
+      if (base != NULL)
+        munmap(base, size);
+      base = NULL;
+    }
+
+    char* base;
+    size_t size;
+};
+
+/// Arquivo colunar aberto só para leitura.
+class ColumnFile : public ColumnMap {
+  public:
+    explicit ColumnFile(const std::string& path) {
+      map(path, false);
+      madvise(base, size, MADV_SEQUENTIAL);
+    }
+
+    const double* column(unsigned c) const { return data(c); }
+    const double* column(const std::string& name) const { return data(index(name)); }
+
+    /// madvise (MADV_WILLNEED, MADV_DONTNEED, ...) nas páginas das linhas [begin, end) da coluna c.
+    void advise(unsigned c, size_t begin, size_t end, int advice) const {
+      if (end <= begin)
+        return;
+      const uintptr_t page = sysconf(_SC_PAGESIZE);
+      uintptr_t first = (uintptr_t) (data(c) + begin) / page * page;
+      uintptr_t last = (uintptr_t) (data(c) + end);
+      madvise((void*) first, last - first, advice);
+    }
+};
+
+/**
+ * Arquivo colunar novo, com todas as linhas já alocadas; os valores são
+ * escritos direto no mapeamento. Os dados vão para o disco em sync(), close() ou no destrutor.
+ */
+class ColumnWriter : public ColumnMap {
+  public:
+    /// Reabre para escrita um arquivo já existente (para continuar uma execução).
+    explicit ColumnWriter(const std::string& path) {
+      map(path, true);
+    }
+
+    ColumnWriter(const std::string& path, size_t rows, const std::vector<std::string>& names) {
+      for (size_t c = 0; c < names.size(); ++c)
+        if (names[c].empty() || names[c].size() > COLUMN_NAME_SIZE)
+          throw std::invalid_argument("ERROR: invalid column name '" + names[c] + "'");
+
+      size_t offset = sizeof(ColumnHeader) + names.size() * COLUMN_NAME_SIZE;
+      offset = (offset + 63) / 64 * 64;
+      size = offset + rows * names.size() * sizeof(double);
+
+      int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0)
+        throw std::runtime_error("ERROR: can't create " + path);
+      void* p = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("ERROR: can't map " + path);
+      base = (char*) p;
+
+      ColumnHeader* h = (ColumnHeader*) base;
+      memcpy(h->magic, COLUMN_MAGIC, 8);
+      h->rows = rows;
+      h->cols = names.size();
+      h->data_offset = offset;
+      for (size_t c = 0; c < names.size(); ++c)
+        memcpy(base + sizeof(ColumnHeader) + c * COLUMN_NAME_SIZE, names[c].data(), names[c].size());
+    }
+
+    ~ColumnWriter() { close(); }
+
+    double* column(unsigned c) { return data(c); }
+    double* column(const std::string& name) { return data(index(name)); }
+
+    void sync() {
+      if (base != NULL)
+        msync(base, size, MS_SYNC);
+    }
+
+    void close() {
+      sync();
+      unmap();
+    }
+};
+
+/**
+ * Converte um CSV (primeira linha com os nomes das colunas, separadas por vírgula)
+ * para o formato colunar. Retorna o número de linhas.
+ */
+inline size_t csv_to_columns(const std::string& csv, const std::string& path) {
+  std::ifstream in(csv.c_str());
+  if (!in)
+    throw std::runtime_error("ERROR: can't open " + csv);
+
+  std::string line;
+  std::vector<std::string> names;
+  if (std::getline(in, line)) {
+    std::istringstream header(line);
+    std::string name;
+    while (std::getline(header, name, ','))
+      names.push_back(name.substr(0, name.find_last_not_of(" \r") + 1));
+  }
+  if (names.empty())
+    throw std::runtime_error("ERROR: " + csv + " has no header");
+
+  // Primeira passada só conta as linhas, para alocar o arquivo de uma vez.
+  size_t rows = 0;
+  while (std::getline(in, line))
+    if (line.find_first_not_of(" \r") != std::string::npos)
+      ++rows;
+
+  in.clear();
+  in.seekg(0);
+  std::getline(in, line);
+  ColumnWriter out(path, rows, names);
+  std::vector<double*> columns;
+  for (unsigned c = 0; c < names.size(); ++c)
+    columns.push_back(out.column(c));
+
+  size_t row = 0;
+  while (row < rows && std::getline(in, line)) {
+    if (line.find_first_not_of(" \r") == std::string::npos)
+      continue;
+    const char* p = line.c_str();
+    for (unsigned c = 0; c < names.size(); ++c) {
+      char* end;
+      columns[c][row] = strtod(p, &end);
+      if (end == p) {
+        std::ostringstream message;
+        message << "ERROR: " << csv << ": bad value in row " << row + 1 << ", column " << names[c];
+        throw std::runtime_error(message.str());
+      }
+      p = end;
+      while (*p == ' ')
+        ++p;
+      if (*p == ',')
+        ++p;
+    }
+    ++row;
+  }
+  return rows;
+}
+
+/// Escreve um arquivo colunar como CSV. Retorna o número de linhas.
+inline size_t columns_to_csv(const std::string& path, std::ostream& out) {
+  ColumnFile in(path);
+  std::vector<const double*> columns;
+  for (unsigned c = 0; c < in.cols(); ++c) {
+    out << (c ? "," : "") << in.name(c);
+    columns.push_back(in.column(c));
+  }
+  out << "\n" << std::setprecision(17);
+  for (size_t row = 0; row < in.rows(); ++row) {
+    for (unsigned c = 0; c < in.cols(); ++c)
+      out << (c ? "," : "") << columns[c][row];
+    out << "\n";
+  }
+  return in.rows();
+}
+
+#endif // _COLUMNAR_HPP_
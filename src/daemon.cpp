@@ -0,0 +1,245 @@
+/**
+ * solverd: serviço local de otimização.
+ *
+ * Recebe jobs (uma linha chave=valor por job, ver jobs.hpp) em um socket Unix,
+ * distribui em lotes entre as threads de trabalho e devolve cada resultado
+ * assim que fica pronto, na mesma conexão (fora de ordem; use o id).
+ *
+ * Jobs sem nenhum limite recebem max_evaluations (-e), para que um job
+ * que não converge não prenda uma thread para sempre.
+ *
+ * A fila guarda até 4 * threads * lote jobs: com ela cheia, as conexões param
+ * de ser lidas até as threads de trabalho a esvaziarem. Uma linha com mais de
+ * MAX_LINE bytes recebe um erro e derruba a conexão.
+ *
+ * Com -c, os resultados passam pelo cache em disco (cache.hpp). Com -P, os
+ * métodos usam os parâmetros de Armijo de um perfil gerado por otim tune (tune.hpp).
+ * Cada -L carrega um plugin de funções objetivo (plugin.hpp), que os jobs usam pelo nome.
+ *
+ * Uso: solverd [-s socket] [-t threads] [-b lote] [-e max_evaluations] [-c cache] [-P perfil] [-L plugin.so]...
+ */
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <getopt.h>
+#include <list>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "jobs.hpp"
+#include "plugin.hpp"
+#include "pool.hpp"
+#include "tune.hpp"
+using namespace std;
+
+/// Maior linha de job aceita, em bytes.
+#define MAX_LINE 65536
+
+// Conexão de um cliente. As threads de trabalho escrevem as respostas com o mutex.
+struct Connection {
+  int fd;
+  std::mutex mutex;
+
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+
+  void send(const string& line) {
+    string data = line + "\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0)
+        return;   // cliente foi embora
+      sent += n;
+    }
+  }
+};
+
+struct Request {
+  std::shared_ptr<Connection> connection;
+  Job job;
+};
+
+// Thread que lê uma conexão; done fica true quando ela termina e pode ser juntada.
+struct Reader {
+  std::shared_ptr<Connection> connection;
+  std::shared_ptr<std::atomic<bool> > done;
+  std::thread thread;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int) {
+  stopping = 1;
+}
+
+/// Lê as linhas de uma conexão e coloca os jobs na fila, até o cliente fechar a conexão ou a fila ser fechada.
+static void read_connection(std::shared_ptr<Connection> connection, BlockingQueue<Request>* queue,
+    unsigned max_evaluations, std::shared_ptr<std::atomic<bool> > done) {
+  string buffer;
+  char chunk[4096];
+  bool open = true;
+  while (open) {
+    ssize_t n = recv(connection->fd, chunk, sizeof(chunk), 0);
+    if (n <= 0)
+      break;
+    buffer.append(chunk, n);
+    size_t end;
+    while (open && (end = buffer.find('\n')) != string::npos) {
+      string line = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+      Request request;
+      string error;
+      if (parse_job(line, request.job, error)) {
+        Budget& budget = request.job.budget;
+        if (budget.max_iterations == 0 && budget.max_evaluations == 0 && budget.max_seconds == 0)
+          budget.max_evaluations = max_evaluations;
+        request.connection = connection;
+        open = queue->push(request);
+      }
+      else if (!error.empty())
+        connection->send(format_error(request.job.id, error));
+    }
+    if (open && buffer.size() > MAX_LINE) {
+      connection->send(format_error("", "line longer than " + std::to_string(MAX_LINE) + " bytes"));
+      shutdown(connection->fd, SHUT_RDWR);
+      open = false;
+    }
+  }
+  *done = true;
+}
+
+/// Thread de trabalho: retira lotes de até batch jobs e responde cada um.
+static void work(BlockingQueue<Request>* queue, size_t batch, Cache* cache) {
+  vector<Request> requests;
+  vector<Job> jobs;
+  vector<JobResult> results;
+  while (queue->pop_batch(requests, batch)) {
+    jobs.clear();
+    for (size_t i = 0; i < requests.size(); ++i)
+      jobs.push_back(requests[i].job);
+    run_jobs(jobs, results, cache);
+    for (size_t i = 0; i < requests.size(); ++i)
+      requests[i].connection->send(format_result(jobs[i], results[i]));
+  }
+}
+
+int main(int argc, char **argv) {
+  string path = "/tmp/solverd.sock";
+  unsigned threads = 0;
+  size_t batch = 32;
+  unsigned max_evaluations = 200000;
+  string cache_path, profile_path;
+  vector<string> plugins;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:b:e:c:P:L:")) != -1) {
+    switch (opt) {
+      case 's': path = optarg; break;
+      case 't': threads = atoi(optarg); break;
+      case 'b': batch = std::max(1, atoi(optarg)); break;
+      case 'e': max_evaluations = atoi(optarg); break;
+      case 'c': cache_path = optarg; break;
+      case 'P': profile_path = optarg; break;
+      case 'L': plugins.push_back(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0]
+          << " [-s socket] [-t threads] [-b batch] [-e max_evaluations] [-c cache] [-P profile] [-L plugin.so]..." << std::endl;
+        return 2;
+    }
+  }
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Os relatórios dos métodos não fazem sentido aqui.
+  VERBOSE = false;
+
+  try {
+    if (!profile_path.empty())
+      load_profile(profile_path);
+    for (size_t i = 0; i < plugins.size(); ++i)
+      load_plugin(plugins[i]);
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (listener < 0 || path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "ERROR: can't create socket " << path << std::endl;
+    return 1;
+  }
+  strcpy(address.sun_path, path.c_str());
+  unlink(path.c_str());
+  if (bind(listener, (sockaddr*) &address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+    std::cerr << "ERROR: can't listen on " << path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  std::unique_ptr<Cache> cache;
+  try {
+    if (!cache_path.empty())
+      cache.reset(new Cache(cache_path));
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  BlockingQueue<Request> queue(4 * threads * batch);
+  vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i)
+    workers.push_back(std::thread(work, &queue, batch, cache.get()));
+
+  std::cerr << "INFO: solverd listening on " << path << " with " << threads
+    << " threads, batch " << batch << std::endl;
+
+  list<Reader> readers;
+  while (!stopping) {
+    for (list<Reader>::iterator r = readers.begin(); r != readers.end(); )
+      if (*r->done) {
+        r->thread.join();
+        r = readers.erase(r);
+      }
+      else
+        ++r;
+    pollfd p = {listener, POLLIN, 0};
+    if (poll(&p, 1, 200) <= 0)
+      continue;
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      continue;
+    Reader reader;
+    reader.connection = std::make_shared<Connection>(fd);
+    reader.done = std::make_shared<std::atomic<bool> >(false);
+    reader.thread = std::thread(read_connection, reader.connection, &queue, max_evaluations, reader.done);
+    readers.push_back(std::move(reader));
+  }
+
+  std::cerr << "INFO: solverd stopping" << std::endl;
+  close(listener);
+  unlink(path.c_str());
+  // Os leitores usam a fila: eles terminam (recv retorna 0, push retorna false) antes que ela seja destruída.
+  for (list<Reader>::iterator r = readers.begin(); r != readers.end(); ++r)
+    shutdown(r->connection->fd, SHUT_RDWR);
+  queue.close();
+  for (list<Reader>::iterator r = readers.begin(); r != readers.end(); ++r)
+    r->thread.join();
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+  if (cache) {
+    std::cerr << "INFO: cache " << cache_path << ": " << cache->hits() << " hits, "
+      << cache->misses() << " misses, " << cache->size() << " entries" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,611 @@
+#ifndef _EXPR_HPP_
+#define _EXPR_HPP_
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "lib.hpp"
+
+/**
+ * Funções objetivo definidas em tempo de execução por uma expressão, como
+ *
+ *    x1^2 + (exp(x1) - x2)^2
+ *
+ * Variáveis x1, x2, ...; números; + - * / ^ (à direita) e menos unário; exp,
+ * log, sqrt, sin, cos e pi. -x^2 é -(x^2).
+ *
+ * A expressão vira um DAG (ExprGraph) em que cada nó é único: subexpressões
+ * iguais viram o mesmo nó (CSE), constantes são calculadas e x + 0, x * 1,
+ * x * 0 etc. são simplificados na criação. O gradiente e a hessiana são nós do
+ * mesmo grafo, derivados simbolicamente, então compartilham os termos com f.
+ *
+ * ExprProgram compila os nós pedidos para um bytecode de registradores (um
+ * registrador por valor vivo, reaproveitado quando o valor morre) e o
+ * interpreta em blocos de pontos: cada instrução roda sobre o bloco inteiro,
+ * em um laço sem desvios que o compilador vetoriza.
+ */
+
+enum ExprOp {
+  OP_CONST, OP_VAR, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+  OP_NEG, OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS
+};
+
+struct ExprNode {
+  ExprOp op;
+  int a, b;         // operandos (-1: não tem)
+  double value;     // OP_CONST: o valor; OP_VAR: o índice da variável (0 = x1)
+};
+
+class ExprGraph {
+  public:
+    ExprGraph() : nvars(0) {}
+
+    const ExprNode& node(int k) const { return nodes[k]; }
+    size_t size() const { return nodes.size(); }
+
+    /// Número de variáveis: o maior índice usado.
+    unsigned variables() const { return nvars; }
+
+    int constant(double c) {
+      return intern(OP_CONST, -1, -1, c);
+    }
+
+    /// Variável x(index + 1).
+    int variable(unsigned index) {
+      nvars = std::max(nvars, index + 1);
+      return intern(OP_VAR, -1, -1, index);
+    }
+
+    /// Nó op(a) ou op(a, b), simplificado.
+    int apply(ExprOp op, int a, int b = -1) {
+      const ExprNode& x = nodes[a];
+      bool ca = x.op == OP_CONST;
+      bool cb = b >= 0 && nodes[b].op == OP_CONST;
+      double va = x.value, vb = cb ? nodes[b].value : NAN;
+
+      if (ca && (b < 0 || cb))
+        return constant(evaluate(op, va, vb));
+      switch (op) {
+        case OP_ADD:
+          if (ca && va == 0) return b;
+          if (cb && vb == 0) return a;
+          if (a > b) std::swap(a, b);
+          break;
+        case OP_SUB:
+          if (cb && vb == 0) return a;
+          if (ca && va == 0) return apply(OP_NEG, b);
+          if (a == b) return constant(0);
+          break;
+        case OP_MUL:
+          if ((ca && va == 0) || (cb && vb == 0)) return constant(0);
+          if (ca && va == 1) return b;
+          if (cb && vb == 1) return a;
+          if (ca && va == -1) return apply(OP_NEG, b);
+          if (cb && vb == -1) return apply(OP_NEG, a);
+          if (a > b) std::swap(a, b);
+          break;
+        case OP_DIV:
+          if (ca && va == 0) return constant(0);
+          if (cb && vb == 1) return a;
+          break;
+        case OP_POW:
+          if (cb && vb == 0) return constant(1);
+          if (cb && vb == 1) return a;
+          if (cb && vb == 2) return apply(OP_MUL, a, a);
+          break;
+        case OP_NEG:
+          if (x.op == OP_NEG) return x.a;
+          break;
+        default:
+          break;
+      }
+      return intern(op, a, b, 0.0);
+    }
+
+    /// Derivada do nó k em relação à variável var, com memória.
+    int derivative(int k, unsigned var) {
+      if (memo.size() <= var)
+        memo.resize(var + 1);
+      std::vector<int>& m = memo[var];
+      if ((size_t) k < m.size() && m[k] >= 0)
+        return m[k];
+
+      ExprNode x = nodes[k];
+      int d;
+      switch (x.op) {
+        case OP_CONST: d = constant(0); break;
+        case OP_VAR: d = constant(x.value == var ? 1 : 0); break;
+        case OP_ADD: d = apply(OP_ADD, derivative(x.a, var), derivative(x.b, var)); break;
+        case OP_SUB: d = apply(OP_SUB, derivative(x.a, var), derivative(x.b, var)); break;
+        case OP_MUL:
+          d = apply(OP_ADD, apply(OP_MUL, derivative(x.a, var), x.b), apply(OP_MUL, x.a, derivative(x.b, var)));
+          break;
+        case OP_DIV:    // (a / b)' = (a' - (a / b) b') / b
+          d = apply(OP_DIV, apply(OP_SUB, derivative(x.a, var), apply(OP_MUL, k, derivative(x.b, var))), x.b);
+          break;
+        case OP_POW:
+          if (nodes[x.b].op == OP_CONST) {    // (a^c)' = c a^(c-1) a'
+            double c = nodes[x.b].value;
+            d = apply(OP_MUL, apply(OP_MUL, constant(c), apply(OP_POW, x.a, constant(c - 1))), derivative(x.a, var));
+          }
+          else {                              // (a^b)' = a^b (b' log a + b a' / a)
+            int t1 = apply(OP_MUL, derivative(x.b, var), apply(OP_LOG, x.a));
+            int t2 = apply(OP_DIV, apply(OP_MUL, x.b, derivative(x.a, var)), x.a);
+            d = apply(OP_MUL, k, apply(OP_ADD, t1, t2));
+          }
+          break;
+        case OP_NEG: d = apply(OP_NEG, derivative(x.a, var)); break;
+        case OP_EXP: d = apply(OP_MUL, k, derivative(x.a, var)); break;
+        case OP_LOG: d = apply(OP_DIV, derivative(x.a, var), x.a); break;
+        case OP_SQRT: d = apply(OP_DIV, derivative(x.a, var), apply(OP_MUL, constant(2), k)); break;
+        case OP_SIN: d = apply(OP_MUL, apply(OP_COS, x.a), derivative(x.a, var)); break;
+        case OP_COS: d = apply(OP_NEG, apply(OP_MUL, apply(OP_SIN, x.a), derivative(x.a, var))); break;
+        default: throw std::logic_error("ERROR: unknown expression node");
+      }
+      if (m.size() <= (size_t) k)
+        m.resize(k + 1, -1);
+      m[k] = d;
+      return d;
+    }
+
+    /// Valor de op em a e b (b só nas binárias).
+    static double evaluate(ExprOp op, double a, double b) {
+      switch (op) {
+        case OP_ADD: return a + b;
+        case OP_SUB: return a - b;
+        case OP_MUL: return a * b;
+        case OP_DIV: return a / b;
+        case OP_POW: return pow(a, b);
+        case OP_NEG: return -a;
+        case OP_EXP: return exp(a);
+        case OP_LOG: return log(a);
+        case OP_SQRT: return sqrt(a);
+        case OP_SIN: return sin(a);
+        case OP_COS: return cos(a);
+        default: throw std::logic_error("ERROR: not an operation");
+      }
+    }
+
+  private:
+    // A chave usa os bits do valor, para que NaN também possa ser uma constante.
+    int intern(ExprOp op, int a, int b, double value) {
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      std::tuple<int, int, int, uint64_t> key(op, a, b, bits);
+      std::map<std::tuple<int, int, int, uint64_t>, int>::iterator it = index.find(key);
+      if (it != index.end())
+        return it->second;
+      ExprNode x = {op, a, b, value};
+      nodes.push_back(x);
+      index[key] = nodes.size() - 1;
+      return nodes.size() - 1;
+    }
+
+    std::vector<ExprNode> nodes;
+    std::map<std::tuple<int, int, int, uint64_t>, int> index;
+    std::vector<std::vector<int> > memo;    // memo[var][k]: derivada do nó k, -1 se ainda não calculada
+    unsigned nvars;
+};
+
+/// Analisador descendente recursivo da linguagem de expressões.
+class ExprParser {
+  public:
+    ExprParser(const std::string& text, ExprGraph& graph) : text(text), pos(0), graph(graph) {}
+
+    /// Lê a expressão inteira; lança std::invalid_argument em erro de sintaxe.
+    int parse() {
+      int k = sum();
+      skip();
+      if (pos != text.size())
+        fail("unexpected '" + text.substr(pos, 1) + "'");
+      return k;
+    }
+
+  private:
+    int sum() {
+      int k = product();
+      for (;;) {
+        if (accept('+'))
+          k = graph.apply(OP_ADD, k, product());
+        else if (accept('-'))
+          k = graph.apply(OP_SUB, k, product());
+        else
+          return k;
+      }
+    }
+
+    int product() {
+      int k = unary();
+      for (;;) {
+        if (accept('*'))
+          k = graph.apply(OP_MUL, k, unary());
+        else if (accept('/'))
+          k = graph.apply(OP_DIV, k, unary());
+        else
+          return k;
+      }
+    }
+
+    int unary() {
+      if (accept('-'))
+        return graph.apply(OP_NEG, unary());
+      if (accept('+'))
+        return unary();
+      int k = primary();
+      if (accept('^'))
+        k = graph.apply(OP_POW, k, unary());
+      return k;
+    }
+
+    int primary() {
+      skip();
+      if (accept('(')) {
+        int k = sum();
+        expect(')');
+        return k;
+      }
+      if (pos < text.size() && (isdigit(text[pos]) || text[pos] == '.')) {
+        const char* begin = text.c_str() + pos;
+        char* end;
+        double v = strtod(begin, &end);
+        pos += end - begin;
+        return graph.constant(v);
+      }
+      size_t start = pos;
+      while (pos < text.size() && isalnum(text[pos]))
+        ++pos;
+      std::string name = text.substr(start, pos - start);
+      if (name.empty())
+        fail(pos < text.size() ? "unexpected '" + text.substr(pos, 1) + "'" : "unexpected end");
+      if (name == "pi")
+        return graph.constant(M_PI);
+      if (name[0] == 'x' && name.size() > 1 && name.find_first_not_of("0123456789", 1) == std::string::npos) {
+        unsigned index = atoi(name.c_str() + 1);
+        if (index == 0 || index > 1000)
+          fail("bad variable '" + name + "'");
+        return graph.variable(index - 1);
+      }
+
+      static const char* names[] = {"exp", "log", "sqrt", "sin", "cos"};
+      static const ExprOp ops[] = {OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS};
+      for (unsigned i = 0; i < 5; ++i)
+        if (name == names[i]) {
+          expect('(');
+          int k = sum();
+          expect(')');
+          return graph.apply(ops[i], k);
+        }
+      fail("unknown name '" + name + "'");
+      return -1;
+    }
+
+    void skip() {
+      while (pos < text.size() && isspace(text[pos]))
+        ++pos;
+    }
+
+    bool accept(char c) {
+      skip();
+      if (pos < text.size() && text[pos] == c) {
+        ++pos;
+        return true;
+      }
+      return false;
+    }
+
+    void expect(char c) {
+      if (!accept(c))
+        fail(std::string("expected '") + c + "'");
+    }
+
+    void fail(const std::string& message) {
+      throw std::invalid_argument("ERROR: expression: " + message + " at position " + std::to_string(pos + 1));
+    }
+
+    const std::string& text;
+    size_t pos;
+    ExprGraph& graph;
+};
+
+/// Instrução do bytecode: r[dst] = op(r[a], r[b]).
+struct ExprInstr {
+  uint8_t op;
+  uint16_t dst, a, b;
+};
+
+/**
+ * Bytecode que calcula uma lista de nós do grafo. Os registradores 0..nvars-1
+ * são as variáveis; depois vêm as constantes, fixas; os demais são reaproveitados.
+ */
+class ExprProgram {
+  public:
+    ExprProgram() : nvars(0), nregs(0) {}
+
+    ExprProgram(const ExprGraph& graph, const std::vector<int>& outputs) : nvars(graph.variables()) {
+      // Os nós já estão em ordem topológica: os operandos são criados antes.
+      const int n = graph.size();
+      const int forever = n;
+      std::vector<int> last(n, -1);     // última instrução que lê o nó
+      std::vector<bool> needed(n, false);
+      for (size_t i = 0; i < outputs.size(); ++i) {
+        needed[outputs[i]] = true;
+        last[outputs[i]] = forever;
+      }
+      for (int k = n - 1; k >= 0; --k) {
+        if (!needed[k])
+          continue;
+        const ExprNode& x = graph.node(k);
+        if (x.a >= 0) {
+          needed[x.a] = true;
+          last[x.a] = std::max(last[x.a], k);
+        }
+        if (x.b >= 0) {
+          needed[x.b] = true;
+          last[x.b] = std::max(last[x.b], k);
+        }
+      }
+
+      std::vector<int> reg(n, -1);
+      nregs = nvars;
+      for (int k = 0; k < n; ++k) {
+        const ExprNode& x = graph.node(k);
+        if (x.op == OP_VAR)
+          reg[k] = (int) x.value;
+        else if (needed[k] && x.op == OP_CONST) {
+          reg[k] = nregs++;
+          constants.push_back(x.value);
+        }
+      }
+
+      std::vector<int> free;
+      for (int k = 0; k < n; ++k) {
+        const ExprNode& x = graph.node(k);
+        if (!needed[k] || x.op == OP_VAR || x.op == OP_CONST)
+          continue;
+        // Operandos que morrem aqui liberam o registrador antes do destino ser escolhido:
+        // a instrução lê e escreve o mesmo elemento, então dst pode ser um operando.
+        if (last[x.a] == k && graph.node(x.a).op != OP_VAR && graph.node(x.a).op != OP_CONST)
+          free.push_back(reg[x.a]);
+        if (x.b >= 0 && x.b != x.a && last[x.b] == k && graph.node(x.b).op != OP_VAR && graph.node(x.b).op != OP_CONST)
+          free.push_back(reg[x.b]);
+        if (free.empty())
+          reg[k] = nregs++;
+        else {
+          reg[k] = free.back();
+          free.pop_back();
+        }
+        if (nregs > 65535)
+          throw std::invalid_argument("ERROR: expression is too large");
+        ExprInstr in = {(uint8_t) x.op, (uint16_t) reg[k], (uint16_t) reg[x.a], (uint16_t) (x.b >= 0 ? reg[x.b] : 0)};
+        code.push_back(in);
+      }
+      for (size_t i = 0; i < outputs.size(); ++i)
+        out.push_back(reg[outputs[i]]);
+    }
+
+    size_t instructions() const { return code.size(); }
+    unsigned registers() const { return nregs; }
+    size_t outputs() const { return out.size(); }
+
+    /**
+     * Calcula as saídas em count pontos. x[v] aponta para os count valores da
+     * variável v; a saída i vai para y[i][0..count). Pode ser chamado de
+     * várias threads ao mesmo tempo.
+     */
+    void run(const double* const* x, size_t count, double* const* y) const {
+      if (count == 0)
+        return;
+      const size_t B = std::min(count, (size_t) EXPR_BLOCK);
+      std::vector<double> r((size_t) nregs * B);
+      for (size_t c = 0; c < constants.size(); ++c)
+        std::fill(&r[(nvars + c) * B], &r[(nvars + c + 1) * B], constants[c]);
+
+      for (size_t begin = 0; begin < count; begin += B) {
+        const size_t m = std::min(B, count - begin);
+        for (unsigned v = 0; v < nvars; ++v)
+          std::copy(x[v] + begin, x[v] + begin + m, &r[v * B]);
+
+        for (size_t i = 0; i < code.size(); ++i) {
+          const ExprInstr& in = code[i];
+          double* d = &r[in.dst * B];
+          const double* a = &r[in.a * B];
+          const double* b = &r[in.b * B];
+          switch (in.op) {
+            case OP_ADD: for (size_t l = 0; l < m; ++l) d[l] = a[l] + b[l]; break;
+            case OP_SUB: for (size_t l = 0; l < m; ++l) d[l] = a[l] - b[l]; break;
+            case OP_MUL: for (size_t l = 0; l < m; ++l) d[l] = a[l] * b[l]; break;
+            case OP_DIV: for (size_t l = 0; l < m; ++l) d[l] = a[l] / b[l]; break;
+            case OP_POW: for (size_t l = 0; l < m; ++l) d[l] = pow(a[l], b[l]); break;
+            case OP_NEG: for (size_t l = 0; l < m; ++l) d[l] = -a[l]; break;
+            case OP_EXP: for (size_t l = 0; l < m; ++l) d[l] = exp(a[l]); break;
+            case OP_LOG: for (size_t l = 0; l < m; ++l) d[l] = log(a[l]); break;
+            case OP_SQRT: for (size_t l = 0; l < m; ++l) d[l] = sqrt(a[l]); break;
+            case OP_SIN: for (size_t l = 0; l < m; ++l) d[l] = sin(a[l]); break;
+            case OP_COS: for (size_t l = 0; l < m; ++l) d[l] = cos(a[l]); break;
+          }
+        }
+
+        for (size_t o = 0; o < out.size(); ++o)
+          std::copy(&r[out[o] * B], &r[out[o] * B] + m, y[o] + begin);
+      }
+    }
+
+    /// Listagem do bytecode, para depuração.
+    std::string disassemble() const {
+      static const char* names[] = {"const", "var", "add", "sub", "mul", "div", "pow", "neg", "exp", "log", "sqrt", "sin", "cos"};
+      std::ostringstream s;
+      for (size_t c = 0; c < constants.size(); ++c)
+        s << "r" << nvars + c << " = " << constants[c] << std::endl;
+      for (size_t i = 0; i < code.size(); ++i) {
+        s << "r" << code[i].dst << " = " << names[code[i].op] << " r" << code[i].a;
+        if (code[i].op <= OP_POW)
+          s << ", r" << code[i].b;
+        s << std::endl;
+      }
+      for (size_t o = 0; o < out.size(); ++o)
+        s << "out" << o << " = r" << out[o] << std::endl;
+      return s.str();
+    }
+
+    /// Pontos por bloco do interpretador.
+    static const size_t EXPR_BLOCK = 64;
+
+  private:
+    unsigned nvars, nregs;
+    std::vector<double> constants;
+    std::vector<ExprInstr> code;
+    std::vector<int> out;
+};
+
+/**
+ * Roda um programa (ExprProgram ou um kernel com a mesma assinatura de run) no
+ * ponto x, de n coordenadas, e retorna as outputs saídas.
+ */
+template <class Kernel>
+std::vector<double> run_at(const Kernel& kernel, const Matrix& x, unsigned n, size_t outputs) {
+  if (x.length() != n)
+    throw std::invalid_argument("ERROR: expression needs a point with " + std::to_string(n) + " coordinates");
+  std::vector<double> v(n), y(outputs);
+  std::vector<const double*> in(n);
+  std::vector<double*> out(outputs);
+  for (unsigned i = 0; i < n; ++i) {
+    v[i] = x.get(i + 1);
+    in[i] = &v[i];
+  }
+  for (size_t o = 0; o < outputs; ++o)
+    out[o] = &y[o];
+  kernel.run(in.data(), 1, out.data());
+  return y;
+}
+
+/// Hessiana n x n a partir do triângulo superior, por linha.
+inline Matrix unpack_hessian(const std::vector<double>& upper, unsigned n) {
+  Matrix H(n, n);
+  for (unsigned i = 0, k = 0; i < n; ++i)
+    for (unsigned j = i; j < n; ++j, ++k) {
+      H.set(i + 1, j + 1, upper[k]);
+      H.set(j + 1, i + 1, upper[k]);
+    }
+  return H;
+}
+
+/**
+ * Função objetivo dada por uma expressão, com gradiente e hessiana simbólicos.
+ * Três programas: f; f e o gradiente; a hessiana (só o triângulo superior,
+ * espelhado na saída).
+ */
+class ExprObjective {
+  public:
+    /// dimension = 0 usa o maior índice de variável da expressão.
+    explicit ExprObjective(const std::string& source, unsigned dimension = 0) : text(source) {
+      int f = ExprParser(source, graph).parse();
+      n = std::max(dimension, graph.variables());
+      if (n == 0)
+        n = 1;
+      graph.variable(n - 1);    // a dimensão vale para os programas
+
+      value_nodes.push_back(f);
+      value_program = ExprProgram(graph, value_nodes);
+      gradient_nodes = value_nodes;
+      for (unsigned i = 0; i < n; ++i)
+        gradient_nodes.push_back(graph.derivative(f, i));
+      gradient_program = ExprProgram(graph, gradient_nodes);
+      for (unsigned i = 0; i < n; ++i)
+        for (unsigned j = i; j < n; ++j)
+          hessian_nodes.push_back(graph.derivative(gradient_nodes[i + 1], j));
+      hessian_program = ExprProgram(graph, hessian_nodes);
+    }
+
+    const std::string& source() const { return text; }
+    unsigned dimension() const { return n; }
+    const ExprGraph& dag() const { return graph; }
+    const ExprProgram& valueProgram() const { return value_program; }
+    const ExprProgram& gradientProgram() const { return gradient_program; }
+    const ExprProgram& hessianProgram() const { return hessian_program; }
+
+    /// Nós de saída de cada programa: f; f e o gradiente; o triângulo superior da hessiana, por linha.
+    const std::vector<int>& valueNodes() const { return value_nodes; }
+    const std::vector<int>& gradientNodes() const { return gradient_nodes; }
+    const std::vector<int>& hessianNodes() const { return hessian_nodes; }
+
+    double value(const Matrix& x) const {
+      return run_at(value_program, x, n, 1)[0];
+    }
+
+    Matrix gradient(const Matrix& x) const {
+      std::vector<double> y = run_at(gradient_program, x, n, n + 1);
+      return Matrix(std::vector<double>(y.begin() + 1, y.end()));
+    }
+
+    Matrix hessian(const Matrix& x) const {
+      return unpack_hessian(run_at(hessian_program, x, n, n * (n + 1) / 2), n);
+    }
+
+    /// f em count pontos (x[v]: os valores da variável v).
+    void values(const double* const* x, size_t count, double* f) const {
+      value_program.run(x, count, &f);
+    }
+
+    /// f e o gradiente em count pontos: g[i] recebe a derivada em relação a x(i + 1).
+    void gradients(const double* const* x, size_t count, double* f, double* const* g) const {
+      std::vector<double*> out(1, f);
+      out.insert(out.end(), g, g + n);
+      gradient_program.run(x, count, out.data());
+    }
+
+    /// Adaptadores para os métodos; guardam uma cópia, então valem depois que this morre.
+    std::function<double(Matrix)> f() const {
+      std::shared_ptr<const ExprObjective> self = std::make_shared<ExprObjective>(*this);
+      return [self](Matrix x) { return self->value(x); };
+    }
+    std::function<Matrix(Matrix)> gradf() const {
+      std::shared_ptr<const ExprObjective> self = std::make_shared<ExprObjective>(*this);
+      return [self](Matrix x) { return self->gradient(x); };
+    }
+    std::function<Matrix(Matrix)> hessf() const {
+      std::shared_ptr<const ExprObjective> self = std::make_shared<ExprObjective>(*this);
+      return [self](Matrix x) { return self->hessian(x); };
+    }
+
+  private:
+    std::string text;
+    ExprGraph graph;
+    unsigned n;
+    std::vector<int> value_nodes, gradient_nodes, hessian_nodes;
+    ExprProgram value_program, gradient_program, hessian_program;
+};
+
+/**
+ * Cria o método `method` (GRADIENT, NEWTON, NEWTONPURE ou QUASINEWTON) para
+ * minimizar obj a partir de x0. NEWTON só em duas variáveis (inv2). Problem
+ * é ExprObjective ou qualquer tipo com dimension(), f(), gradf() e hessf().
+ */
+template <class Problem>
+Method* expr_method(const Problem& obj, int method, Matrix x0, double epsilon, const Budget& budget = Budget()) {
+  switch (method) {
+    case GRADIENT:
+      return new GradientMethod(obj.f(), obj.gradf(), x0, epsilon, budget);
+    case NEWTON:
+    case NEWTONPURE:
+      if (obj.dimension() != 2)
+        throw std::invalid_argument("ERROR: Newton's method needs an expression in x1 and x2");
+      return new NewtonMethod(obj.f(), obj.gradf(), obj.hessf(), x0, epsilon, method == NEWTONPURE, budget);
+    case QUASINEWTON:
+      return new QuasiNewtonMethod(obj.f(), obj.gradf(), x0, eye(obj.dimension()), epsilon, budget);
+    default:
+      throw std::invalid_argument("ERROR: Unknown method");
+  }
+}
+
+#endif // _EXPR_HPP_
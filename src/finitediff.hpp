@@ -0,0 +1,270 @@
+#ifndef _FINITEDIFF_HPP_
+#define _FINITEDIFF_HPP_
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "pool.hpp"
+
+/**
+ * Derivadas por diferenças finitas, para funções objetivo sem gradiente ou
+ * hessiana analíticos, em R^n.
+ *
+ * fd_gradient() faz as n avaliações perturbadas (2n nas centrais) em paralelo,
+ * com as threads do pool. fd_hessian() monta a hessiana por diferenças do
+ * gradiente; com um padrão de esparsidade, as colunas estruturalmente
+ * ortogonais (sem linha não nula em comum) recebem a mesma cor e são
+ * perturbadas juntas, então uma hessiana tridiagonal custa 3 gradientes
+ * a mais, qualquer que seja n.
+ *
+ * f e grad são chamados de várias threads ao mesmo tempo.
+ */
+
+typedef std::function<double(const std::vector<double>&)> Objective;
+typedef std::function<std::vector<double>(const std::vector<double>&)> Gradient;
+
+/// Diferenças progressivas (erro O(h)) ou centrais (erro O(h^2), o dobro de avaliações).
+enum {FD_FORWARD, FD_CENTRAL};
+
+/**
+ * Passo para a coordenada xi: h = eps^(1/2) max(1, |xi|) nas progressivas e
+ * eps^(1/3) max(1, |xi|) nas centrais, que equilibram o erro de truncamento e o
+ * de arredondamento. O passo é ajustado para que xi + h seja exato.
+ */
+inline double fd_step(double xi, int mode) {
+  double h = (mode == FD_CENTRAL ? std::cbrt(DBL_EPSILON) : std::sqrt(DBL_EPSILON)) * std::max(1.0, std::fabs(xi));
+  volatile double t = xi + h;
+  return t - xi;
+}
+
+/// Coordenadas por tarefa do pool: umas 4 tarefas por thread.
+inline size_t fd_chunk(size_t n, ThreadPool& pool) {
+  return std::max((size_t) 1, n / (4 * pool.size()));
+}
+
+/**
+ * Gradiente de f em x. fx é f(x), se já conhecido (só as progressivas o usam).
+ * Retorna o número de avaliações de f em evaluations, se não for NULL.
+ */
+inline std::vector<double> fd_gradient(const Objective& f, const std::vector<double>& x, int mode, ThreadPool& pool,
+    double fx = NAN, size_t* evaluations = NULL) {
+  const size_t n = x.size();
+  std::vector<double> g(n);
+  if (mode == FD_FORWARD && std::isnan(fx)) {
+    fx = f(x);
+    if (evaluations != NULL)
+      ++*evaluations;
+  }
+
+  parallel_for(pool, n, fd_chunk(n, pool), [&](size_t begin, size_t end) {
+    std::vector<double> y(x);
+    for (size_t i = begin; i < end; ++i) {
+      double h = fd_step(x[i], mode);
+      y[i] = x[i] + h;
+      double fp = f(y);
+      if (mode == FD_CENTRAL) {
+        y[i] = x[i] - h;
+        g[i] = (fp - f(y)) / (2 * h);
+      }
+      else
+        g[i] = (fp - fx) / h;
+      y[i] = x[i];
+    }
+  });
+
+  if (evaluations != NULL)
+    *evaluations += mode == FD_CENTRAL ? 2 * n : n;
+  return g;
+}
+
+/**
+ * Padrão de esparsidade de uma hessiana n x n (simétrico): rows[j] tem as
+ * linhas não nulas da coluna j, em ordem crescente, incluindo a diagonal.
+ */
+struct SparsityPattern {
+  std::vector<std::vector<size_t> > rows;
+
+  SparsityPattern() {}
+
+  /// Hessiana cheia.
+  static SparsityPattern dense(size_t n) {
+    return band(n, n);
+  }
+
+  /// Hessiana em banda: H(i, j) pode ser não nulo se |i - j| <= k.
+  static SparsityPattern band(size_t n, size_t k) {
+    SparsityPattern p;
+    p.rows.resize(n);
+    for (size_t j = 0; j < n; ++j)
+      for (size_t i = j > k ? j - k : 0; i < n && i <= j + k; ++i)
+        p.rows[j].push_back(i);
+    return p;
+  }
+
+  size_t size() const { return rows.size(); }
+
+  /// Número de elementos não nulos.
+  size_t nonzeros() const {
+    size_t nz = 0;
+    for (size_t j = 0; j < rows.size(); ++j)
+      nz += rows[j].size();
+    return nz;
+  }
+
+  /// Posição da linha i em rows[j], ou -1 se H(i, j) está fora do padrão.
+  long find(size_t i, size_t j) const {
+    const std::vector<size_t>& r = rows[j];
+    std::vector<size_t>::const_iterator it = std::lower_bound(r.begin(), r.end(), i);
+    return it == r.end() || *it != i ? -1 : it - r.begin();
+  }
+};
+
+/**
+ * Coloração gulosa das colunas: duas colunas com uma linha não nula em comum
+ * (vizinhas a distância até 2 no grafo do padrão) recebem cores diferentes.
+ * Retorna a cor de cada coluna; as cores são 0, 1, ..., colors - 1.
+ */
+inline std::vector<size_t> color_columns(const SparsityPattern& p, size_t* colors = NULL) {
+  const size_t n = p.size();
+  const size_t none = (size_t) -1;
+  std::vector<size_t> color(n, none);
+  std::vector<size_t> forbidden(n + 1, none);   // forbidden[c] == j: a cor c não serve para j
+  size_t used = 0;
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t a = 0; a < p.rows[j].size(); ++a) {
+      size_t i = p.rows[j][a];
+      if (i >= n)
+        throw std::invalid_argument("ERROR: sparsity pattern has a row out of range");
+      // Pelo padrão simétrico, as colunas com linha i não nula são rows[i].
+      for (size_t b = 0; b < p.rows[i].size(); ++b) {
+        size_t k = p.rows[i][b];
+        if (k < n && color[k] != none)
+          forbidden[color[k]] = j;
+      }
+    }
+    size_t c = 0;
+    while (forbidden[c] == j)
+      ++c;
+    color[j] = c;
+    used = std::max(used, c + 1);
+  }
+  if (colors != NULL)
+    *colors = used;
+  return color;
+}
+
+/// Hessiana nos elementos do padrão, coluna por coluna.
+struct SparseHessian {
+  SparsityPattern pattern;
+  std::vector<size_t> offset;   // a coluna j começa em values[offset[j]]
+  std::vector<double> values;
+  size_t colors;        // grupos de colunas perturbados juntos
+  size_t gradients;     // avaliações do gradiente
+
+  SparseHessian() : colors(0), gradients(0) {}
+
+  /// H(i, j); zero fora do padrão.
+  double at(size_t i, size_t j) const {
+    long k = pattern.find(i, j);
+    return k < 0 ? 0.0 : values[offset[j] + k];
+  }
+};
+
+/**
+ * Hessiana de uma função com gradiente grad, em x, nos elementos do padrão.
+ * Cada cor é uma direção d = soma de h_j e_j sobre as colunas j da cor, e
+ * H(i, j) = (grad(x + d) - grad(x))_i / h_j para a coluna j da cor com linha i,
+ * que é única pela coloração. As cores são avaliadas em paralelo. No fim, H é
+ * simetrizada: H(i, j) = H(j, i) = a média dos dois.
+ */
+inline SparseHessian fd_hessian(const Gradient& grad, const std::vector<double>& x, const SparsityPattern& pattern,
+    int mode, ThreadPool& pool) {
+  const size_t n = x.size();
+  if (pattern.size() != n)
+    throw std::invalid_argument("ERROR: sparsity pattern and point have different sizes");
+
+  SparseHessian H;
+  H.pattern = pattern;
+  H.values.assign(pattern.nonzeros(), 0.0);
+  std::vector<size_t> color = color_columns(pattern, &H.colors);
+
+  std::vector<std::vector<size_t> > groups(H.colors);
+  for (size_t j = 0; j < n; ++j)
+    groups[color[j]].push_back(j);
+  H.offset.assign(n + 1, 0);
+  for (size_t j = 0; j < n; ++j)
+    H.offset[j + 1] = H.offset[j] + pattern.rows[j].size();
+  std::vector<double> step(n);
+  for (size_t j = 0; j < n; ++j)
+    step[j] = fd_step(x[j], mode);
+
+  std::vector<double> g0;
+  if (mode == FD_FORWARD)
+    g0 = grad(x);
+
+  parallel_for(pool, H.colors, 1, [&](size_t begin, size_t end) {
+    std::vector<double> y(x);
+    for (size_t c = begin; c < end; ++c) {
+      const std::vector<size_t>& group = groups[c];
+      for (size_t a = 0; a < group.size(); ++a)
+        y[group[a]] = x[group[a]] + step[group[a]];
+      std::vector<double> gp = grad(y), gm;
+      if (mode == FD_CENTRAL) {
+        for (size_t a = 0; a < group.size(); ++a)
+          y[group[a]] = x[group[a]] - step[group[a]];
+        gm = grad(y);
+      }
+      for (size_t a = 0; a < group.size(); ++a) {
+        size_t j = group[a];
+        y[j] = x[j];
+        for (size_t b = 0; b < pattern.rows[j].size(); ++b) {
+          size_t i = pattern.rows[j][b];
+          H.values[H.offset[j] + b] = mode == FD_CENTRAL ?
+            (gp[i] - gm[i]) / (2 * step[j]) : (gp[i] - g0[i]) / step[j];
+        }
+      }
+    }
+  });
+  H.gradients = (mode == FD_CENTRAL ? 2 : 1) * H.colors + (mode == FD_FORWARD);
+
+  for (size_t j = 0; j < n; ++j)
+    for (size_t b = 0; b < pattern.rows[j].size(); ++b) {
+      size_t i = pattern.rows[j][b];
+      long k = i < j ? pattern.find(j, i) : -1;
+      if (k >= 0) {
+        double& hij = H.values[H.offset[j] + b];
+        double& hji = H.values[H.offset[i] + k];
+        hij = hji = 0.5 * (hij + hji);
+      }
+    }
+  return H;
+}
+
+/**
+ * fa em R^n, n >= 2: soma de x_i^2 + (exp(x_i) - x_{i+1})^2 para i < n - 1.
+ * Com n = 2 é a própria fa. A hessiana é tridiagonal.
+ */
+inline double fan(const std::vector<double>& x) {
+  double s = 0.0;
+  for (size_t i = 0; i + 1 < x.size(); ++i) {
+    double r = exp(x[i]) - x[i + 1];
+    s += x[i] * x[i] + r * r;
+  }
+  return s;
+}
+
+/// gradiente de fan
+inline std::vector<double> gradfan(const std::vector<double>& x) {
+  std::vector<double> g(x.size(), 0.0);
+  for (size_t i = 0; i + 1 < x.size(); ++i) {
+    double e = exp(x[i]), r = e - x[i + 1];
+    g[i] += 2 * x[i] + 2 * r * e;
+    g[i + 1] -= 2 * r;
+  }
+  return g;
+}
+
+#endif // _FINITEDIFF_HPP_
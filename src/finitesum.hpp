@@ -0,0 +1,228 @@
+#ifndef _FINITESUM_HPP_
+#define _FINITESUM_HPP_
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "lib.hpp"
+#include "finitediff.hpp"
+#include "pool.hpp"
+
+/**
+ * Objetivos de soma finita, f(x) = soma de fi(x) sobre os registros i, para
+ * ajuste de dados com milhões de registros.
+ *
+ * Um FiniteSum soma os termos de um intervalo de registros de uma vez, sem
+ * uma chamada por registro. SumObjective divide os registros em blocos de
+ * SUM_BLOCK, soma os blocos com as threads do pool e reduz as somas parciais
+ * na ordem dos blocos: o resultado é o mesmo, bit a bit, com qualquer número
+ * de threads e em qualquer ordem de execução das tarefas.
+ *
+ * SumObjective tem dimension(), f(), gradf() e hessf() (SumMethods), então
+ * vale para expr_method com todos os métodos; a hessiana (para Newton) é por
+ * diferenças centrais do gradiente. Para dados maiores que a memória, há
+ * StreamObjective (stream.hpp), com a mesma interface.
+ *
+ *    LeastSquares data(features, y, rows);
+ *    SumObjective obj(data);
+ *    std::unique_ptr<Method> m(expr_method(obj, QUASINEWTON, x0, 1e-6));
+ */
+
+/// Registros por bloco da redução. Fixo, para que o resultado não dependa do número de threads.
+#define SUM_BLOCK 4096
+
+class FiniteSum {
+  public:
+    virtual ~FiniteSum() {}
+
+    virtual unsigned dimension() const = 0;
+    virtual size_t records() const = 0;
+
+    /**
+     * Soma de fi(x) para begin <= i < end, na ordem dos registros. Se g não é
+     * NULL, soma também os gradientes em g (dimension() valores). Chamado de
+     * várias threads ao mesmo tempo, com intervalos e g diferentes.
+     */
+    virtual double sum(const double* x, size_t begin, size_t end, double* g) const = 0;
+};
+
+/**
+ * Mínimos quadrados lineares: fi(x) = (ai.x - yi)^2 / 2, com ai e yi em colunas
+ * (como as de um ColumnFile): features[j][i] é a coordenada j de ai.
+ * Os arrays são do chamador e devem viver mais que o objeto.
+ */
+class LeastSquares : public FiniteSum {
+  public:
+    LeastSquares(const std::vector<const double*>& features, const double* y, size_t rows)
+      : features(features), y(y), rows(rows) {
+      if (features.empty())
+        throw std::invalid_argument("ERROR: least squares needs at least one feature");
+    }
+
+    unsigned dimension() const { return features.size(); }
+    size_t records() const { return rows; }
+
+    double sum(const double* x, size_t begin, size_t end, double* g) const {
+      const unsigned n = features.size();
+      std::vector<double> gsum(g != NULL ? n : 0, 0.0);
+      double f = 0.0;
+      for (size_t i = begin; i < end; ++i) {
+        double r = -y[i];
+        for (unsigned j = 0; j < n; ++j)
+          r += features[j][i] * x[j];
+        f += 0.5 * r * r;
+        if (g != NULL)
+          for (unsigned j = 0; j < n; ++j)
+            gsum[j] += r * features[j][i];
+      }
+      // Soma local e uma escrita só: os g de blocos vizinhos podem dividir uma linha de cache.
+      for (unsigned j = 0; j < gsum.size(); ++j)
+        g[j] += gsum[j];
+      return f;
+    }
+
+  private:
+    std::vector<const double*> features;
+    const double* y;
+    size_t rows;
+};
+
+/**
+ * Soma os termos de terms em blocos de SUM_BLOCK registros, com as threads do
+ * pool, e acumula as somas dos blocos em f e g (se não é NULL) na ordem dos
+ * blocos. Como os blocos começam em múltiplos de SUM_BLOCK, somar os registros
+ * em trechos de múltiplos de SUM_BLOCK dá o mesmo resultado que somar tudo de uma vez.
+ */
+inline void sum_blocks(const FiniteSum& terms, const double* x, ThreadPool& pool, double& f, double* g) {
+  const unsigned n = terms.dimension();
+  const size_t records = terms.records();
+  const size_t blocks = (records + SUM_BLOCK - 1) / SUM_BLOCK;
+
+  // partial[k * (n + 1)]: a soma do bloco k; seguem as n coordenadas do gradiente dele.
+  std::vector<double> partial(blocks * (n + 1), 0.0);
+  const FiniteSum* t = &terms;
+  double* p = partial.data();
+  bool gradient = g != NULL;
+  parallel_for(pool, blocks, std::max((size_t) 1, blocks / (4 * pool.size())), [=](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+      double* block = p + k * (n + 1);
+      block[0] = t->sum(x, k * SUM_BLOCK, std::min(records, (k + 1) * SUM_BLOCK), gradient ? block + 1 : NULL);
+    }
+  });
+
+  for (size_t k = 0; k < blocks; ++k) {
+    const double* block = p + k * (n + 1);
+    f += block[0];
+    if (g != NULL)
+      for (unsigned j = 0; j < n; ++j)
+        g[j] += block[1 + j];
+  }
+}
+
+/**
+ * value(), gradient(), hessian(), f(), gradf() e hessf() para expr_method, a
+ * partir de dimension() e evaluate(x, g) de Derived. As funções de f(), gradf()
+ * e hessf() guardam cópias de Derived, que deve ser barato de copiar.
+ */
+template <class Derived>
+class SumMethods {
+  public:
+    double value(const Matrix& x) const {
+      return self().evaluate(point(x), NULL);
+    }
+
+    Matrix gradient(const Matrix& x) const {
+      std::vector<double> g;
+      self().evaluate(point(x), &g);
+      return Matrix(g);
+    }
+
+    /// Hessiana por diferenças centrais do gradiente (2 dimension() gradientes), simetrizada.
+    Matrix hessian(const Matrix& x) const {
+      const unsigned n = self().dimension();
+      std::vector<double> v = point(x), gp, gm;
+      Matrix H(n, n);
+      for (unsigned j = 0; j < n; ++j) {
+        double h = fd_step(v[j], FD_CENTRAL), xj = v[j];
+        v[j] = xj + h;
+        self().evaluate(v, &gp);
+        v[j] = xj - h;
+        self().evaluate(v, &gm);
+        v[j] = xj;
+        for (unsigned i = 0; i < n; ++i)
+          H.set(i + 1, j + 1, (gp[i] - gm[i]) / (2 * h));
+      }
+      for (unsigned i = 1; i <= n; ++i)
+        for (unsigned j = i + 1; j <= n; ++j) {
+          double hij = 0.5 * (H.get(i, j) + H.get(j, i));
+          H.set(i, j, hij);
+          H.set(j, i, hij);
+        }
+      return H;
+    }
+
+    std::function<double(Matrix)> f() const {
+      Derived obj(self());
+      return [obj](Matrix x) { return obj.value(x); };
+    }
+    std::function<Matrix(Matrix)> gradf() const {
+      Derived obj(self());
+      return [obj](Matrix x) { return obj.gradient(x); };
+    }
+    std::function<Matrix(Matrix)> hessf() const {
+      Derived obj(self());
+      return [obj](Matrix x) { return obj.hessian(x); };
+    }
+
+  protected:
+    /// Lança std::invalid_argument se x não tem dimension() coordenadas.
+    void check(const std::vector<double>& x) const {
+      const unsigned n = self().dimension();
+      if (x.size() != n)
+        throw std::invalid_argument("ERROR: the objective needs a point with " + std::to_string(n) + " coordinates");
+    }
+
+  private:
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+    std::vector<double> point(const Matrix& x) const {
+      std::vector<double> v(x.length());
+      for (unsigned i = 0; i < v.size(); ++i)
+        v[i] = x.get(i + 1);
+      check(v);
+      return v;
+    }
+};
+
+/**
+ * Um FiniteSum como objetivo dos métodos, avaliado com as threads do próprio
+ * pool. As cópias (as de f(), gradf() e hessf()) dividem o pool. terms deve
+ * viver mais que o objetivo e as cópias.
+ */
+class SumObjective : public SumMethods<SumObjective> {
+  public:
+    /// threads = 0 usa o número de processadores.
+    explicit SumObjective(const FiniteSum& terms, unsigned threads = 0)
+      : terms(&terms), pool(std::make_shared<ThreadPool>(threads)) {}
+
+    unsigned dimension() const { return terms->dimension(); }
+    unsigned threads() const { return pool->size(); }
+
+    /// f(x) e, se g não é NULL, o gradiente em g.
+    double evaluate(const std::vector<double>& x, std::vector<double>* g) const {
+      check(x);
+      double f = 0.0;
+      if (g != NULL)
+        g->assign(dimension(), 0.0);
+      sum_blocks(*terms, x.data(), *pool, f, g != NULL ? g->data() : NULL);
+      return f;
+    }
+
+  private:
+    const FiniteSum* terms;
+    std::shared_ptr<ThreadPool> pool;
+};
+
+#endif // _FINITESUM_HPP_
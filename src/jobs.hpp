@@ -0,0 +1,460 @@
+#ifndef _JOBS_HPP_
+#define _JOBS_HPP_
+
+#include <cerrno>
+#include <climits>
+#include <map>
+#include <sstream>
+#include <string>
+#include "cache.hpp"
+#include "lib.hpp"
+#include "multistart.hpp"
+#include "pool.hpp"
+
+/**
+ * Jobs de otimização em texto, um por linha, no formato chave=valor:
+ *
+ *    id=7 kind=solve function=FA method=QUASINEWTON x1=2 x2=1 limit=4 eps_sub=1e-7 eps_meth=1e-1 seed=42
+ *    id=8 kind=min function=FB method=GRADIENT x1=-1 x2=3 eps_meth=1e-6
+ *
+ * kind=solve roda solve_it; kind=min minimiza f diretamente a partir de x0
+ * (com o BatchSolver, que junta vários jobs no mesmo lote). As chaves omitidas
+ * ficam com os valores padrão de Job. Limites opcionais: max_iterations,
+ * max_evaluations, max_seconds. Em kind=solve, portfolio=GRADIENT,QUASINEWTON
+ * põe os métodos para disputar cada subproblema (PortfolioMethod); o resultado
+ * ganha wins=GRADIENT:3,QUASINEWTON:5, quantas vezes cada um convergiu primeiro.
+ * anderson=m acelera as iterações externas de kind=solve (SolveIt::setAnderson);
+ * hessian_reuse=k reusa a hessiana do newton por até k iterações (SolveIt::setHessianReuse).
+ *
+ * O resultado também é uma linha chave=valor:
+ *
+ *    id=7 status=converged x1=0 x2=1 f=0 iterations=7 evaluations=301 seconds=0.0012
+ */
+
+/// Tipo de job: solve_it ou minimização direta de f.
+enum {SOLVE, MINIMIZE};
+
+struct Job {
+  std::string id;
+  int kind;
+  int function;
+  int method;
+  double x1, x2;          // ponto inicial
+  int limitx0;
+  double epsilonSub;
+  double epsilonMeth;
+  unsigned seed;
+  Budget budget;
+  std::vector<int> portfolio;   // kind=solve: métodos que disputam cada subproblema
+  unsigned anderson;            // kind=solve: memória da aceleração de Anderson (0 = sem)
+  unsigned hessian_reuse;       // kind=solve: iterações por hessiana do newton (0 = sem reuso)
+
+  Job() :
+    kind(SOLVE),
+    function(FA),
+    method(QUASINEWTON),
+    x1(0.0),
+    x2(0.0),
+    limitx0(4),
+    epsilonSub(1e-7),
+    epsilonMeth(1e-1),
+    seed(1),
+    anderson(0),
+    hessian_reuse(0) {}
+};
+
+struct JobResult {
+  SolveResult result;
+  double seconds;     // tempo de parede do job
+  bool cached;        // veio do cache
+  std::vector<unsigned> wins;   // vitórias de cada método de job.portfolio
+  std::string error;  // não vazio: o job falhou com esta mensagem
+
+  JobResult() : seconds(0.0), cached(false) {}
+};
+
+/// Chave do job no cache de resultados.
+inline uint64_t job_key(const Job& job) {
+  uint64_t h = solve_key(job.kind, job.function, job.method, Matrix(vector<double>{job.x1, job.x2}),
+      job.limitx0, job.epsilonSub, job.epsilonMeth, job.seed, job.budget);
+  if (!job.portfolio.empty())
+    h = fnv1a(job.portfolio.data(), job.portfolio.size() * sizeof(int), h);
+  if (job.anderson > 0 || job.hessian_reuse > 0) {
+    h = fnv1a(&job.anderson, sizeof(job.anderson), h);
+    h = fnv1a(&job.hessian_reuse, sizeof(job.hessian_reuse), h);
+  }
+  return h == 0 ? 1 : h;
+}
+
+/// FA, FB, FC ou uma função registrada (plugin.hpp) a partir do nome; -1 se desconhecido.
+inline int parse_function(const std::string& name) {
+  if (name == "FA" || name == "fa") return FA;
+  if (name == "FB" || name == "fb") return FB;
+  if (name == "FC" || name == "fc") return FC;
+  for (size_t i = 0; i < USER_FUNCTIONS.size(); ++i)
+    if (USER_FUNCTIONS[i].name == name)
+      return FIRST_USER_FUNCTION + i;
+  return -1;
+}
+
+/// GRADIENT, NEWTON, NEWTONPURE ou QUASINEWTON a partir do nome; -1 se desconhecido.
+inline int parse_method(const std::string& name) {
+  if (name == "GRADIENT" || name == "gradient") return GRADIENT;
+  if (name == "NEWTON" || name == "newton") return NEWTON;
+  if (name == "NEWTONPURE" || name == "newtonpure") return NEWTONPURE;
+  if (name == "QUASINEWTON" || name == "quasinewton") return QUASINEWTON;
+  return -1;
+}
+
+inline const char* function_name(int function) {
+  switch (function) {
+    case FA: return "FA";
+    case FB: return "FB";
+    case FC: return "FC";
+  }
+  if (const UserFunction* user = user_function(function))
+    return user->name.c_str();
+  return "?";
+}
+
+inline const char* method_name(int method) {
+  switch (method) {
+    case GRADIENT: return "GRADIENT";
+    case NEWTON: return "NEWTON";
+    case NEWTONPURE: return "NEWTONPURE";
+    case QUASINEWTON: return "QUASINEWTON";
+  }
+  return "?";
+}
+
+/// Nome do motivo de parada sem espaços ("step too small" -> "step_too_small").
+inline std::string status_name(Termination reason) {
+  std::string s = termination_name(reason);
+  std::replace(s.begin(), s.end(), ' ', '_');
+  return s;
+}
+
+/// Quebra uma linha chave=valor em um mapa.
+inline bool parse_fields(const std::string& line, std::map<std::string, std::string>& fields, std::string& error) {
+  std::istringstream in(line);
+  std::string token;
+  while (in >> token) {
+    size_t eq = token.find('=');
+    if (eq == std::string::npos || eq == 0) {
+      error = "malformed field '" + token + "'";
+      return false;
+    }
+    fields[token.substr(0, eq)] = token.substr(eq + 1);
+  }
+  return true;
+}
+
+/**
+ * Lê um job de uma linha. Linhas vazias e comentários (#) não são jobs:
+ * retorna false com error vazio. Em erro de formato, retorna false com a mensagem em error.
+ */
+inline bool parse_job(const std::string& line, Job& job, std::string& error) {
+  error.clear();
+  size_t first = line.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos || line[first] == '#')
+    return false;
+
+  std::map<std::string, std::string> fields;
+  if (!parse_fields(line, fields, error))
+    return false;
+
+  // O id vem primeiro para que as mensagens de erro possam citá-lo.
+  job = Job();
+  if (fields.count("id"))
+    job.id = fields["id"];
+  for (std::map<std::string, std::string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+    const std::string& key = it->first;
+    const std::string& value = it->second;
+    char* end = NULL;
+    errno = 0;
+    double number = strtod(value.c_str(), &end);
+    bool numeric = end != value.c_str() && *end == '\0' && errno == 0;
+
+    if (key == "id")
+      continue;
+    else if (key == "kind") {
+      if (value == "solve") job.kind = SOLVE;
+      else if (value == "min") job.kind = MINIMIZE;
+      else { error = "unknown kind '" + value + "'"; return false; }
+    }
+    else if (key == "function") {
+      if ((job.function = parse_function(value)) < 0) { error = "unknown function '" + value + "'"; return false; }
+    }
+    else if (key == "method") {
+      if ((job.method = parse_method(value)) < 0) { error = "unknown method '" + value + "'"; return false; }
+    }
+    else if (key == "portfolio") {
+      std::istringstream names(value);
+      std::string name;
+      while (std::getline(names, name, ',')) {
+        job.portfolio.push_back(parse_method(name));
+        if (job.portfolio.back() < 0) { error = "unknown method '" + name + "'"; return false; }
+      }
+    }
+    else if (!numeric) {
+      error = "bad value for '" + key + "'";
+      return false;
+    }
+    else if (key == "x1") job.x1 = number;
+    else if (key == "x2") job.x2 = number;
+    else if (key == "limit") {
+      if (number < 1 || number > INT_MAX) { error = "limit must be between 1 and " + std::to_string(INT_MAX); return false; }
+      job.limitx0 = (int) number;
+    }
+    else if (key == "eps_sub") job.epsilonSub = number;
+    else if (key == "eps_meth") job.epsilonMeth = number;
+    else if (key == "seed" || key == "max_iterations" || key == "max_evaluations") {
+      // Fora de [0, UINT_MAX], a conversão para unsigned é indefinida.
+      if (number < 0 || number > UINT_MAX) { error = key + " must be between 0 and " + std::to_string(UINT_MAX); return false; }
+      if (key == "seed") job.seed = (unsigned) number;
+      else if (key == "max_iterations") job.budget.max_iterations = (unsigned) number;
+      else job.budget.max_evaluations = (unsigned) number;
+    }
+    else if (key == "max_seconds") {
+      if (number < 0) { error = "max_seconds must not be negative"; return false; }
+      job.budget.max_seconds = number;
+    }
+    else if (key == "anderson") {
+      if (number < 0 || number > 100) { error = "anderson must be between 0 and 100"; return false; }
+      job.anderson = (unsigned) number;
+    }
+    else if (key == "hessian_reuse") {
+      if (number < 0 || number > 1e6) { error = "hessian_reuse must be between 0 and 1000000"; return false; }
+      job.hessian_reuse = (unsigned) number;
+    }
+    else {
+      error = "unknown field '" + key + "'";
+      return false;
+    }
+  }
+
+  if (job.limitx0 <= 0) {
+    error = "limit must be positive";
+    return false;
+  }
+  if ((job.method == NEWTON || job.method == NEWTONPURE) && !has_hessian(job.function)) {
+    error = "NEWTON is only implemented for FA and functions with a hessian";
+    return false;
+  }
+  for (size_t i = 0; i < job.portfolio.size(); ++i) {
+    if ((job.portfolio[i] == NEWTON || job.portfolio[i] == NEWTONPURE) && !has_hessian(job.function)) {
+      error = "NEWTON is only implemented for FA and functions with a hessian";
+      return false;
+    }
+  }
+  if (const UserFunction* user = user_function(job.function)) {
+    if (user->dimension != 2) {
+      error = "function " + user->name + " needs two variables";
+      return false;
+    }
+    // kind=min usa o BatchSolver, que só tem o newton de FA.
+    if (job.kind == MINIMIZE && (job.method == NEWTON || job.method == NEWTONPURE)) {
+      error = "kind=min with function " + user->name + " needs GRADIENT or QUASINEWTON";
+      return false;
+    }
+  }
+  if ((!job.portfolio.empty() || job.anderson > 0 || job.hessian_reuse > 0) && job.kind != SOLVE) {
+    error = "portfolio, anderson and hessian_reuse are only supported for kind=solve";
+    return false;
+  }
+  return true;
+}
+
+/// Linha de erro para uma linha de job inválida ou um job que falhou.
+inline std::string format_error(const std::string& id, const std::string& error) {
+  return "id=" + (id.empty() ? std::string("?") : id) + " status=error message=" + error;
+}
+
+/// Linha de resultado de um job.
+inline std::string format_result(const Job& job, const JobResult& r) {
+  if (!r.error.empty())
+    return format_error(job.id, r.error);
+  std::ostringstream out;
+  out << std::setprecision(17);
+  out << "id=" << job.id
+    << " status=" << status_name(r.result.reason)
+    << " x1=" << r.result.x.x1()
+    << " x2=" << r.result.x.x2()
+    << " f=" << r.result.fx
+    << " iterations=" << r.result.iterations
+    << " evaluations=" << r.result.n_evaluations
+    << " seconds=" << std::setprecision(6) << r.seconds;
+  for (size_t i = 0; i < r.wins.size() && i < job.portfolio.size(); ++i)
+    out << (i == 0 ? " wins=" : ",") << method_name(job.portfolio[i]) << ":" << r.wins[i];
+  return out.str();
+}
+
+
+/// Vitórias de cada método de job.portfolio em solver.
+inline std::vector<unsigned> portfolio_wins(const Job& job, const SolveIt& solver) {
+  std::vector<unsigned> wins;
+  for (size_t i = 0; i < job.portfolio.size(); ++i)
+    wins.push_back(solver.wins(job.portfolio[i]));
+  return wins;
+}
+
+/// Mensagem de uma exceção para format_error, sem o prefixo "ERROR: ".
+inline std::string error_message(const std::exception& e) {
+  std::string message = e.what();
+  return message.compare(0, 7, "ERROR: ") == 0 ? message.substr(7) : message;
+}
+
+/// Roda um job kind=solve (solve_it com semente própria, sem relatórios).
+inline JobResult run_solve_job(const Job& job) {
+  Timer timer;
+  JobResult r;
+  SolveIt solver(job.function, Matrix(vector<double>{job.x1, job.x2}), job.limitx0,
+      job.epsilonSub, job.epsilonMeth, job.method, job.budget);
+  solver.setSeed(job.seed);
+  solver.setPortfolio(job.portfolio);
+  solver.setAnderson(job.anderson);
+  solver.setHessianReuse(job.hessian_reuse);
+  r.result = solver.run();
+  r.wins = portfolio_wins(job, solver);
+  r.seconds = timer.elapsed();
+  return r;
+}
+
+/**
+ * Roda um lote de jobs. Os jobs kind=min com a mesma função, método,
+ * epsilon e limites vão juntos para um BatchSolver; os kind=solve rodam um a um.
+ * Com cache, os jobs já resolvidos saem dele e os novos resultados vão para ele.
+ * Um job que lança uma exceção sai com a mensagem em error, sem afetar os outros.
+ */
+inline void run_jobs(const vector<Job>& jobs, vector<JobResult>& results, Cache* cache = NULL) {
+  results.assign(jobs.size(), JobResult());
+  vector<bool> done(jobs.size(), false);
+  vector<uint64_t> keys(jobs.size(), 0);
+
+  if (cache != NULL) {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      keys[i] = job_key(jobs[i]);
+      done[i] = results[i].cached = cache->lookup(keys[i], results[i].result);
+    }
+  }
+
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (done[i])
+      continue;
+    if (jobs[i].kind == SOLVE) {
+      done[i] = true;
+      try {
+        results[i] = run_solve_job(jobs[i]);
+      }
+      catch (const std::exception& e) {
+        results[i].error = error_message(e);
+        continue;
+      }
+      if (cache != NULL)
+        cache->store(keys[i], results[i].result);
+      continue;
+    }
+
+    // Junta os kind=min compatíveis com jobs[i].
+    Timer timer;
+    vector<size_t> group;
+    vector<double> x01, x02;
+    for (size_t j = i; j < jobs.size(); ++j) {
+      const Job& a = jobs[i];
+      const Job& b = jobs[j];
+      if (done[j] || b.kind != MINIMIZE || b.function != a.function || b.method != a.method ||
+          b.epsilonMeth != a.epsilonMeth || b.budget.max_iterations != a.budget.max_iterations ||
+          b.budget.max_evaluations != a.budget.max_evaluations || b.budget.max_seconds != a.budget.max_seconds)
+        continue;
+      group.push_back(j);
+      x01.push_back(b.x1);
+      x02.push_back(b.x2);
+      done[j] = true;
+    }
+    vector<StartResult> starts;
+    try {
+      BatchSolver solver(jobs[i].function, jobs[i].method, jobs[i].epsilonMeth);
+      solver.setBudget(jobs[i].budget);
+      starts = solver.solve(x01, x02);
+    }
+    catch (const std::exception& e) {
+      for (size_t k = 0; k < group.size(); ++k)
+        results[group[k]].error = error_message(e);
+      continue;
+    }
+    double seconds = timer.elapsed();
+    for (size_t k = 0; k < group.size(); ++k) {
+      SolveResult& r = results[group[k]].result;
+      r.x = Matrix(vector<double>{starts[k].x1, starts[k].x2});
+      r.fx = starts[k].f;
+      r.reason = starts[k].reason;
+      r.iterations = starts[k].iterations;
+      r.n_evaluations = starts[k].evaluations;
+      results[group[k]].seconds = seconds;
+      if (cache != NULL)
+        cache->store(keys[group[k]], r);
+    }
+  }
+}
+
+struct JobStats {
+  size_t jobs;      // jobs executados
+  size_t errors;    // linhas inválidas
+  JobStats() : jobs(0), errors(0) {}
+};
+
+/**
+ * Lê jobs de in e escreve um resultado por job em out, na ordem da entrada.
+ * A entrada é consumida em janelas de até window linhas (jobs, erros,
+ * comentários e linhas vazias); os jobs de cada janela são divididos em lotes
+ * de batch jobs executados pelas threads do pool. Assim a memória usada não
+ * depende do tamanho do arquivo, nem mesmo com muitas linhas inválidas.
+ */
+inline JobStats process_jobs(std::istream& in, std::ostream& out, ThreadPool& pool, size_t batch, size_t window,
+    Cache* cache = NULL) {
+  JobStats stats;
+  vector<Job> jobs;
+  vector<size_t> slot;          // posição de cada job válido em output
+  vector<std::string> output;
+  std::string line;
+  size_t lineno = 0;
+  bool more = true;
+
+  while (more) {
+    jobs.clear();
+    slot.clear();
+    output.clear();
+    for (size_t lines = 0; lines < window && (more = (bool) std::getline(in, line)); ++lines) {
+      ++lineno;
+      Job job;
+      std::string error;
+      if (parse_job(line, job, error)) {
+        slot.push_back(output.size());
+        output.push_back(std::string());
+        jobs.push_back(job);
+      }
+      else if (!error.empty()) {
+        std::ostringstream message;
+        message << "line " << lineno << ": " << error;
+        output.push_back(format_error(job.id, message.str()));
+        ++stats.errors;
+      }
+    }
+
+    parallel_for(pool, jobs.size(), batch, [&](size_t begin, size_t end) {
+      vector<Job> chunk(jobs.begin() + begin, jobs.begin() + end);
+      vector<JobResult> results;
+      run_jobs(chunk, results, cache);
+      for (size_t k = 0; k < chunk.size(); ++k)
+        output[slot[begin + k]] = format_result(chunk[k], results[k]);
+    });
+
+    for (size_t k = 0; k < output.size(); ++k)
+      out << output[k] << "\n";
+    stats.jobs += jobs.size();
+  }
+  out.flush();
+  return stats;
+}
+
+#endif // _JOBS_HPP_
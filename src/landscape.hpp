@@ -0,0 +1,259 @@
+#ifndef _LANDSCAPE_HPP_
+#define _LANDSCAPE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <initializer_list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pool.hpp"
+#include "vecmath.hpp"
+
+/**
+ * Paisagem de uma função objetivo: f (ou o g do subproblema) e, opcionalmente,
+ * |grad| avaliados em uma grade nx x ny, com os kernels vetoriais de vecmath.hpp
+ * e um bloco por tarefa do pool de threads.
+ *
+ * Arquivo (.lnd), mapeado com mmap:
+ *    cabeçalho (128 bytes): LandscapeHeader
+ *    blocos de tile x tile pontos, em ordem de linha (bloco (0,0), (1,0), ...);
+ *    dentro do bloco, um plano de float por canal (0 = valor, 1 = |grad|),
+ *    cada plano em ordem de linha. Pontos fora da grade (blocos da borda) são NaN.
+ *
+ * O ponto (i, j) é (x1min + i (x1max - x1min) / (nx - 1), x2min + j (x2max - x2min) / (ny - 1)).
+ */
+
+#define LANDSCAPE_MAGIC "OTIMLND1"
+
+struct LandscapeHeader {
+  char magic[8];
+  uint64_t nx, ny;
+  uint32_t tile, channels;
+  double x1min, x1max, x2min, x2max;
+  int32_t function, reserved;
+  double lambdak, xkk1, xkk2;
+  float vmin[2], vmax[2];     // extremos dos valores finitos de cada canal
+  char padding[16];
+};
+
+/// O que avaliar e onde.
+struct LandscapeSpec {
+  int function;
+  double lambdak, xkk1, xkk2;   // lambdak = 0: a própria f
+  bool gradient;                // também |grad|
+  double x1min, x1max, x2min, x2max;
+  size_t nx, ny;
+  unsigned tile;
+
+  LandscapeSpec() :
+    function(FA), lambdak(0.0), xkk1(0.0), xkk2(0.0), gradient(false),
+    x1min(-4.0), x1max(4.0), x2min(-4.0), x2max(4.0), nx(512), ny(512), tile(256) {}
+};
+
+/// Paisagem gravada em disco, mapeada só para leitura.
+class LandscapeFile {
+  public:
+    explicit LandscapeFile(const std::string& path) {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+          close(fd);
+        throw std::runtime_error("ERROR: can't open " + path);
+      }
+      size = st.st_size;
+      void* p = size >= sizeof(LandscapeHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+      close(fd);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("ERROR: can't map " + path);
+      base = (char*) p;
+      // Divide em vez de multiplicar: um cabeçalho corrompido não estoura a conta.
+      const size_t data = size - sizeof(LandscapeHeader);
+      if (memcmp(header().magic, LANDSCAPE_MAGIC, 8) != 0 || header().tile == 0 || data % sizeof(float) != 0 ||
+          !product_is({tiles_x(), tiles_y(), header().channels, header().tile, header().tile}, data / sizeof(float))) {
+        munmap(base, size);
+        throw std::runtime_error("ERROR: " + path + " is not a valid landscape file");
+      }
+    }
+
+    ~LandscapeFile() { munmap(base, size); }
+
+    LandscapeFile(const LandscapeFile&) = delete;
+    LandscapeFile& operator=(const LandscapeFile&) = delete;
+
+    const LandscapeHeader& header() const { return *(const LandscapeHeader*) base; }
+    size_t tiles_x() const { return header().nx / header().tile + (header().nx % header().tile != 0); }
+    size_t tiles_y() const { return header().ny / header().tile + (header().ny % header().tile != 0); }
+    size_t tile_floats() const { return (size_t) header().channels * header().tile * header().tile; }
+
+    /// Valor do canal no ponto (i, j) da grade.
+    float value(unsigned channel, size_t i, size_t j) const {
+      size_t t = header().tile;
+      const float* p = (const float*) (base + sizeof(LandscapeHeader)) +
+        ((j / t) * tiles_x() + i / t) * tile_floats() + channel * t * t;
+      return p[(j % t) * t + i % t];
+    }
+
+  private:
+    /// Se o produto dos fatores é exatamente total, sem estourar size_t.
+    static bool product_is(std::initializer_list<size_t> factors, size_t total) {
+      size_t p = 1;
+      for (size_t f : factors) {
+        if (f == 0)
+          return total == 0;
+        if (p > total / f)
+          return false;
+        p *= f;
+      }
+      return p == total;
+    }
+
+    char* base;
+    size_t size;
+};
+
+/**
+ * Avalia a paisagem e grava em path. Cada bloco é uma tarefa do pool e escreve
+ * direto no arquivo mapeado; a memória usada não depende do tamanho da grade.
+ */
+inline LandscapeHeader compute_landscape(const LandscapeSpec& spec, const std::string& path, ThreadPool& pool) {
+  if (spec.nx < 2 || spec.ny < 2 || spec.tile == 0 || spec.tile % VEC_WIDTH != 0)
+    throw std::invalid_argument("ERROR: landscape needs nx, ny >= 2 and a tile multiple of VEC_WIDTH");
+
+  LandscapeHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, LANDSCAPE_MAGIC, 8);
+  h.nx = spec.nx;
+  h.ny = spec.ny;
+  h.tile = spec.tile;
+  h.channels = spec.gradient ? 2 : 1;
+  h.x1min = spec.x1min;
+  h.x1max = spec.x1max;
+  h.x2min = spec.x2min;
+  h.x2max = spec.x2max;
+  h.function = spec.function;
+  h.lambdak = spec.lambdak;
+  h.xkk1 = spec.xkk1;
+  h.xkk2 = spec.xkk2;
+  for (unsigned c = 0; c < 2; ++c) {
+    h.vmin[c] = INFINITY;
+    h.vmax[c] = -INFINITY;
+  }
+
+  const size_t t = spec.tile;
+  const size_t tiles_x = (spec.nx + t - 1) / t, tiles_y = (spec.ny + t - 1) / t;
+  const size_t tile_floats = h.channels * t * t;
+  const size_t size = sizeof(LandscapeHeader) + tiles_x * tiles_y * tile_floats * sizeof(float);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("ERROR: can't create " + path);
+  void* p = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("ERROR: can't map " + path);
+  char* base = (char*) p;
+  float* data = (float*) (base + sizeof(LandscapeHeader));
+
+  const double dx = (spec.x1max - spec.x1min) / (spec.nx - 1);
+  const double dy = (spec.x2max - spec.x2min) / (spec.ny - 1);
+  std::mutex mutex;
+
+  parallel_for(pool, tiles_x * tiles_y, 1, [&](size_t begin, size_t end) {
+    std::vector<double> x1(t);
+    float lo[2] = {INFINITY, INFINITY}, hi[2] = {-INFINITY, -INFINITY};
+    for (size_t k = begin; k < end; ++k) {
+      size_t tx = k % tiles_x, ty = k / tiles_x;
+      float* values = data + k * tile_floats;
+      float* norms = values + t * t;
+      size_t i0 = tx * t, j0 = ty * t;
+      size_t w = std::min(t, spec.nx - i0), hgt = std::min(t, spec.ny - j0);
+      for (size_t i = 0; i < t; ++i)
+        x1[i] = spec.x1min + (i0 + i) * dx;
+
+      for (size_t j = 0; j < t; ++j) {
+        float* row = values + j * t;
+        float* nrow = norms + j * t;
+        if (j >= hgt) {
+          std::fill(row, row + t, NAN);
+          if (spec.gradient)
+            std::fill(nrow, nrow + t, NAN);
+          continue;
+        }
+        vdouble b = vsplat(spec.x2min + (j0 + j) * dy);
+        for (size_t i = 0; i < t; i += VEC_WIDTH) {
+          vdouble a = vload(&x1[i]);
+          vdouble v = vg(spec.function, spec.lambdak, a, b, spec.xkk1, spec.xkk2);
+          vdouble n = vsplat(0.0);
+          if (spec.gradient) {
+            vdouble g1, g2;
+            vgradg(spec.function, spec.lambdak, a, b, spec.xkk1, spec.xkk2, g1, g2);
+            n = vsqrt(g1 * g1 + g2 * g2);
+          }
+          for (unsigned l = 0; l < VEC_WIDTH; ++l) {
+            bool inside = i + l < w;
+            row[i + l] = inside ? (float) v[l] : NAN;
+            if (spec.gradient)
+              nrow[i + l] = inside ? (float) n[l] : NAN;
+            if (inside && std::isfinite(row[i + l])) {
+              lo[0] = std::min(lo[0], row[i + l]);
+              hi[0] = std::max(hi[0], row[i + l]);
+            }
+            if (inside && spec.gradient && std::isfinite(nrow[i + l])) {
+              lo[1] = std::min(lo[1], nrow[i + l]);
+              hi[1] = std::max(hi[1], nrow[i + l]);
+            }
+          }
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (unsigned c = 0; c < 2; ++c) {
+      h.vmin[c] = std::min(h.vmin[c], lo[c]);
+      h.vmax[c] = std::max(h.vmax[c], hi[c]);
+    }
+  });
+
+  memcpy(base, &h, sizeof(h));
+  msync(base, size, MS_SYNC);
+  munmap(base, size);
+  return h;
+}
+
+/**
+ * Grava um canal da paisagem como imagem PGM (P5, 8 bits), com x2 crescendo
+ * para cima e um ponto a cada stride em cada direção. Os valores vão para
+ * 0..255 em escala logarítmica (log(1 + v - vmin)); pontos não finitos ficam pretos.
+ */
+inline void landscape_to_pgm(const LandscapeFile& in, unsigned channel, const std::string& path, size_t stride = 1) {
+  const LandscapeHeader& h = in.header();
+  if (channel >= h.channels)
+    throw std::invalid_argument("ERROR: the landscape has no such channel");
+  if (stride == 0)
+    stride = 1;
+  std::ofstream out(path.c_str(), std::ios::binary);
+  if (!out)
+    throw std::runtime_error("ERROR: can't create " + path);
+
+  size_t w = (h.nx + stride - 1) / stride, hgt = (h.ny + stride - 1) / stride;
+  out << "P5\n" << w << " " << hgt << "\n255\n";
+  double vmin = h.vmin[channel];
+  double scale = h.vmax[channel] > vmin ? 255.0 / std::log1p(h.vmax[channel] - vmin) : 0.0;
+  std::vector<unsigned char> row(w);
+  for (size_t r = 0; r < hgt; ++r) {
+    size_t j = (hgt - 1 - r) * stride;
+    for (size_t c = 0; c < w; ++c) {
+      float v = in.value(channel, c * stride, j);
+      row[c] = std::isfinite(v) ? (unsigned char) std::min(255.0, std::log1p(v - vmin) * scale + 0.5) : 0;
+    }
+    out.write((const char*) row.data(), w);
+  }
+}
+
+#endif // _LANDSCAPE_HPP_
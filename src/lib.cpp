@@ -0,0 +1,1155 @@
+#include "lib.hpp"
+#include "finitediff.hpp"
+
+/**
+ * Definições de lib.hpp, compiladas uma vez na biblioteca (libotimcore). Com
+ * a opção LTO do CMake, as operações de Matrix continuam podendo ser
+ * expandidas em linha nos métodos, como quando tudo estava no cabeçalho.
+ */
+
+unsigned DEFAULT_PRECISION = 6;
+
+bool VERBOSE = true;
+
+static thread_local bool silenced = false;
+
+std::ostream& logger() {
+  static thread_local std::ostream null(NULL);
+  return VERBOSE && !silenced ? std::cout : null;
+}
+
+void silence_logger() {
+  silenced = true;
+}
+
+double EPSILON_ARMIJO_CALL = 1e-15;
+
+unsigned MAX_ITERATIONS = 400;
+
+Matrix eye(unsigned n) {
+  Matrix w(n,n,0.0);
+  for (unsigned i = 1; i <= n; ++i)
+    w.set(i,i,1.0);
+  return w;
+}
+
+Matrix::Matrix() :
+  m(0), 
+  n(0) {
+  v.clear();
+}
+
+Matrix::Matrix(unsigned rows, unsigned cols, double value) :
+  m(rows),
+  n(cols) {
+  v = vector< vector<double> >(rows, vector<double>(cols, value));
+}
+
+Matrix::Matrix(const Matrix& o) :
+  m(o.m),
+  n(o.n),
+  v(o.v) {
+}
+
+Matrix::Matrix(const vector<double>& w) :
+  m(w.size()),
+  n(1) {
+    for (unsigned i = 0; i < w.size(); ++i)
+      v.push_back(vector<double>(1, w[i]));
+}
+
+double Matrix::det2() const {
+  if (m != 2 && n != 2)
+    throw std::invalid_argument("ERROR: Can't apply det2 to a non 2x2 matrix");
+  return get(1,1) * get(2,2) - get(1,2) * get(2,1); 
+}
+
+Matrix::Matrix(const vector<vector<double> >& w) :
+  m(w.size()),
+  n(w[0].size()),
+  v(w) {
+}
+
+unsigned Matrix::getCols() const {
+  return n;
+}
+
+unsigned Matrix::getRows() const {
+  return m;
+}
+
+double Matrix::get(unsigned i) const {
+  return v.at((i - 1) % m).at((i-1) / m);
+}
+
+void Matrix::set(unsigned i, double value) {
+  v.at((i - 1) % m).at((i-1) / m) = value;
+}
+
+double Matrix::get(unsigned i, unsigned j) const {
+  return v.at(i-1).at(j-1);
+}
+
+void Matrix::set(unsigned i, unsigned j, double value) {
+  v.at(i-1).at(j-1) = value;
+}
+
+Matrix Matrix::operator+(const Matrix& o) const {
+  Matrix a(m, n);
+  for (unsigned i = 1; i <= m; ++i)
+    for (unsigned j = 1; j <= n; ++j)
+      a.set(i, j, get(i,j) + o.get(i,j));
+  return a;
+}
+
+Matrix Matrix::operator-(const Matrix& o) const {
+  Matrix a(m, n);
+  for (unsigned i = 1; i <= m; ++i)
+    for (unsigned j = 1; j <= n; ++j)
+      a.set(i, j, get(i,j) - o.get(i,j));
+  return a;
+}
+
+Matrix Matrix::operator*(double s) const {
+  Matrix a(m, n);
+  for (unsigned i = 1; i <= m; ++i)
+    for (unsigned j = 1; j <= n; ++j)
+      a.set(i, j, get(i,j) * s);
+  return a;
+}
+
+Matrix Matrix::operator/(double s) const {
+  Matrix a(m, n);
+  for (unsigned i = 1; i <= m; ++i)
+    for (unsigned j = 1; j <= n; ++j)
+      a.set(i, j, get(i,j) / s);
+  return a;
+}
+
+Matrix Matrix::t() const {
+  return this->transpose();
+}
+
+Matrix Matrix::transpose() const {
+  Matrix w(getCols(), getRows());
+  for (unsigned i = 1; i <= getRows(); ++i)
+    for (unsigned j = 1; j <= getCols(); ++j)
+      w.set(j,i,get(i,j));
+  return w;
+}
+
+bool Matrix::isVector() const {
+  return m == 1 || n == 1;
+}
+
+double Matrix::mod() const {
+  double sum = 0.0;
+  for (unsigned i = 1; i <= length(); ++i)
+    sum += get(i) * get(i);
+  return sqrt(sum);
+}
+
+double Matrix::x() const {
+  if (m == 1 && n == 1)
+    return get(1,1);
+  else
+    throw std::invalid_argument("ERROR: Not a 1x1 Matrix");
+}
+
+double Matrix::x1() const {
+  if (m == 2 && n == 1)
+    return get(1,1);  
+  else
+    throw std::invalid_argument("ERROR: Not a 2x1 column vector");
+}
+
+double Matrix::x2() const {
+  if (m == 2 && n == 1)
+    return get(2,1);  
+  else
+    throw std::invalid_argument("ERROR: Not a 2x1 column vector");
+}
+
+unsigned Matrix::length() const {
+  return m * n;
+}
+
+bool Matrix::isFinite() const {
+  for (unsigned i = 1; i <= length(); ++i)
+    if (!std::isfinite(get(i)))
+      return false;
+  return true;
+}
+
+Matrix Matrix::operator*(const Matrix& o) const {
+  Matrix w(getRows(), o.getCols());
+  if (getCols() != o.getRows())
+    throw std::invalid_argument("ERROR: Invalid matrix multiplication");
+  for (unsigned i = 1; i <= getRows(); ++i)
+    for (unsigned j = 1; j <= o.getCols(); ++j) {
+      double sum = 0.0;
+      for (unsigned k = 1; k <= getCols(); ++k) {
+        sum += get(i,k) * o.get(k,j);
+      }
+      w.set(i,j,sum);
+    }
+  return w;
+}
+
+Matrix operator*(double s, const Matrix& o) {
+  return o * s;
+}
+
+void Matrix::debug() const {
+  std::cout << "INFO: Matrix debug" << std::endl;
+  std::cout << "\t" << "#rows=" << m << ", #cols=" <<  n << std::endl;
+  for (unsigned i = 1; i <= m; ++i) {
+    std::cout << "\t";
+    for (unsigned j = 1; j <= n; ++j)
+      std::cout << get(i,j) << " ";
+    std::cout << std::endl;
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const Matrix& x) {
+  bool column = x.isVector();
+  out << (column ? "(" : "[");
+  for (unsigned i = 1; i <= x.getRows(); ++i)
+    for (unsigned j = 1; j <= x.getCols(); ++j) {
+      if (i > 1 || j > 1)
+        out << (column || j > 1 ? ", " : "; ");
+      out << x.get(i, j);
+    }
+  return out << (column ? ")" : "]");
+}
+
+int rand_int(unsigned limit) { 
+  int signal = ((rand() % 2) == 0) ? (-1) : (+1);
+  return signal * (rand() % limit); 
+};
+
+int rand_double(unsigned limit) {
+  int signal = ((rand() % 2) == 0) ? (-1) : (+1);
+  double decimals = (rand() % 1000) / 1000.0;
+  return signal * ((rand() % limit) + decimals); 
+};
+
+int rand_double(unsigned limit, unsigned* state) {
+  int signal = ((rand_r(state) % 2) == 0) ? (-1) : (+1);
+  double decimals = (rand_r(state) % 1000) / 1000.0;
+  return signal * ((rand_r(state) % limit) + decimals);
+};
+
+double fa(Matrix x) {
+  double a = x.x1();
+  double b = exp(x.x1()) - x.x2();
+  return a * a + b * b;
+}
+
+Matrix gradfa(Matrix x) {
+  Matrix w(2,1);
+  w.set(1, (2 * x.x1()) + 2 * ( exp(x.x1()) - x.x2() ) * exp(x.x1()));
+  w.set(2,                2 * ( exp(x.x1()) - x.x2() ) * (-1));
+  return w;
+}
+
+Matrix hessfa(Matrix x) {
+  Matrix w(2,2);
+  w.set(1, 1, 2 + 4 * exp(2 * x.x1()) - 2 * exp(x.x1()) * x.x2());
+  w.set(1, 2, -2 * exp(x.x1()));
+  w.set(2, 1, -2 * exp(x.x1()));
+  w.set(2, 2, 2);
+  return w;
+}
+
+double fb(Matrix x) {
+  return sqrt(fa(x));
+}
+
+Matrix gradfb(Matrix x) {
+  Matrix w(2,1);
+  w.set(1, (1.0/(2 * fb(x))) * gradfa(x).x1());
+  w.set(2, (1.0/(2 * fb(x))) * gradfa(x).x2());
+  return w;
+}
+
+double fc(Matrix x) {
+  return log(1.0 + fa(x));
+}
+
+Matrix gradfc(Matrix x) {
+  Matrix w(2,1);
+  w.set(1, (1.0/fc(x)) * gradfa(x).x1());
+  w.set(2, (1.0/fc(x)) * gradfa(x).x2());
+  return w;
+}
+
+double d(Matrix x, Matrix xkk) {
+  double a = x.x1() - xkk.x1();
+  double b = (x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1()));
+  return a * a + b * b;
+}
+
+Matrix gradd(Matrix x, Matrix xkk) {
+  Matrix w(2,1);
+  w.set(1,
+      2 * (x.x1() - xkk.x1()) +
+      2 * (-exp(x.x1())) * ((x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1())))
+      );
+  w.set(2,
+      2 * ((x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1())))
+      );
+  return w;
+}
+
+Matrix hessd(Matrix x, Matrix xkk) {
+	Matrix w(2,2);
+	w.set(1, 1, 2 + 4 * exp(2*x.x1()) - 2 * exp(x.x1()) * (x.x2() - xkk.x2() + exp(xkk.x1())));
+	w.set(1, 2, -2 * exp(x.x1()));
+	w.set(2, 1, -2 * exp(x.x1()));
+	w.set(2, 2, 2);
+	return w;
+}
+
+double g(
+    std::function<double(Matrix)> f,
+    double lambdak,
+    Matrix x,
+    Matrix xkk
+    )
+{
+  return f(x) + (((lambdak/2.0) * d(x,xkk)));
+}
+
+Matrix gradg(
+    std::function<Matrix(Matrix)> gradf,
+    double lambdak,
+    Matrix x,
+    Matrix xkk
+    )
+{
+  return gradf(x) + ((lambdak/2.0) * gradd(x,xkk));
+}
+
+Matrix hessg(
+    std::function<Matrix(Matrix)> hessf,
+    double lambdak,
+    Matrix x,
+    Matrix xkk
+)
+{
+    return hessf(x) + ((lambdak/2.0) * hessd(x,xkk));
+}
+
+bool inv2(const Matrix& w, Matrix& inv) {
+  double det = w.det2();
+  if (det == 0)
+    return false;
+
+  Matrix ret(2,2);
+  ret.set(1, 1, w.get(2,2));
+  ret.set(1, 2, (-1) * w.get(1,2));
+  ret.set(2, 1, (-1) * w.get(2,1));
+  ret.set(2, 2, w.get(1,1));
+  inv = ret / det;
+  return true;
+}
+
+Matrix invhessg(
+    std::function<Matrix(Matrix)> hessf,
+    double lambdak,
+    Matrix x,
+    Matrix xkk
+)
+{
+  Matrix ret;
+  if (!inv2(hessg(hessf, lambdak, x, xkk), ret))
+    throw std::invalid_argument("ERROR: Determinant is zero: this matrix doesn't have a inverse");
+  return ret;
+}
+
+const char* termination_name(Termination reason) {
+  switch (reason) {
+    case CONVERGED:           return "converged";
+    case STEP_TOO_SMALL:      return "step too small";
+    case TOO_MANY_ITERATIONS: return "too many iterations";
+    case SINGULAR_HESSIAN:    return "singular hessian";
+    case NOT_FINITE:          return "not finite";
+    case TOO_MANY_EVALUATIONS: return "too many evaluations";
+    case TIME_LIMIT:          return "time limit";
+    case CANCELLED:           return "cancelled";
+  }
+  return "unknown";
+}
+
+std::function<double(Matrix)> counted(std::function<double(Matrix)> f, BudgetTracker& tracker) {
+  return [f, &tracker](Matrix x) -> double {
+    tracker.count_evaluation();
+    return f(x);
+  };
+}
+
+double armijo_call(
+    double s,
+    double beta,              // 0 < b < 1
+    double sigma,             // 0 < o < 1
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    // Para copiar o valor: Matrix x
+    // Para apenas copiar a referência do valor: const Matrix& x
+    // Vantagem da versão com referência: é mais rápida
+    const Matrix& x,
+    const Matrix& p,
+    BudgetTracker* tracker   // se não for NULL, a busca para quando o budget esgota
+    )
+{
+  // f(x) e gradf(x)' p não mudam durante a busca.
+  return armijo_call(s, beta, sigma, f, x, f(x), ((gradf(x)).t() * p).x(), p, tracker);
+}
+
+double armijo_call(
+    double s,
+    double beta,
+    double sigma,
+    std::function<double(Matrix)> f,
+    const Matrix& x,
+    double fx,
+    double slope,
+    const Matrix& p,
+    BudgetTracker* tracker
+    )
+{
+  logger() << "\t\t" << "INFO: armijo_call: ";
+  Timer timer;
+
+  // Skipping right through the test means 1 iteration.
+  // iter = m, só de armijo
+  unsigned iter = 0;
+
+  double pmod = p.mod();
+  Termination stop;
+
+  while (true) {
+    if ( (fx - f(x + s * pow(beta, iter) * p)) >= -sigma * s * pow(beta, iter) * slope )
+      break;
+    ++iter;
+    // Passo praticamente zero: o método vai parar com STEP_TOO_SMALL.
+    if (s * pow(beta, iter) * pmod < EPSILON_ARMIJO_CALL)
+      break;
+    if (tracker != NULL && tracker->exceeded(stop))
+      break;
+  }
+
+  double t = s * pow(beta, iter);
+  logger() <<
+    "#iter=" << iter+1 << ", t=" << setprecision(15) << t <<
+    setprecision(2) << " \%\% s=" << s << ", beta=" << beta << ", sigma=" << sigma <<
+    setprecision(DEFAULT_PRECISION) << std::endl; 
+  logger() << "\t\t\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
+  return t;
+}
+
+Method::Method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget
+    ) :
+  gradf(gradf),
+  x0(x0),
+  epsilon(epsilon),
+  tracker(budget),
+  xk(x0),
+  fxk(NAN),
+  iter(0),
+  n_call_armijo(0),
+  evaluated(false),
+  finished(false) {
+  this->f = counted(f, tracker);
+}
+
+void Method::evaluate() {
+  fxk = f(xk);
+  gk = gradf(xk);
+  evaluated = true;
+  best.keep_best(xk, fxk);
+}
+
+bool Method::check() {
+  Termination stop;
+  if (!std::isfinite(fxk) || !gk.isFinite())
+    finish(NOT_FINITE);
+  // Critério de parada.
+  else if (gk.mod() < epsilon)
+    finish(CONVERGED);
+  else if (tracker.exceeded(iter, stop))
+    finish(stop);
+  return finished;
+}
+
+bool Method::step() {
+  if (finished)
+    return false;
+  if (!evaluated) {
+    evaluate();
+    if (check())
+      return false;
+  }
+
+  ++iter;
+  logger() << "-------------------------------------------------------------------" << std::endl;
+  logger() << "Beginning iteration #" << iter << " of the " << name() << " method:" << std::endl;
+
+  if (!compute_direction())
+    return true;
+  if (!dk.isFinite()) {
+    finish(NOT_FINITE);
+    return true;
+  }
+
+  double ak = steplength();
+
+  Termination stop;
+  if (tracker.exceeded(stop)) {
+    finish(stop);
+    return true;
+  }
+
+  if ((ak * dk).mod() < EPSILON_ARMIJO_CALL) {
+    logger() << "WARNING: ak * dk too small. Stopping here, otherwise this would be an infinite loop." << std::endl;
+    finish(STEP_TOO_SMALL);
+    return true;
+  }
+
+  // Atualização do xk.
+  Matrix xprev = xk;
+  Matrix gprev = gk;
+  xk = xk + ak * dk;
+  evaluate();
+  moved(xprev, gprev);
+  log_iteration();
+  check();
+  return true;
+}
+
+SolveResult Method::run() {
+  while (step())
+    ;
+  return result();
+}
+
+void Method::cancel() {
+  if (!finished)
+    finish(CANCELLED);
+}
+
+double Method::steplength() {
+  ++n_call_armijo;
+  // Ordem: s, beta, sigma (o), ...
+  // fxk e gk já são os de xk (evaluate): a busca não os calcula de novo.
+  return armijo_call(armijo.s, armijo.beta, armijo.sigma, f, xk, fxk, (gk.t() * dk).x(), dk, &tracker);
+}
+
+void Method::log_iteration() const {
+  logger() << "iter = " << iter << "\tINFO: " << name() << "_method" << std::endl;
+  logger() << "\t\t" << "dk: " << dk << std::endl;
+  logger() << "\t\t" << "xk: " << xk << std::endl;
+  logger() << "\t\t" << "f(xk): " << fxk << std::endl;
+}
+
+void Method::finish(Termination reason) {
+  best.reason = reason;
+  finished = true;
+}
+
+SolveResult Method::result() const {
+  SolveResult r = best;
+  // Convergiu (ou nenhum iterado foi finito): o resultado é o último iterado.
+  if ((finished && r.reason == CONVERGED) || r.x.length() == 0) {
+    r.x = xk;
+    r.fx = fxk;
+  }
+  r.iterations = iter;
+  r.n_call_armijo = n_call_armijo;
+  r.n_evaluations = tracker.evaluations();
+  return r;
+}
+
+void Method::report() const {
+  SolveResult r = result();
+  Timer t = timer;
+  logger() << "Information about this " << name() << " method run:" << std::endl;
+  logger() << "\t" << "elapsed time: " << t.elapsed() << "s" << std::endl;
+  logger() << "\t" << "initial point: " << x0 << std::endl;
+  logger() << "\t" << "epsilon: " << epsilon << std::endl;
+  logger() << "\t" << "n_iterations: " << r.iterations << std::endl;
+  logger() << "\t" << "n_call_armijo: " << r.n_call_armijo << std::endl;
+  logger() << "\t" << "termination: " << termination_name(r.reason) << std::endl;
+  logger() << "\t" << "optimal point: " << r.x << std::endl;
+  logger() << "\t" << "optimal value: " << r.fx << std::endl;
+}
+
+SolveResult run_method(Method& method) {
+  logger() << "INFO: " << method.name() << "_method run" << std::endl;
+  logger() << "\t" << "with initial point: " << method.current() << std::endl;
+  SolveResult r = method.run();
+  method.report();
+  return r;
+}
+
+SolveResult gradient_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget
+    )
+{
+  GradientMethod method(f, gradf, x0, epsilon, budget);
+  return run_method(method);
+}
+
+SolveResult newton_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    std::function<Matrix(Matrix)> hessf,
+    Matrix x0,
+    double epsilon,
+    bool pure,    // false means to not use armijo
+    const Budget& budget
+    )
+{
+  NewtonMethod method(f, gradf, hessf, x0, epsilon, pure, budget);
+  return run_method(method);
+}
+
+SolveResult quasinewton_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    Matrix x0,
+    Matrix B0,
+    double epsilon,
+    const Budget& budget
+    )
+{
+  QuasiNewtonMethod method(f, gradf, x0, B0, epsilon, budget);
+  return run_method(method);
+}
+
+std::vector<UserFunction> USER_FUNCTIONS;
+
+/// Pool das diferenças finitas, um só para o processo: quem avalia também executa blocos (parallel_for).
+static ThreadPool& fd_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+static std::vector<double> coordinates(const Matrix& x) {
+  std::vector<double> v(x.length());
+  for (unsigned i = 0; i < v.size(); ++i)
+    v[i] = x.get(i + 1);
+  return v;
+}
+
+/// Completa fn com o gradiente e a hessiana por diferenças centrais, se faltarem.
+static UserFunction with_derivatives(UserFunction fn) {
+  if (!fn.gradf) {
+    std::function<double(Matrix)> f = fn.f;
+    Objective objective = [f](const std::vector<double>& v) { return f(Matrix(v)); };
+    fn.gradf = [objective](Matrix x) {
+      return Matrix(fd_gradient(objective, coordinates(x), FD_CENTRAL, fd_pool()));
+    };
+    fn.numeric_gradient = true;
+  }
+  if (!fn.hessf) {
+    std::function<Matrix(Matrix)> gradf = fn.gradf;
+    Gradient gradient = [gradf](const std::vector<double>& v) { return coordinates(gradf(Matrix(v))); };
+    const unsigned n = fn.dimension;
+    SparsityPattern pattern = SparsityPattern::band(n, fn.band < 0 ? n : fn.band);
+    fn.hessf = [gradient, pattern, n](Matrix x) {
+      SparseHessian h = fd_hessian(gradient, coordinates(x), pattern, FD_CENTRAL, fd_pool());
+      Matrix H(n, n);
+      for (unsigned i = 0; i < n; ++i)
+        for (unsigned j = 0; j < n; ++j)
+          H.set(i + 1, j + 1, h.at(i, j));
+      return H;
+    };
+    fn.numeric_hessian = true;
+  }
+  return fn;
+}
+
+int register_function(const UserFunction& fn) {
+  if (!fn.f || fn.dimension == 0)
+    throw std::invalid_argument("ERROR: function " + fn.name + " needs a value and a dimension");
+  for (size_t i = 0; i < USER_FUNCTIONS.size(); ++i)
+    if (USER_FUNCTIONS[i].name == fn.name) {
+      USER_FUNCTIONS[i] = with_derivatives(fn);
+      return FIRST_USER_FUNCTION + i;
+    }
+  USER_FUNCTIONS.push_back(with_derivatives(fn));
+  return FIRST_USER_FUNCTION + USER_FUNCTIONS.size() - 1;
+}
+
+const UserFunction* user_function(int function) {
+  if (function < FIRST_USER_FUNCTION || (size_t) (function - FIRST_USER_FUNCTION) >= USER_FUNCTIONS.size())
+    return NULL;
+  return &USER_FUNCTIONS[function - FIRST_USER_FUNCTION];
+}
+
+std::function<double(Matrix)> objective(int function) {
+  if (const UserFunction* user = user_function(function))
+    return user->f;
+  switch(function) {
+    case FB:
+      return fb;
+    case FC:
+      return fc;
+    default:
+      return fa;
+  }
+}
+
+ArmijoParams ARMIJO_PROFILE[3][4];
+
+ArmijoParams armijo_params(int function, int method) {
+  if (function < FA || function > FC || method < GRADIENT || method > QUASINEWTON)
+    return ArmijoParams();
+  return ARMIJO_PROFILE[function][method];
+}
+
+std::function<Matrix(Matrix)> gradient(int function) {
+  if (const UserFunction* user = user_function(function))
+    return user->gradf;
+  switch(function) {
+    case FB:
+      return gradfb;
+    case FC:
+      return gradfc;
+    default:
+      return gradfa;
+  }
+}
+
+bool has_hessian(int function) {
+  const UserFunction* user = user_function(function);
+  return user != NULL ? (bool) user->hessf : function == FA;
+}
+
+std::function<Matrix(Matrix)> hessian(int function) {
+  if (const UserFunction* user = user_function(function)) {
+    if (!user->hessf)
+      throw std::invalid_argument("ERROR: " + user->name + " has no hessian");
+    return user->hessf;
+  }
+  if (function == FB)
+    throw std::invalid_argument("ERROR: invhessb is not implemented");
+  if (function == FC)
+    throw std::invalid_argument("ERROR: invhessc is not implemented");
+  return hessfa;
+}
+
+Method* subproblem_method(
+    int function,
+    int method,
+    double lambdak,
+    Matrix xk,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget
+    )
+{
+  std::function<double(Matrix)> f = objective(function);
+  std::function<Matrix(Matrix)> gradf = gradient(function);
+  std::function<double(Matrix)> gsub = [f,lambdak,xk](Matrix x) -> double { return g(f, lambdak, x, xk); };
+  std::function<Matrix(Matrix)> gradgsub = [gradf,lambdak,xk](Matrix x) -> Matrix { return gradg(gradf, lambdak, x, xk); };
+  Method* m = NULL;
+
+  switch(method) {
+    case GRADIENT:
+      m = new GradientMethod(gsub, gradgsub, x0, epsilon, budget);
+      break;
+    case NEWTON:
+    case NEWTONPURE: {
+      std::function<Matrix(Matrix)> hessf = hessian(function);
+      m = new NewtonMethod(
+          gsub,
+          gradgsub,
+          [hessf,lambdak,xk](Matrix x) -> Matrix { return hessg(hessf, lambdak, x, xk); },
+          x0,
+          epsilon,
+          method == NEWTONPURE,
+          budget
+          );
+      break;
+    }
+    case QUASINEWTON:
+      m = new QuasiNewtonMethod(gsub, gradgsub, x0, eye(2), epsilon, budget);
+      break;
+    default:
+      throw std::invalid_argument("ERROR: Unknown method");
+  }
+  m->setArmijo(armijo_params(function, method));
+  return m;
+}
+
+Method* portfolio_method(
+    int function,
+    const std::vector<int>& methods,
+    double lambdak,
+    Matrix xk,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget
+    )
+{
+  Budget share = budget;
+  if (budget.max_evaluations > 0 && !methods.empty())
+    share.max_evaluations = std::max(1u, budget.max_evaluations / (unsigned) methods.size());
+  std::vector<Method*> members;
+  try {
+    for (size_t i = 0; i < methods.size(); ++i)
+      members.push_back(subproblem_method(function, methods[i], lambdak, xk, x0, epsilon, share));
+  }
+  catch (...) {
+    for (size_t i = 0; i < members.size(); ++i)
+      delete members[i];
+    throw;
+  }
+  std::function<double(Matrix)> f = objective(function);
+  std::function<Matrix(Matrix)> gradf = gradient(function);
+  return new PortfolioMethod(
+      [f,lambdak,xk](Matrix x) -> double { return g(f, lambdak, x, xk); },
+      [gradf,lambdak,xk](Matrix x) -> Matrix { return gradg(gradf, lambdak, x, xk); },
+      x0, epsilon, members, methods, budget);
+}
+
+Matrix Anderson::next(const Matrix& x, const Matrix& gx) {
+  Matrix r = gx - x;
+  if (memory == 0)
+    return gx;
+  if (last_g.length() == gx.length()) {
+    dg.push_back(gx - last_g);
+    dr.push_back(r - last_r);
+    if (dg.size() > memory) {
+      dg.pop_front();
+      dr.pop_front();
+    }
+  }
+  last_g = gx;
+  last_r = r;
+  unsigned k = dg.size();
+  if (k == 0)
+    return gx;
+
+  // Equações normais (dR' dR + mu I) gamma = dR' r, por eliminação de Gauss com pivoteamento.
+  vector<vector<double> > a(k, vector<double>(k + 1, 0.0));
+  double trace = 0.0;
+  for (unsigned i = 0; i < k; ++i) {
+    for (unsigned j = 0; j < k; ++j)
+      a[i][j] = (dr[i].t() * dr[j]).x();
+    a[i][k] = (dr[i].t() * r).x();
+    trace += a[i][i];
+  }
+  for (unsigned i = 0; i < k; ++i)
+    a[i][i] += 1e-10 * trace + 1e-300;
+  for (unsigned c = 0; c < k; ++c) {
+    unsigned pivot = c;
+    for (unsigned i = c + 1; i < k; ++i)
+      if (std::fabs(a[i][c]) > std::fabs(a[pivot][c]))
+        pivot = i;
+    std::swap(a[c], a[pivot]);
+    for (unsigned i = c + 1; i < k; ++i) {
+      double factor = a[i][c] / a[c][c];
+      for (unsigned j = c; j <= k; ++j)
+        a[i][j] -= factor * a[c][j];
+    }
+  }
+  vector<double> gamma(k);
+  for (unsigned i = k; i-- > 0; ) {
+    double sum = a[i][k];
+    for (unsigned j = i + 1; j < k; ++j)
+      sum -= a[i][j] * gamma[j];
+    gamma[i] = sum / a[i][i];
+  }
+
+  Matrix xnext = gx;
+  for (unsigned i = 0; i < k; ++i)
+    xnext = xnext - gamma[i] * dg[i];
+  return xnext;
+}
+
+SolveIt::SolveIt(
+    int function,
+    Matrix x0sub,
+    int limitx0,
+    double epsilonSub,
+    double epsilonMeth,
+    int method,
+    const Budget& budget
+    ) :
+  function(function),
+  x0sub(x0sub),
+  limitx0(limitx0),
+  epsilonSub(epsilonSub),
+  epsilonMeth(epsilonMeth),
+  method(method),
+  tracker(budget),
+  xk(x0sub),
+  iter(0),
+  finished(false),
+  reason(CONVERGED),
+  seeded(false),
+  rng_state(0),
+  rng_iteration(0),
+  n_accelerated(0),
+  n_rejected(0),
+  hessian_reuse(0),
+  n_hessians(0) {
+  memset(n_wins, 0, sizeof(n_wins));
+  const UserFunction* user = user_function(function);
+  if (user != NULL && user->dimension != 2)
+    throw std::invalid_argument("ERROR: solve_it needs a function of two variables, " + user->name + " has " +
+        std::to_string(user->dimension));
+  if (method == NEWTON || method == NEWTONPURE)
+    hessian(function);    // lança se não há hessiana
+}
+
+/// state, se os campos usados como índices e enums são válidos; lança std::runtime_error se não.
+static const SolveItState& checked_state(const SolveItState& state) {
+  std::string error;
+  if ((state.function < FA || state.function > FC) && user_function(state.function) == NULL)
+    error = "unknown function " + std::to_string(state.function);
+  else if (state.method < GRADIENT || state.method > QUASINEWTON)
+    error = "unknown method " + std::to_string(state.method);
+  else if (state.reason > CANCELLED)
+    error = "unknown termination " + std::to_string(state.reason);
+  else if (state.limitx0 <= 0)
+    error = "limit must be positive";
+  if (!error.empty())
+    throw std::runtime_error("ERROR: corrupt solve_it state: " + error);
+  return state;
+}
+
+SolveIt::SolveIt(const SolveItState& state, const Budget& budget) :
+  SolveIt(checked_state(state).function, Matrix(vector<double>{state.x0sub1, state.x0sub2}), state.limitx0,
+      state.epsilonSub, state.epsilonMeth, state.method, budget) {
+  xk = Matrix(vector<double>{state.xk1, state.xk2});
+  iter = state.iter;
+  finished = state.finished;
+  reason = (Termination) state.reason;
+  seeded = state.seeded;
+  rng_state = rng_iteration = state.rng_state;
+  tracker.add_evaluations(state.evaluations);
+}
+
+SolveItState SolveIt::checkpoint() const {
+  SolveItState s;
+  memset(&s, 0, sizeof(s));
+  s.function = function;
+  s.method = method;
+  s.limitx0 = limitx0;
+  s.epsilonSub = epsilonSub;
+  s.epsilonMeth = epsilonMeth;
+  s.x0sub1 = x0sub.x1();
+  s.x0sub2 = x0sub.x2();
+  // xk só muda no fim da iteração externa; no meio dela, volta-se ao seu início.
+  s.xk1 = xk.x1();
+  s.xk2 = xk.x2();
+  s.iter = sub ? iter - 1 : iter;
+  s.finished = finished;
+  s.reason = reason;
+  s.seeded = seeded;
+  s.rng_state = sub ? rng_iteration : rng_state;
+  s.evaluations = tracker.evaluations();
+  return s;
+}
+
+void SolveIt::setSeed(unsigned seed) {
+  seeded = true;
+  rng_state = seed;
+}
+
+void SolveIt::setPortfolio(const std::vector<int>& methods) {
+  for (size_t i = 0; i < methods.size(); ++i) {
+    if (methods[i] < GRADIENT || methods[i] > QUASINEWTON)
+      throw std::invalid_argument("ERROR: Unknown method");
+    if ((methods[i] == NEWTON || methods[i] == NEWTONPURE) && !has_hessian(function))
+      throw std::invalid_argument("ERROR: NEWTON is only implemented for FA and functions with a hessian");
+  }
+  portfolio = methods;
+}
+
+void SolveIt::finish(Termination reason) {
+  this->reason = reason;
+  finished = true;
+  sub.reset();
+}
+
+void SolveIt::begin_iteration() {
+  ++iter;
+
+  if (iter == MAX_ITERATIONS) {
+    logger() << "Interrupting this solve_it run. Reason: too many iterations already: #iter = " << iter << std::endl;
+    finish(TOO_MANY_ITERATIONS);
+    return;
+  }
+
+  logger() << "**************************************************************" << std::endl;
+  logger() << "Beginning iteration #" << iter << " of solve_it:" << std::endl;
+
+  // Critério de parada 2.
+  if (gradient(function)(xk).mod() < epsilonSub) {
+    logger() << "Finished solve_it. Reason: |gradf(xk)| near to zero, with xk = (" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
+    finish(CONVERGED);
+    return;
+  }
+
+  Termination stop;
+  if (tracker.exceeded(stop)) {
+    logger() << "Interrupting this solve_it run. Reason: " << termination_name(stop) << std::endl;
+    finish(stop);
+    return;
+  }
+
+  // Inicialização do problema de otimização, com números aleatórios
+  rng_iteration = rng_state;
+  Matrix x0(2,1);
+  x0.set(1, seeded ? rand_double(limitx0, &rng_state) : rand_double(limitx0));
+  x0.set(2, seeded ? rand_double(limitx0, &rng_state) : rand_double(limitx0));
+
+  // Atualizando o valor do lambdak (=1.0/k)
+  double lambdak = 1.0/iter;
+
+  if (portfolio.empty())
+    sub.reset(subproblem_method(function, method, lambdak, xk, x0, epsilonMeth, tracker.remaining()));
+  else
+    sub.reset(portfolio_method(function, portfolio, lambdak, xk, x0, epsilonMeth, tracker.remaining()));
+
+  // A hessiana de g muda pouco de um subproblema para o seguinte.
+  NewtonMethod* newton = dynamic_cast<NewtonMethod*>(sub.get());
+  if (newton != NULL && hessian_reuse > 0) {
+    newton->setHessianReuse(hessian_reuse);
+    // Com every = 1 é o Newton puro: cada iteração, inclusive a primeira, calcula a sua hessiana.
+    if (hessian_reuse > 1 && last_inverse.length() > 0)
+      newton->setInverseHessian(last_inverse);
+  }
+  logger() << "INFO: " << sub->name() << "_method run" << std::endl;
+  logger() << "\t" << "with initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
+}
+
+void SolveIt::end_iteration() {
+  sub->report();
+  SolveResult inner = sub->result();
+  const PortfolioMethod* race = dynamic_cast<const PortfolioMethod*>(sub.get());
+  if (race != NULL && race->winner() >= 0)
+    ++n_wins[race->winner()];
+  const NewtonMethod* newton = dynamic_cast<const NewtonMethod*>(sub.get());
+  if (newton != NULL) {
+    n_hessians += newton->hessians();
+    if (hessian_reuse > 1)
+      last_inverse = newton->inverseHessian();
+  }
+  sub.reset();
+  tracker.add_evaluations(inner.n_evaluations);
+
+  // O método falhou no subproblema: para com o último xk.
+  if (!inner.converged()) {
+    logger() << "Interrupting this solve_it run. Reason: the method stopped with: " << termination_name(inner.reason) << std::endl;
+    finish(inner.reason);
+    return;
+  }
+  Matrix xnext = inner.x;
+
+  // Critério de parada 1.
+  if ((xnext - xk).mod() < epsilonSub) {
+    logger() << "Finished solve_it. Reason: xnext is near to xk, they are equal to (" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
+    xk = xnext;
+    finish(CONVERGED);
+    return;
+  }
+
+  Matrix xacc = anderson.next(xk, xnext);
+  if (anderson.size() > 0) {
+    std::function<double(Matrix)> f = objective(function);
+    double facc = f(xacc);
+    tracker.add_evaluations(2);
+    if (std::isfinite(facc) && facc <= f(xnext)) {
+      logger() << "INFO: Anderson step accepted: (" << xacc.x1() << ", " << xacc.x2() << ")" << std::endl;
+      ++n_accelerated;
+      xnext = xacc;
+    }
+    else {
+      ++n_rejected;
+      anderson.restart();
+    }
+  }
+  xk = xnext;
+}
+
+bool SolveIt::step() {
+  if (finished)
+    return false;
+  if (!sub) {
+    begin_iteration();
+    if (finished)
+      return false;
+  }
+  if (!sub->step())
+    end_iteration();
+  return true;
+}
+
+SolveResult SolveIt::run() {
+  while (step())
+    ;
+  return result();
+}
+
+void SolveIt::cancel() {
+  if (!finished)
+    finish(CANCELLED);
+}
+
+SolveResult SolveIt::result() const {
+  SolveResult r;
+  r.x = xk;
+  r.fx = objective(function)(xk);
+  r.reason = reason;
+  r.iterations = iter;
+  r.n_evaluations = tracker.evaluations() + (sub ? sub->result().n_evaluations : 0);
+  return r;
+}
+
+void SolveIt::report() const {
+  SolveResult r = result();
+  Timer t = timer;
+  logger() << "Information about this solve_it run:" << std::endl;
+  logger() << "\t" << "elapsed time: " << t.elapsed() << "s" << std::endl;
+  logger() << "\t" << "initial point: " << "(" << x0sub.x1() << ", " << x0sub.x2() << ")" << std::endl;
+  logger() << "\t" << "epsilon: " << epsilonSub << std::endl;
+  logger() << "\t" << "n_iterations: " << r.iterations << std::endl;
+  logger() << "\t" << "termination: " << termination_name(r.reason) << std::endl;
+  logger() << "\t" << "optimal point: " << "(" << r.x.x1() << ", " << r.x.x2() << ")" << std::endl;
+  logger() << "\t" << "optimal value: " << r.fx << std::endl;
+}
+
+SolveResult solve_it(
+    int function,       // resolver qual função?
+    Matrix x0sub,       // com que ponto inicial?
+    int limitx0,        // com que limites para gerar os pontos iniciais dos métodos?
+    double epsilonSub,  // epsilon do problema
+    double epsilonMeth, // epsilon dos métodos (gradiente, etc.)
+    int method,         // resolver com qual método? (gradiente, etc.)
+    const Budget& budget  // avaliações/tempo valem para a execução toda; max_iterations, para cada método
+    )
+{
+  logger() << "INFO: solve_it run" << std::endl;
+  logger() << "\t" << "with initial point: " << "(" << x0sub.x1() << ", " << x0sub.x2() << ")" << std::endl;
+
+  SolveIt solver(function, x0sub, limitx0, epsilonSub, epsilonMeth, method, budget);
+  SolveResult result = solver.run();
+  solver.report();
+  return result;
+}
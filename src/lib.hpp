@@ -2,25 +2,44 @@
 #define _LIB_HPP_
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <cstdlib>
 #include <ctime>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
+// Versão da biblioteca. Mude quando os resultados dos métodos mudarem: ela entra na chave do cache (cache.hpp).
+#define LIB_VERSION "1.1.0"
+
 // Precisão a ser usada para imprimir os doubles.
-unsigned DEFAULT_PRECISION = 6;
+extern unsigned DEFAULT_PRECISION;
+
+// Se false, os métodos não imprimem nada (útil quando muitas execuções rodam juntas).
+extern bool VERBOSE;
+
+/// Saída dos relatórios dos métodos: std::cout, ou nada se VERBOSE for false ou a thread foi silenciada.
+std::ostream& logger();
+
+/// Silencia logger() na thread atual (threads auxiliares não disputam o std::cout).
+void silence_logger();
 
 // Epsilon para um t (de armijo) muito pequeno, de modo que o passo seja praticamente zero, entrando em um loop infinito.
-double EPSILON_ARMIJO_CALL = 1e-15;
+extern double EPSILON_ARMIJO_CALL;
 
 // Número máximo de iterações para o SOLVE_IT
-unsigned MAX_ITERATIONS = 400;
+extern unsigned MAX_ITERATIONS;
 
 class Matrix {
   public:
@@ -95,6 +114,9 @@ class Matrix {
     /// Return the number of elements of this matrix.
     unsigned length() const;
 
+    /// Return true if no element is NaN or infinite.
+    bool isFinite() const;
+
   private:
     /** Dimensions of the Matrix.
      * m = number of lines
@@ -107,183 +129,12 @@ class Matrix {
 };
 
 /// Return a n x n identity matrix
-Matrix eye(unsigned n) {
-  Matrix w(n,n,0.0);
-  for (unsigned i = 1; i <= n; ++i)
-    w.set(i,i,1.0);
-  return w;
-}
-
-Matrix::Matrix() :
-  m(0), 
-  n(0) {
-  v.clear();
-}
-
-Matrix::Matrix(unsigned rows, unsigned cols, double value) :
-  m(rows),
-  n(cols) {
-  v = vector< vector<double> >(rows, vector<double>(cols, value));
-}
-
-Matrix::Matrix(const Matrix& o) :
-  m(o.m),
-  n(o.n),
-  v(o.v) {
-}
-
-Matrix::Matrix(const vector<double>& w) :
-  m(w.size()),
-  n(1) {
-    for (unsigned i = 0; i < w.size(); ++i)
-      v.push_back(vector<double>(1, w[i]));
-}
-
-double Matrix::det2() const {
-  if (m != 2 && n != 2)
-    throw std::invalid_argument("ERROR: Can't apply det2 to a non 2x2 matrix");
-  return get(1,1) * get(2,2) - get(1,2) * get(2,1); 
-}
-
-Matrix::Matrix(const vector<vector<double> >& w) :
-  m(w.size()),
-  n(w[0].size()),
-  v(w) {
-}
-
-unsigned Matrix::getCols() const {
-  return n;
-}
-
-unsigned Matrix::getRows() const {
-  return m;
-}
-
-double Matrix::get(unsigned i) const {
-  return v.at((i - 1) % m).at((i-1) / m);
-}
-
-void Matrix::set(unsigned i, double value) {
-  v.at((i - 1) % m).at((i-1) / m) = value;
-}
-
-double Matrix::get(unsigned i, unsigned j) const {
-  return v.at(i-1).at(j-1);
-}
-
-void Matrix::set(unsigned i, unsigned j, double value) {
-  v.at(i-1).at(j-1) = value;
-}
-    
-Matrix Matrix::operator+(const Matrix& o) const {
-  Matrix a(m, n);
-  for (unsigned i = 1; i <= m; ++i)
-    for (unsigned j = 1; j <= n; ++j)
-      a.set(i, j, get(i,j) + o.get(i,j));
-  return a;
-}
-
-Matrix Matrix::operator-(const Matrix& o) const {
-  Matrix a(m, n);
-  for (unsigned i = 1; i <= m; ++i)
-    for (unsigned j = 1; j <= n; ++j)
-      a.set(i, j, get(i,j) - o.get(i,j));
-  return a;
-}
-
-Matrix Matrix::operator*(double s) const {
-  Matrix a(m, n);
-  for (unsigned i = 1; i <= m; ++i)
-    for (unsigned j = 1; j <= n; ++j)
-      a.set(i, j, get(i,j) * s);
-  return a;
-}
-
-Matrix Matrix::operator/(double s) const {
-  Matrix a(m, n);
-  for (unsigned i = 1; i <= m; ++i)
-    for (unsigned j = 1; j <= n; ++j)
-      a.set(i, j, get(i,j) / s);
-  return a;
-}
-
-Matrix Matrix::t() const {
-  return this->transpose();
-}
-
-Matrix Matrix::transpose() const {
-  Matrix w(getCols(), getRows());
-  for (unsigned i = 1; i <= getRows(); ++i)
-    for (unsigned j = 1; j <= getCols(); ++j)
-      w.set(j,i,get(i,j));
-  return w;
-}
-
-bool Matrix::isVector() const {
-  return m == 1 || n == 1;
-}
-
-double Matrix::mod() const {
-  double sum = 0.0;
-  for (unsigned i = 1; i <= length(); ++i)
-    sum += get(i) * get(i);
-  return sqrt(sum);
-}
-
-double Matrix::x() const {
-  if (m == 1 && n == 1)
-    return get(1,1);
-  else
-    throw std::invalid_argument("ERROR: Not a 1x1 Matrix");
-}
-
-double Matrix::x1() const {
-  if (m == 2 && n == 1)
-    return get(1,1);  
-  else
-    throw std::invalid_argument("ERROR: Not a 2x1 column vector");
-}
-
-double Matrix::x2() const {
-  if (m == 2 && n == 1)
-    return get(2,1);  
-  else
-    throw std::invalid_argument("ERROR: Not a 2x1 column vector");
-}
-
-unsigned Matrix::length() const {
-  return m * n;
-}
-
-Matrix Matrix::operator*(const Matrix& o) const {
-  Matrix w(getRows(), o.getCols());
-  if (getCols() != o.getRows())
-    throw std::invalid_argument("ERROR: Invalid matrix multiplication");
-  for (unsigned i = 1; i <= getRows(); ++i)
-    for (unsigned j = 1; j <= o.getCols(); ++j) {
-      double sum = 0.0;
-      for (unsigned k = 1; k <= getCols(); ++k) {
-        sum += get(i,k) * o.get(k,j);
-      }
-      w.set(i,j,sum);
-    }
-  return w;
-}
-
-Matrix operator*(double s, const Matrix& o) {
-  return o * s;
-}
-
-void Matrix::debug() const {
-  std::cout << "INFO: Matrix debug" << std::endl;
-  std::cout << "\t" << "#rows=" << m << ", #cols=" <<  n << std::endl;
-  for (unsigned i = 1; i <= m; ++i) {
-    std::cout << "\t";
-    for (unsigned j = 1; j <= n; ++j)
-      std::cout << get(i,j) << " ";
-    std::cout << std::endl;
-  }
-}
+Matrix eye(unsigned n);
+
+Matrix operator*(double s, const Matrix& o);
+
+/// Vetores como (a, b, ...) e matrizes como [a, b; c, d], para os relatórios.
+std::ostream& operator<<(std::ostream& out, const Matrix& x);
 
 /**
  * Classe para contar o tempo de um método. 
@@ -307,100 +158,47 @@ class Timer {
 };
 
 /// Retorna um inteiro aleatório entre -limit e +limit (não-incluso).
-int rand_int(unsigned limit) { 
-  int signal = ((rand() % 2) == 0) ? (-1) : (+1);
-  return signal * (rand() % limit); 
-};
+int rand_int(unsigned limit);
 
 /// Retorna um número aleatório entre -limit e +limit.
-int rand_double(unsigned limit) {
-  int signal = ((rand() % 2) == 0) ? (-1) : (+1);
-  double decimals = (rand() % 1000) / 1000.0;
-  return signal * ((rand() % limit) + decimals); 
-};
+int rand_double(unsigned limit);
+
+/// Idem, com rand_r(state) em vez de rand(): reprodutível e seguro entre threads.
+int rand_double(unsigned limit, unsigned* state);
 
 /// fa
-double fa(Matrix x) {
-  return pow(x.x1(), 2) + pow(exp(x.x1()) - x.x2(), 2.0);
-}
+double fa(Matrix x);
 
 /// gradiente de fa
-Matrix gradfa(Matrix x) {
-  Matrix w(2,1);
-  w.set(1, (2 * x.x1()) + 2 * ( exp(x.x1()) - x.x2() ) * exp(x.x1()));
-  w.set(2,                2 * ( exp(x.x1()) - x.x2() ) * (-1));
-  return w;
-}
+Matrix gradfa(Matrix x);
 
 /// hessiana de fa
-Matrix hessfa(Matrix x) {
-  Matrix w(2,2);
-  w.set(1, 1, 2 + 4 * exp(2 * x.x1()) - 2 * exp(x.x1()) * x.x2());
-  w.set(1, 2, -2 * exp(x.x1()));
-  w.set(2, 1, -2 * exp(x.x1()));
-  w.set(2, 2, 2);
-  return w;
-}
+Matrix hessfa(Matrix x);
 
 /// fb
-double fb(Matrix x) {
-  return sqrt(fa(x));
-}
+double fb(Matrix x);
 
 /// gradiente de fb
-Matrix gradfb(Matrix x) {
-  Matrix w(2,1);
-  w.set(1, (1.0/(2 * fb(x))) * gradfa(x).x1());
-  w.set(2, (1.0/(2 * fb(x))) * gradfa(x).x2());
-  return w;
-}
+Matrix gradfb(Matrix x);
 
 /// fc
-double fc(Matrix x) {
-  return log(1.0 + fa(x));
-}
+double fc(Matrix x);
 
 /// gradiente de fc
-Matrix gradfc(Matrix x) {
-  Matrix w(2,1);
-  w.set(1, (1.0/fc(x)) * gradfa(x).x1());
-  w.set(2, (1.0/fc(x)) * gradfa(x).x2());
-  return w;
-}
+Matrix gradfc(Matrix x);
 
 /**
  * d do subproblema.
  * x: a variável
  * xkk: o ponto anterior
  */
-double d(Matrix x, Matrix xkk) {
-  return
-    pow(x.x1() - xkk.x1(), 2.0) +
-    pow((x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1())), 2.0);
-}
+double d(Matrix x, Matrix xkk);
 
 /// gradiente de d
-Matrix gradd(Matrix x, Matrix xkk) {
-  Matrix w(2,1);
-  w.set(1,
-      2 * (x.x1() - xkk.x1()) +
-      2 * (-exp(x.x1())) * ((x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1())))
-      );
-  w.set(2,
-      2 * ((x.x2() - xkk.x2()) - (exp(x.x1()) - exp(xkk.x1())))
-      );
-  return w;
-}
+Matrix gradd(Matrix x, Matrix xkk);
 
 /// hessiana de d
-Matrix hessd(Matrix x, Matrix xkk) {
-	Matrix w(2,2);
-	w.set(1, 1, 2 + 4 * exp(2*x.x1()) - 2 * exp(x.x1()) * (x.x2() - xkk.x2() + exp(xkk.x1())));
-	w.set(1, 2, -2 * exp(x.x1()));
-	w.set(2, 1, -2 * exp(x.x1()));
-	w.set(2, 2, 2);
-	return w;
-}
+Matrix hessd(Matrix x, Matrix xkk);
 
 /**
  * g do subproblema
@@ -411,10 +209,7 @@ double g(
     double lambdak,
     Matrix x,
     Matrix xkk
-    )
-{
-  return f(x) + (((lambdak/2.0) * d(x,xkk)));
-}
+    );
 
 /// gradiente de g
 Matrix gradg(
@@ -422,10 +217,7 @@ Matrix gradg(
     double lambdak,
     Matrix x,
     Matrix xkk
-    )
-{
-  return gradf(x) + ((lambdak/2.0) * gradd(x,xkk));
-}
+    );
 
 /// hessiana de g
 Matrix hessg(
@@ -433,10 +225,13 @@ Matrix hessg(
     double lambdak,
     Matrix x,
     Matrix xkk
-)
-{
-    return hessf(x) + ((lambdak/2.0) * hessd(x,xkk));
-}
+);
+
+/**
+ * Inversa de uma matriz 2x2.
+ * Retorna false (sem alterar inv) se o determinante for zero.
+ */
+bool inv2(const Matrix& w, Matrix& inv);
 
 /// inversa da hessiana de g
 Matrix invhessg(
@@ -444,24 +239,134 @@ Matrix invhessg(
     double lambdak,
     Matrix x,
     Matrix xkk
-)
-{
-  Matrix w = hessg(hessf, lambdak, x, xkk);	
+);
+
+/// Motivo de parada de um método de otimização.
+enum Termination {
+  CONVERGED,          // |gradf(xk)| < epsilon
+  STEP_TOO_SMALL,     // ak * dk muito pequeno, o método não sai do lugar
+  TOO_MANY_ITERATIONS,
+  SINGULAR_HESSIAN,   // hessiana sem inversa (Newton)
+  NOT_FINITE,         // f, gradiente ou direção com NaN/infinito
+  TOO_MANY_EVALUATIONS,
+  TIME_LIMIT,
+  CANCELLED
+};
 
-  Matrix ret(2,2);
-  ret.set(1, 1, w.get(2,2));
-  ret.set(1, 2, (-1) * w.get(1,2));
-  ret.set(2, 1, (-1) * w.get(2,1));
-  ret.set(2, 2, w.get(1,1));
+/// Nome legível de um motivo de parada.
+const char* termination_name(Termination reason);
+
+/**
+ * Resultado de um método de otimização.
+ * Se o método não convergiu, x é o melhor iterado (menor f) encontrado.
+ */
+struct SolveResult {
+  Matrix x;                 // ponto encontrado
+  double fx;                // f(x)
+  Termination reason;       // motivo de parada
+  unsigned iterations;      // número de iterações
+  unsigned n_call_armijo;   // número de chamadas de Armijo
+  unsigned n_evaluations;   // número de avaliações de f
+
+  SolveResult() : fx(NAN), reason(CONVERGED), iterations(0), n_call_armijo(0), n_evaluations(0) {}
+
+  bool converged() const { return reason == CONVERGED; }
+
+  /// Guarda xk se ele for o melhor iterado até agora.
+  void keep_best(const Matrix& xk, double fxk) {
+    if (std::isfinite(fxk) && !(fxk >= fx)) {
+      x = xk;
+      fx = fxk;
+    }
+  }
+};
 
-  double det = w.det2();
-  if (det == 0) 
-    throw std::invalid_argument("ERROR: Determinant is zero: this matrix doesn't have a inverse");
-  else
-    ret = ret / det;
+/**
+ * Cancelamento cooperativo: outra thread chama cancel() e os métodos param
+ * (com CANCELLED) na próxima verificação dos laços internos.
+ */
+class CancelToken {
+  public:
+    CancelToken() : flag(false) {}
+    void cancel() { flag.store(true); }
+    void reset() { flag.store(false); }
+    bool cancelled() const { return flag.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<bool> flag;
+};
 
-  return ret;
-}
+/// Limites de uma execução de um método. Zero significa sem limite.
+struct Budget {
+  unsigned max_iterations;      // iterações do método
+  unsigned max_evaluations;     // avaliações de f (inclusive as de Armijo)
+  double max_seconds;           // tempo de parede
+  const CancelToken* cancel;    // pode ser NULL
+
+  Budget() : max_iterations(0), max_evaluations(0), max_seconds(0.0), cancel(NULL) {}
+};
+
+/// Acompanha o consumo de um Budget durante uma execução.
+class BudgetTracker {
+  public:
+    BudgetTracker(const Budget& budget) : budget(budget), n_evaluations(0) {}
+
+    void count_evaluation() { ++n_evaluations; }
+    void add_evaluations(unsigned n) { n_evaluations += n; }
+    unsigned evaluations() const { return n_evaluations; }
+    double elapsed() { return timer.elapsed(); }
+
+    /// Retorna true, com o motivo em reason, se avaliações, tempo ou cancelamento esgotaram.
+    bool exceeded(Termination& reason) {
+      if (budget.cancel != NULL && budget.cancel->cancelled())
+        reason = CANCELLED;
+      else if (budget.max_evaluations > 0 && n_evaluations >= budget.max_evaluations)
+        reason = TOO_MANY_EVALUATIONS;
+      else if (budget.max_seconds > 0 && timer.elapsed() >= budget.max_seconds)
+        reason = TIME_LIMIT;
+      else
+        return false;
+      return true;
+    }
+
+    /// Idem, considerando também as iterações já feitas.
+    bool exceeded(unsigned iterations, Termination& reason) {
+      if (budget.max_iterations > 0 && iterations >= budget.max_iterations) {
+        reason = TOO_MANY_ITERATIONS;
+        return true;
+      }
+      return exceeded(reason);
+    }
+
+    /// Budget com o que resta deste (para uma execução aninhada).
+    Budget remaining() {
+      Budget b = budget;
+      if (budget.max_evaluations > 0)
+        b.max_evaluations = budget.max_evaluations > n_evaluations ? budget.max_evaluations - n_evaluations : 1;
+      if (budget.max_seconds > 0)
+        b.max_seconds = std::max(budget.max_seconds - timer.elapsed(), 1e-9);
+      return b;
+    }
+
+  private:
+    Budget budget;
+    Timer timer;
+    unsigned n_evaluations;
+};
+
+/// f que conta suas avaliações em tracker.
+std::function<double(Matrix)> counted(std::function<double(Matrix)> f, BudgetTracker& tracker);
+
+/// Parâmetros da regra de Armijo: passo inicial s, fator de redução beta e sigma.
+struct ArmijoParams {
+  double s, beta, sigma;
+
+  ArmijoParams(double s = 1.0, double beta = 0.5, double sigma = 0.1) : s(s), beta(beta), sigma(sigma) {}
+
+  /// s > 0, 0 < beta < 1 e 0 < sigma < 1.
+  bool valid() const { return s > 0 && beta > 0 && beta < 1 && sigma > 0 && sigma < 1; }
+
+  bool operator==(const ArmijoParams& o) const { return s == o.s && beta == o.beta && sigma == o.sigma; }
+};
 
 /**
  * Regra de Armijo.
@@ -485,217 +390,294 @@ double armijo_call(
     // Para apenas copiar a referência do valor: const Matrix& x
     // Vantagem da versão com referência: é mais rápida
     const Matrix& x,
-    const Matrix& p
-    )
-{
-  std::cout << "\t\t" << "INFO: armijo_call: ";
-  Timer timer;
-
-  // Skipping right through the test means 1 iteration.
-  // iter = m, só de armijo
-  unsigned iter = 0;
-
-  while (true) {
-    if ( (f(x) - f(x + s * pow(beta, iter) * p)) >= -sigma * s * pow(beta, iter) * ((gradf(x)).t() * p).x() )
-      break;
-    ++iter;
-  }
-
-  double t = s * pow(beta, iter);
-  std::cout <<
-    "#iter=" << iter+1 << ", t=" << setprecision(15) << t <<
-    setprecision(2) << " \%\% s=" << s << ", beta=" << beta << ", sigma=" << sigma <<
-    setprecision(DEFAULT_PRECISION) << std::endl; 
-  std::cout << "\t\t\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
-  return t;
-}
+    const Matrix& p,
+    BudgetTracker* tracker = NULL   // se não for NULL, a busca para quando o budget esgota
+    );
 
-/// Método do gradiente
-Matrix gradient_method(
+/// Como acima, com f(x) e gradf(x)' p já conhecidos (o método já os calculou em xk).
+double armijo_call(
+    double s,
+    double beta,
+    double sigma,
     std::function<double(Matrix)> f,
-    std::function<Matrix(Matrix)> gradf,
-    Matrix x0,
-    double epsilon
-    )
-{
-  std::cout << "INFO: gradient_method run" << std::endl;
-  std::cout << "initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-
-  Timer timer;
-  Matrix xk = x0;             // x atual
-  unsigned iter = 0;          // Iteração atual
-  unsigned n_call_armijo = 0; // Número de chamadas de Armijo.
-
-  while(true) {
-    ++iter;
-    std::cout << "-------------------------------------------------------------------" << std::endl;
-    std::cout << "Beginning iteration #" << iter << " of the gradient method:" << std::endl;
-
-    // Critério de parada.
-    if ((gradf(xk)).mod() < epsilon) 
-      break;
-
-    Matrix dk = (-1) * gradf(xk);     // descida (o gradiente)
-
-    // Ordem: s, beta, sigma (o), ...
-    double ak = armijo_call(1.0, 0.5, 0.1, f, gradf, xk, dk);
-    ++n_call_armijo;
-
-    if ((ak * dk).mod() < EPSILON_ARMIJO_CALL) {
-      throw std::invalid_argument("WARNING: ak * dk too small. Stopping here, otherwise this would be an infinite loop.");
-    }
+    const Matrix& x,
+    double fx,                // f(x)
+    double slope,             // gradf(x)' p
+    const Matrix& p,
+    BudgetTracker* tracker = NULL
+    );
 
-    // Atualização do xk.
-    xk = xk + ak * dk;
+/**
+ * Método de otimização executado passo a passo.
+ * Cada step() faz uma iteração e devolve o controle, de modo que um
+ * escalonador pode intercalar muitas execuções em poucas threads,
+ * interromper as lentas e acompanhar os iterados.
+ *
+ * Como usar:
+ *    GradientMethod m(f, gradf, x0, epsilon);
+ *    while (m.step())
+ *      <usar m.current(), m.value()>;
+ *    SolveResult r = m.result();
+ */
+class Method {
+  public:
+    Method(
+        std::function<double(Matrix)> f,
+        std::function<Matrix(Matrix)> gradf,
+        Matrix x0,
+        double epsilon,
+        const Budget& budget
+        );
+    virtual ~Method() {}
 
-    std::cout << "iter = " << iter << "\tINFO: gradient_method" << std::endl;
-    std::cout << "\t\t" << "dk: " << "(" << dk.x1() << ", " << dk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "xk: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "f(xk): " << f(xk) << std::endl;
-  }
+    // f conta as avaliações em tracker, por referência: não copiar.
+    Method(const Method&) = delete;
+    Method& operator=(const Method&) = delete;
 
-  std::cout << "Information about this Gradient  method run:" << std::endl;
-  std::cout << "\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
-  std::cout << "\t" << "initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-  std::cout << "\t" << "epsilon: " << epsilon << std::endl;
-  std::cout << "\t" << "n_iterations: " << iter + 1 << std::endl;
-  std::cout << "\t" << "n_call_armijo: " << n_call_armijo << std::endl;
-  std::cout << "\t" << "optimal point: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-  std::cout << "\t" << "optimal value: " << f(xk) << std::endl;
+    /// Faz uma iteração. Retorna false se o método já tinha terminado.
+    virtual bool step();
 
-  return xk;
-}
+    /// Executa até o fim.
+    SolveResult run();
 
-/// Método de Newton
-Matrix newton_method(
-    std::function<double(Matrix)> f,
-    std::function<Matrix(Matrix)> gradf,
-    std::function<Matrix(Matrix)> invhessf,
-    Matrix x0,
-    double epsilon,
-    bool pure = false     // false means to not use armijo
-    )
-{
-  std::cout << "INFO: newton_method run" << std::endl;
-  std::cout << "\t" << "with initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-
-  Timer timer;
-  Matrix xk = x0;
-  unsigned iter = 0;
-  unsigned n_call_armijo = 0;
-  double ak;
-
-  while(true) {
-    ++iter;
-    std::cout << "-------------------------------------------------------------------" << std::endl;
-    std::cout << "Beginning iteration #" << iter << " of the newton method:" << std::endl;
-
-    // Critério de parada.
-    if ((gradf(xk)).mod() < epsilon)
-      break;
-
-    Matrix dk = (-1) * invhessf(xk) * gradf(xk);
-
-    if (pure)
-      ak = 1;
-    else {
-      ak = armijo_call(1.0, 0.5, 0.1, f, gradf, xk, dk);
-      ++n_call_armijo;
+    /// Interrompe a execução (motivo CANCELLED).
+    void cancel();
+
+    /// Nome do método, para os relatórios.
+    virtual const char* name() const = 0;
+
+    bool done() const { return finished; }
+    const Matrix& current() const { return xk; }    // iterado atual
+    double value() const { return fxk; }            // f(current()), NaN antes do primeiro passo
+    const Matrix& direction() const { return dk; }  // última direção de descida
+    unsigned iteration() const { return iter; }
+
+    /// Resultado da execução; antes do fim, o melhor iterado até agora.
+    SolveResult result() const;
+
+    /// Parâmetros da busca de Armijo (padrão: s = 1, beta = 0.5, sigma = 0.1).
+    void setArmijo(const ArmijoParams& params) { armijo = params; }
+
+    /// Imprime o resumo da execução.
+    void report() const;
+
+  protected:
+    /// Direção de descida em xk. Se não houver, chama finish() e retorna false.
+    virtual bool compute_direction() = 0;
+
+    /// Tamanho do passo na direção dk (Armijo).
+    virtual double steplength();
+
+    /// Chamado depois que xk, fxk e gk passaram para o novo iterado.
+    virtual void moved(const Matrix& xprev, const Matrix& gprev) {}
+
+    /// Imprime o estado após uma iteração.
+    virtual void log_iteration() const;
+
+    void finish(Termination reason);
+
+    std::function<double(Matrix)> f;
+    std::function<Matrix(Matrix)> gradf;
+    Matrix x0;
+    double epsilon;
+    ArmijoParams armijo;
+    BudgetTracker tracker;
+    Timer timer;
+
+    Matrix xk, gk, dk;        // iterado, gradiente e direção
+    double fxk;
+    unsigned iter;
+    unsigned n_call_armijo;
+    bool evaluated;           // fxk e gk valem para xk
+    bool finished;
+    SolveResult best;
+
+  private:
+    /// Avalia f e o gradiente em xk.
+    void evaluate();
+
+    /// Verifica os critérios de parada em xk; retorna true se terminou.
+    bool check();
+};
+
+/// Método do gradiente, passo a passo.
+class GradientMethod : public Method {
+  public:
+    GradientMethod(
+        std::function<double(Matrix)> f,
+        std::function<Matrix(Matrix)> gradf,
+        Matrix x0,
+        double epsilon,
+        const Budget& budget = Budget()
+        ) : Method(f, gradf, x0, epsilon, budget) {}
+
+    const char* name() const { return "gradient"; }
+
+  protected:
+    bool compute_direction() {
+      dk = (-1) * gk;     // descida (o gradiente)
+      return true;
+    }
+};
+
+/**
+ * Método de Newton, passo a passo.
+ *
+ * Com setHessianReuse(k), é o Newton de Shamanskii (k = 1: Newton; k grande:
+ * método da corda): a inversa da hessiana vale por até k iterações e só é
+ * recalculada antes disso se o progresso piorar (|grad| caiu menos que o fator
+ * ratio na última iteração) ou se a direção deixar de ser de descida.
+ */
+class NewtonMethod : public Method {
+  public:
+    NewtonMethod(
+        std::function<double(Matrix)> f,
+        std::function<Matrix(Matrix)> gradf,
+        std::function<Matrix(Matrix)> hessf,
+        Matrix x0,
+        double epsilon,
+        bool pure = false,    // false means to not use armijo
+        const Budget& budget = Budget()
+        ) : Method(f, gradf, x0, epsilon, budget), hessf(hessf), pure(pure),
+            reuse(1), ratio(0.5), age(0), stale(false), n_hessians(0) {}
+
+    const char* name() const { return "newton"; }
+
+    /// Reusa a inversa da hessiana por até every iterações (1 = recalcula sempre).
+    void setHessianReuse(unsigned every, double ratio = 0.5) {
+      reuse = std::max(1u, every);
+      this->ratio = ratio;
     }
 
-    if ((ak * dk).mod() < 1e-15) {
-      throw std::invalid_argument("WARNING: ak * dk too small. Stopping here, otherwise this would be an infinite loop.");
+    /// Começa com esta inversa (de outra execução, p. ex.), como se tivesse acabado de ser calculada.
+    void setInverseHessian(const Matrix& inv) {
+      invhk = inv;
+      age = 0;
     }
 
-    // Atualização do xk.
-    xk = xk + ak * dk;
+    /// Inversa da hessiana em uso; vazia antes da primeira iteração.
+    const Matrix& inverseHessian() const { return invhk; }
 
-    std::cout << "iter = " << iter << "\tINFO: newton_method" << std::endl;
-    std::cout << "\t\t" << "dk: " << "(" << dk.x1() << ", " << dk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "xk: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "f(xk): " << f(xk) << std::endl;
-  }
+    /// Hessianas calculadas (e invertidas) até agora.
+    unsigned hessians() const { return n_hessians; }
 
-  std::cout << "Information about this Newton method run:" << std::endl;
-  std::cout << "\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
-  std::cout << "\t" << "initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-  std::cout << "\t" << "epsilon: " << epsilon << std::endl;
-  std::cout << "\t" << "n_iterations: " << iter + 1 << std::endl;
-  std::cout << "\t" << "n_call_armijo: " << n_call_armijo << std::endl;
-  std::cout << "\t" << "optimal point: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-  std::cout << "\t" << "optimal value: " << f(xk) << std::endl;
+  protected:
+    bool compute_direction() {
+      bool fresh = invhk.length() == 0 || age >= reuse || stale;
+      if (fresh && !factorize())
+        return false;
+      dk = (-1) * invhk * gk;
 
-  return xk;
-}
+      // Com uma inversa velha, a direção pode não ser de descida: recalcula.
+      if (!fresh && (gk.t() * dk).x() >= 0) {
+        if (!factorize())
+          return false;
+        dk = (-1) * invhk * gk;
+      }
+      ++age;
+      return true;
+    }
 
-/// Método de quasi-newton com atualização de posto 2
-Matrix quasinewton_method(
-    std::function<double(Matrix)> f,
-    std::function<Matrix(Matrix)> gradf,
-    Matrix x0,
-    Matrix B0,
-    double epsilon
-    )
-{
-  std::cout << "INFO: quasinewton_method run" << std::endl;
-  std::cout << "\t" << "with initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-
-  Timer timer;
-  Matrix xk = x0;
-  Matrix Bk = B0;
-  unsigned iter = 0;
-  unsigned n_call_armijo = 0;
-
-  while(true) {
-    ++iter;
-    std::cout << "-------------------------------------------------------------------" << std::endl;
-    std::cout << "Beginning iteration #" << iter << " of the quasi-newton method:" << std::endl;
-
-    // Critério de parada.
-    if ((gradf(xk)).mod() < epsilon)
-      break;
-
-    Matrix dk = (-1.0) * Bk * (gradf)(xk);
-
-    double ak = armijo_call(1.0, 0.5, 0.1, f, gradf, xk, dk);
-    ++n_call_armijo;
-
-    if ((ak * dk).mod() < 1e-15) {
-      throw std::invalid_argument("WARNING: ak * dk too small. Stopping here, otherwise this would be an infinite loop.");
+    void moved(const Matrix& xprev, const Matrix& gprev) {
+      stale = reuse > 1 && gk.mod() > ratio * gprev.mod();
     }
 
-    Matrix sk = (-1) * xk;
-    Matrix yk = (-1) * (gradf)(xk);
+    double steplength() {
+      return pure ? 1.0 : Method::steplength();
+    }
 
-    // Atualização do xk.
-    xk = xk + ak * dk;
+    /// Calcula e inverte a hessiana em xk.
+    bool factorize() {
+      ++n_hessians;
+      age = 0;
+      if (!inv2(hessf(xk), invhk)) {
+        logger() << "WARNING: Determinant is zero: the hessian doesn't have a inverse." << std::endl;
+        finish(SINGULAR_HESSIAN);
+        return false;
+      }
+      return true;
+    }
 
-    sk = xk + sk;
-    yk = (gradf)(xk) + yk;
+    std::function<Matrix(Matrix)> hessf;
+    bool pure;
+    unsigned reuse;
+    double ratio;
+    Matrix invhk;
+    unsigned age;             // iterações desde o último cálculo da inversa
+    bool stale;               // o progresso piorou: recalcular
+    unsigned n_hessians;
+};
 
-    // Atualiazação de posto 2 (BFGS)
-    Matrix parcela1 = (Bk * sk * sk.t() * Bk) / ((sk.t() * Bk * sk).x());
-    Matrix parcela2 = (yk * yk.t()) / (yk.t() * sk).x();
-    Bk = Bk + (parcela2 - parcela1);
+/// Método de quasi-newton com atualização de posto 2, passo a passo.
+class QuasiNewtonMethod : public Method {
+  public:
+    QuasiNewtonMethod(
+        std::function<double(Matrix)> f,
+        std::function<Matrix(Matrix)> gradf,
+        Matrix x0,
+        Matrix B0,
+        double epsilon,
+        const Budget& budget = Budget()
+        ) : Method(f, gradf, x0, epsilon, budget), Bk(B0) {}
+
+    const char* name() const { return "quasi-newton"; }
+
+  protected:
+    bool compute_direction() {
+      dk = (-1.0) * Bk * gk;
+      return true;
+    }
 
-    std::cout << "iter = " << iter << "\tINFO: quasi-newton_method" << std::endl;
-    std::cout << "\t\t" << "dk: " << "(" << dk.x1() << ", " << dk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "Bk: " << "[" << Bk.get(1,1) << ", " << Bk.get(1,2) << "; " << Bk.get(2,1) << ", " << Bk.get(2,2) << "]" << std::endl;
-    std::cout << "\t\t" << "xk: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-    std::cout << "\t\t" << "f(xk): " << f(xk) << std::endl;
-  }
+    void moved(const Matrix& xprev, const Matrix& gprev) {
+      Matrix sk = xk - xprev;
+      Matrix yk = gk - gprev;
+
+      // Atualiazação de posto 2 (BFGS)
+      Matrix parcela1 = (Bk * sk * sk.t() * Bk) / ((sk.t() * Bk * sk).x());
+      Matrix parcela2 = (yk * yk.t()) / (yk.t() * sk).x();
+      Bk = Bk + (parcela2 - parcela1);
+    }
+
+    void log_iteration() const {
+      Method::log_iteration();
+      logger() << "\t\t" << "Bk: " << Bk << std::endl;
+    }
+
+    Matrix Bk;
+};
+
+/// Executa um método até o fim, com os relatórios de início e fim.
+SolveResult run_method(Method& method);
 
-  std::cout << "Information about this Quasi-Newton method run:" << std::endl;
-  std::cout << "\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
-  std::cout << "\t" << "initial point: " << "(" << x0.x1() << ", " << x0.x2() << ")" << std::endl;
-  std::cout << "\t" << "epsilon: " << epsilon << std::endl;
-  std::cout << "\t" << "n_iterations: " << iter + 1 << std::endl;
-  std::cout << "\t" << "n_call_armijo: " << n_call_armijo << std::endl;
-  std::cout << "\t" << "optimal point: " << "(" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-  std::cout << "\t" << "optimal value: " << f(xk) << std::endl;
+/// Método do gradiente
+SolveResult gradient_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget = Budget()
+    );
 
-  return xk;
-}
+/// Método de Newton
+SolveResult newton_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    std::function<Matrix(Matrix)> hessf,
+    Matrix x0,
+    double epsilon,
+    bool pure = false,    // false means to not use armijo
+    const Budget& budget = Budget()
+    );
+
+/// Método de quasi-newton com atualização de posto 2
+SolveResult quasinewton_method(
+    std::function<double(Matrix)> f,
+    std::function<Matrix(Matrix)> gradf,
+    Matrix x0,
+    Matrix B0,
+    double epsilon,
+    const Budget& budget = Budget()
+    );
 
 /// Função a, Função b ou Função c
 enum {FA, FB, FC};
@@ -703,177 +685,349 @@ enum {FA, FB, FC};
 /// Tipo de método: gradiente, newton ou quasi-newton
 enum {GRADIENT, NEWTON, NEWTONPURE, QUASINEWTON};
 
-/// Resolver um problema de otimização
-Matrix solve_it(
-    int function,       // resolver qual função?
-    Matrix x0sub,       // com que ponto inicial?
-    int limitx0,        // com que limites para gerar os pontos iniciais dos métodos?
-    double epsilonSub,  // epsilon do problema
-    double epsilonMeth, // epsilon dos métodos (gradiente, etc.)
-    int method          // resolver com qual método? (gradiente, etc.)
-    ) 
-{
-  std::cout << "INFO: solve_it run" << std::endl;
-  std::cout << "\t" << "with initial point: " << "(" << x0sub.x1() << ", " << x0sub.x2() << ")" << std::endl;
-
-  Timer timer;
-  Matrix xk = x0sub;
-  Matrix xnext;
-  unsigned iter = 0;
-
-  while(true) {
-    ++iter;
-
-    if (iter == MAX_ITERATIONS) {
-      std::cout << "Interrupting this solve_it run. Reason: too many iterations already: #iter = " << iter << std::endl;
-      break;
-    }
-
-    std::cout << "**************************************************************" << std::endl;
-    std::cout << "Beginning iteration #" << iter << " of solve_it:" << std::endl;
-
-    // Critério de parada 2.
-    bool terminate = false;
-    switch(function) {
-      case FA:
-        if (((*gradfa)(xk)).mod() < epsilonSub)
-          terminate = true;
-        break;
-      case FB:
-        if (((*gradfb)(xk)).mod() < epsilonSub)
-          terminate = true;
-        break;
-      case FC:
-        if (((*gradfc)(xk)).mod() < epsilonSub)
-          terminate = true;
-        break;
-    }
-    if (terminate) {
-      std::cout << "Finished solve_it. Reason: |gradf(xk)| near to zero, with xk = (" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-      xnext = xk;
-      break;
+/**
+ * Portfolio: vários métodos disputam o mesmo problema, cada um em uma thread.
+ * O primeiro que converge vence e cancela os outros (um CancelToken
+ * compartilhado, verificado entre as iterações de cada um). Se nenhum converge,
+ * fica o resultado de menor f.
+ *
+ * Um único step() roda a disputa inteira, com os métodos em silêncio
+ * (silence_logger). As avaliações de f de todos os métodos entram na conta;
+ * portfolio_method divide o limite de avaliações entre eles.
+ */
+class PortfolioMethod : public Method {
+  public:
+    /// Toma posse dos métodos; kinds[i] é o tipo (GRADIENT, ...) de members[i].
+    PortfolioMethod(
+        std::function<double(Matrix)> f,
+        std::function<Matrix(Matrix)> gradf,
+        Matrix x0,
+        double epsilon,
+        const std::vector<Method*>& members,
+        const std::vector<int>& kinds,
+        const Budget& budget = Budget()
+        ) : Method(f, gradf, x0, epsilon, budget), kinds(kinds), won(-1) {
+      for (size_t i = 0; i < members.size(); ++i)
+        this->members.push_back(std::unique_ptr<Method>(members[i]));
     }
 
-    // Inicialização do problema de otimização, com números aleatórios
-    Matrix x0(2,1);
-    x0.set(1, rand_double(limitx0));
-    x0.set(2, rand_double(limitx0));
-
-    // Atualizando o valor do lambdak (=1.0/k)
-    double lambdak = 1.0/iter;
-
-    // Resolver um problema de otimização (método do gradiente)
-    if (method == GRADIENT) {
-      switch(function) {
-        case FA:
-          xnext = gradient_method(
-              [lambdak,xk](Matrix x) -> double { return g(fa, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfa, lambdak, x, xk); },
-              x0,
-              epsilonMeth
-              );
-          break;
-        case FB:
-          xnext = gradient_method(
-              [lambdak,xk](Matrix x) -> double { return g(fb, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfb, lambdak, x, xk); },
-              x0,
-              epsilonMeth
-              );
-          break;
-        case FC:
-          xnext = gradient_method(
-              [lambdak,xk](Matrix x) -> double { return g(fc, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfc, lambdak, x, xk); },
-              x0,
-              epsilonMeth
-              );
-          break;
+    const char* name() const { return "portfolio"; }
+
+    bool step() {
+      if (finished)
+        return false;
+
+      CancelToken race;
+      std::atomic<int> first(-1);
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < members.size(); ++i) {
+        threads.push_back(std::thread([this, i, &race, &first]() {
+          silence_logger();
+          Method& m = *members[i];
+          while (m.step()) {
+            if (race.cancelled()) {
+              m.cancel();
+              break;
+            }
+          }
+          int none = -1;
+          if (m.result().converged() && first.compare_exchange_strong(none, (int) i))
+            race.cancel();
+        }));
       }
-    }
-
-    // Resolver um problema de otimização (método de Newton)
-    else if (method == NEWTON || method == NEWTONPURE) {
-      switch(function) {
-        case FA:
-          xnext = newton_method(
-              [lambdak,xk](Matrix x) -> double { return g(fa, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfa, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return invhessg(hessfa, lambdak, x, xk); },
-              x0,
-              epsilonMeth,
-              method == NEWTONPURE ? true : false
-              );
-          break;
-        case FB:
-          throw std::invalid_argument("ERROR: invhessb is not implemented");
-          break;
-        case FC:
-          throw std::invalid_argument("ERROR: invhessc is not implemented");
-          break;
+      for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+      // Ninguém convergiu: o de menor f.
+      int w = first.load();
+      if (w < 0) {
+        w = 0;
+        for (size_t i = 1; i < members.size(); ++i)
+          if (members[i]->result().fx < members[w]->result().fx)
+            w = i;
       }
+      for (size_t i = 0; i < members.size(); ++i)
+        tracker.add_evaluations(members[i]->result().n_evaluations);
+
+      SolveResult r = members[w]->result();
+      won = first.load() < 0 ? -1 : kinds[w];
+      best = r;
+      xk = r.x;
+      fxk = r.fx;
+      iter = r.iterations;
+      n_call_armijo = r.n_call_armijo;
+      evaluated = true;
+      logger() << "INFO: portfolio: " << members[w]->name() << "_method "
+        << (won >= 0 ? "won" : "is the best of the unconverged methods") << std::endl;
+      finish(r.reason);
+      return true;
     }
 
-    else if (method == QUASINEWTON) {
-      switch(function) {
-        case FA:
-          xnext = quasinewton_method(
-              [lambdak,xk](Matrix x) -> double { return g(fa, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfa, lambdak, x, xk); },
-              x0,
-              eye(2),
-              epsilonMeth
-              );
-          break;
-        case FB:
-          xnext = quasinewton_method(
-              [lambdak,xk](Matrix x) -> double { return g(fb, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfb, lambdak, x, xk); },
-              x0,
-              eye(2),
-              epsilonMeth
-              );
-          break;
-        case FC:
-          xnext = quasinewton_method(
-              [lambdak,xk](Matrix x) -> double { return g(fc, lambdak, x, xk); },
-              [lambdak,xk](Matrix x) -> Matrix { return gradg(gradfc, lambdak, x, xk); },
-              x0,
-              eye(2),
-              epsilonMeth
-              );
-          break;
-      }
-    }
+    /// Tipo do método que convergiu primeiro; -1 se nenhum convergiu (ou antes do fim).
+    int winner() const { return won; }
 
-    // Critério de parada 1.
-    if ((xnext - xk).mod() < epsilonSub) {
-      std::cout << "Finished solve_it. Reason: xnext is near to xk, they are equal to (" << xk.x1() << ", " << xk.x2() << ")" << std::endl;
-      break;
-    }
+  protected:
+    bool compute_direction() { return false; }
 
-    xk = xnext;
-  }
+    std::vector<std::unique_ptr<Method>> members;
+    std::vector<int> kinds;
+    int won;
+};
 
-  std::cout << "Information about this solve_it run:" << std::endl;
-  std::cout << "\t" << "elapsed time: " << timer.elapsed() << "s" << std::endl;
-  std::cout << "\t" << "initial point: " << "(" << x0sub.x1() << ", " << x0sub.x2() << ")" << std::endl;
-  std::cout << "\t" << "epsilon: " << epsilonSub << std::endl;
-  std::cout << "\t" << "n_iterations: " << iter << std::endl;
-  std::cout << "\t" << "optimal point: " << "(" << xnext.x1() << ", " << xnext.x2() << ")" << std::endl;
-
-  switch(function) {
-    case FA:
-      std::cout << "\t" << "optimal value: " << (*fa)(xnext) << std::endl;
-      break;
-    case FB:
-      std::cout << "\t" << "optimal value: " << (*fb)(xnext) << std::endl;
-      break;
-    case FC:
-      std::cout << "\t" << "optimal value: " << (*fc)(xnext) << std::endl;
-      break;
-  }
-  return xnext;
-}
+/**
+ * Funções registradas em tempo de execução (plugins, plugin.hpp), com os
+ * índices FIRST_USER_FUNCTION, FIRST_USER_FUNCTION + 1, ... Valem em
+ * objective(), gradient() e hessian() como FA, FB e FC; solve_it e o
+ * BatchSolver só aceitam as de duas variáveis. Registre antes de criar as
+ * threads que as usam.
+ */
+#define FIRST_USER_FUNCTION 16
+
+struct UserFunction {
+  std::string name;
+  unsigned dimension;
+  std::function<double(Matrix)> f;
+  std::function<Matrix(Matrix)> gradf;    // vazia: diferenças centrais de f
+  std::function<Matrix(Matrix)> hessf;    // vazia: diferenças centrais do gradiente
+  int band;                               // hessf por diferenças: H(i, j) = 0 se |i - j| > band; -1: cheia
+  bool numeric_gradient, numeric_hessian; // gradf, hessf por diferenças finitas (register_function)
+  // f (e o gradiente) em count pontos de uma vez, com x[i][k] a coordenada i do
+  // ponto k e g[i][k] a derivada em relação a x(i + 1), para o BatchSolver.
+  // Vazias: f e gradf ponto a ponto.
+  std::function<void(const double* const* x, size_t count, double* f)> values;
+  std::function<void(const double* const* x, size_t count, double* f, double* const* g)> gradients;
+
+  UserFunction() : dimension(0), band(-1), numeric_gradient(false), numeric_hessian(false) {}
+};
+
+extern std::vector<UserFunction> USER_FUNCTIONS;
+
+/**
+ * Registra fn e retorna o índice dela; um nome já registrado é substituído.
+ * Sem gradf ou hessf, a função recebe as de diferenças finitas (finitediff.hpp).
+ */
+int register_function(const UserFunction& fn);
+
+/// A função registrada com o índice function, ou NULL.
+const UserFunction* user_function(int function);
+
+/// f (FA, FB, FC ou uma função registrada)
+std::function<double(Matrix)> objective(int function);
+
+/**
+ * Parâmetros de Armijo usados por cada (função, método) em subproblem_method
+ * e no BatchSolver. Começam com os padrões; um perfil gerado pelo autotuner
+ * (tune.hpp) pode substituí-los.
+ */
+extern ArmijoParams ARMIJO_PROFILE[3][4];
+
+ArmijoParams armijo_params(int function, int method);
+
+/// gradiente de f (FA, FB, FC ou uma função registrada)
+std::function<Matrix(Matrix)> gradient(int function);
+
+/// true se a hessiana de f existe (FA e as funções registradas com hessiana).
+bool has_hessian(int function);
+
+/// hessiana de f; lança std::invalid_argument se não existe.
+std::function<Matrix(Matrix)> hessian(int function);
+
+/**
+ * Cria o método `method` para o subproblema g = f + (lambdak / 2) d(., xk)
+ * da função `function`, a partir de x0.
+ */
+Method* subproblem_method(
+    int function,
+    int method,
+    double lambdak,
+    Matrix xk,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget = Budget()
+    );
+
+/**
+ * Como subproblem_method, mas com um PortfolioMethod que põe os métodos
+ * `methods` para disputar. Cada método recebe uma parte igual de
+ * budget.max_evaluations, para que a disputa toda caiba no budget.
+ */
+Method* portfolio_method(
+    int function,
+    const std::vector<int>& methods,
+    double lambdak,
+    Matrix xk,
+    Matrix x0,
+    double epsilon,
+    const Budget& budget = Budget()
+    );
+
+/**
+ * Aceleração de Anderson (tipo II) de uma iteração de ponto fixo x <- G(x).
+ * Guarda as últimas `memory` diferenças de G(x) e do resíduo r = G(x) - x e
+ * propõe G(x) - dG gamma, com gamma o mínimo de |r - dR gamma| (mínimos
+ * quadrados com uma regularização pequena, para memória maior que a dimensão).
+ * Quem usa decide se aceita a proposta; se não aceitar, chama restart().
+ */
+class Anderson {
+  public:
+    explicit Anderson(unsigned memory = 0) : memory(memory) {}
+
+    /// Próximo iterado a partir de x e gx = G(x). Sem histórico (ou memory = 0), é gx.
+    Matrix next(const Matrix& x, const Matrix& gx);
+
+    /// Esquece o histórico (mas não o último par x, G(x)).
+    void restart() { dg.clear(); dr.clear(); }
+
+    unsigned size() const { return dg.size(); }
+
+  private:
+    unsigned memory;
+    std::deque<Matrix> dg, dr;
+    Matrix last_g, last_r;
+};
+
+/**
+ * Estado de um SolveIt entre iterações externas, para salvar e retomar a execução
+ * (ver checkpoint.hpp). O subproblema em andamento não entra: a retomada refaz a
+ * iteração externa desde o início. Sem setSeed, a retomada sorteia outro ponto
+ * inicial para o subproblema, já que o estado de rand() não é salvo.
+ */
+struct SolveItState {
+  int32_t function, method, limitx0;
+  uint32_t iter;              // iterações externas completas
+  double epsilonSub, epsilonMeth;
+  double x0sub1, x0sub2;
+  double xk1, xk2;
+  uint32_t finished, reason;
+  uint32_t seeded, rng_state;
+  uint64_t evaluations;       // avaliações de f das iterações completas
+};
+
+/**
+ * solve_it passo a passo.
+ * Cada step() faz uma iteração do método do subproblema atual; quando ele
+ * termina, o step() seguinte fecha a iteração externa e começa a próxima.
+ */
+class SolveIt {
+  public:
+    SolveIt(
+        int function,       // resolver qual função?
+        Matrix x0sub,       // com que ponto inicial?
+        int limitx0,        // com que limites para gerar os pontos iniciais dos métodos?
+        double epsilonSub,  // epsilon do problema
+        double epsilonMeth, // epsilon dos métodos (gradiente, etc.)
+        int method,         // resolver com qual método? (gradiente, etc.)
+        const Budget& budget = Budget()  // avaliações/tempo valem para a execução toda; max_iterations, para cada método
+        );
+
+    /**
+     * Retoma uma execução salva com checkpoint(). O limite de tempo recomeça do
+     * zero. Lança std::runtime_error se a função, o método, o motivo de parada
+     * ou o limite do estado são inválidos (um checkpoint corrompido).
+     */
+    explicit SolveIt(const SolveItState& state, const Budget& budget = Budget());
+
+    /// Faz uma iteração. Retorna false se já tinha terminado.
+    bool step();
+
+    /// Executa até o fim.
+    SolveResult run();
+
+    /// Interrompe a execução (motivo CANCELLED).
+    void cancel();
+
+    /// Gera os pontos iniciais dos métodos com rand_r a partir de seed, em vez de rand().
+    void setSeed(unsigned seed);
+
+    /**
+     * Resolve cada subproblema com um portfolio (PortfolioMethod) dos métodos
+     * dados, em vez de só com method. Vazio volta ao método único. Não entra
+     * no checkpoint(): quem retoma a execução chama setPortfolio de novo.
+     */
+    void setPortfolio(const std::vector<int>& methods);
+
+    /**
+     * Acelera a sequência externa xk <- prox(xk) com Anderson de memória memory
+     * (0 desliga). A proposta só é aceita se f nela não for maior que f(prox(xk));
+     * senão, o passo é o normal e o histórico recomeça. O critério de parada 1
+     * continua sendo |prox(xk) - xk| < epsilonSub. O histórico não entra no checkpoint().
+     */
+    void setAnderson(unsigned memory) { anderson = Anderson(memory); }
+
+    /**
+     * Com NEWTON ou NEWTONPURE, reusa a inversa da hessiana por até every
+     * iterações (NewtonMethod::setHessianReuse) e, com every > 1, passa a
+     * última inversa de cada subproblema para o seguinte. 0 desliga.
+     */
+    void setHessianReuse(unsigned every) { hessian_reuse = every; }
+
+    /// Hessianas calculadas pelos métodos de newton dos subproblemas já terminados.
+    unsigned hessians() const { return n_hessians; }
+
+    /// Propostas de Anderson aceitas e rejeitadas.
+    unsigned accelerated() const { return n_accelerated; }
+    unsigned rejected() const { return n_rejected; }
+
+    /// Quantas vezes cada tipo de método (GRADIENT, ...) venceu o portfolio.
+    unsigned wins(int method) const { return method >= GRADIENT && method <= QUASINEWTON ? n_wins[method] : 0; }
+
+    bool done() const { return finished; }
+    const Matrix& current() const { return xk; }        // iterado externo atual
+    unsigned iteration() const { return iter; }         // iteração externa atual
+    const Method* inner() const { return sub.get(); }   // método do subproblema, NULL entre iterações
+
+    /// Resultado da execução (o iterado externo atual; o motivo só vale depois do fim).
+    SolveResult result() const;
+
+    /// Estado para retomar a execução a partir da última iteração externa completa.
+    SolveItState checkpoint() const;
+
+    /// Imprime o resumo da execução.
+    void report() const;
+
+  private:
+    /// Critérios de parada no início de uma iteração externa; cria o método do subproblema.
+    void begin_iteration();
+
+    /// Fecha a iteração externa depois que o método do subproblema terminou.
+    void end_iteration();
+
+    void finish(Termination reason);
+
+    int function;
+    Matrix x0sub;
+    int limitx0;
+    double epsilonSub, epsilonMeth;
+    int method;
+    BudgetTracker tracker;
+    Timer timer;
+
+    Matrix xk;
+    unsigned iter;
+    bool finished;
+    Termination reason;
+    std::unique_ptr<Method> sub;
+    bool seeded;
+    unsigned rng_state;     // estado do rand_r, se seeded
+    unsigned rng_iteration; // rng_state no início da iteração externa atual
+    std::vector<int> portfolio;
+    unsigned n_wins[4];
+    Anderson anderson;
+    unsigned n_accelerated, n_rejected;
+    unsigned hessian_reuse;
+    Matrix last_inverse;    // inversa da hessiana do último subproblema, com hessian_reuse
+    unsigned n_hessians;
+};
+
+/// Resolver um problema de otimização
+SolveResult solve_it(
+    int function,       // resolver qual função?
+    Matrix x0sub,       // com que ponto inicial?
+    int limitx0,        // com que limites para gerar os pontos iniciais dos métodos?
+    double epsilonSub,  // epsilon do problema
+    double epsilonMeth, // epsilon dos métodos (gradiente, etc.)
+    int method,         // resolver com qual método? (gradiente, etc.)
+    const Budget& budget = Budget()  // avaliações/tempo valem para a execução toda; max_iterations, para cada método
+    );
 
 #endif // _LIB_HPP_
@@ -0,0 +1,142 @@
+/**
+ * loadgen: gerador de carga para o solverd.
+ *
+ * Envia n jobs com pontos iniciais aleatórios, mantendo no máximo c em voo,
+ * e mede a vazão e a latência (do envio até a resposta) de cada job.
+ *
+ * Uso: loadgen [-s socket] [-n jobs] [-c concorrência] [-k solve|min]
+ *              [-f função] [-m método] [-l limite] [-r semente]
+ */
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <getopt.h>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "jobs.hpp"
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv) {
+  string path = "/tmp/solverd.sock";
+  unsigned n = 10000;
+  unsigned concurrency = 256;
+  string kind = "solve";
+  string function = "FA";
+  string method = "GRADIENT";
+  int limit = 4;
+  unsigned seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:c:k:f:m:l:r:")) != -1) {
+    switch (opt) {
+      case 's': path = optarg; break;
+      case 'n': n = atoi(optarg); break;
+      case 'c': concurrency = std::max(1, atoi(optarg)); break;
+      case 'k': kind = optarg; break;
+      case 'f': function = optarg; break;
+      case 'm': method = optarg; break;
+      case 'l': limit = std::max(1, atoi(optarg)); break;
+      case 'r': seed = atoi(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-s socket] [-n jobs] [-c concurrency] [-k solve|min]"
+          " [-f function] [-m method] [-l limit] [-r seed]" << std::endl;
+        return 2;
+    }
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  if (fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) < 0) {
+    std::cerr << "ERROR: can't connect to " << path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  vector<Clock::time_point> sent(n);
+  vector<double> latency;
+  latency.reserve(n);
+  std::map<string, unsigned> statuses;
+  std::mutex mutex;
+  std::condition_variable window;
+  unsigned in_flight = 0;
+
+  Clock::time_point start = Clock::now();
+
+  // Envia os jobs respeitando a janela de concorrência.
+  std::thread sender([&]() {
+    unsigned state = seed;
+    for (unsigned i = 0; i < n; ++i) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        window.wait(lock, [&]() { return in_flight < concurrency; });
+        ++in_flight;
+        sent[i] = Clock::now();
+      }
+      std::ostringstream line;
+      line << "id=" << i << " kind=" << kind << " function=" << function << " method=" << method
+        << " x1=" << rand_double(limit, &state) + (rand_r(&state) % 1000) / 1000.0
+        << " x2=" << rand_double(limit, &state) + (rand_r(&state) % 1000) / 1000.0
+        << " limit=" << limit << " seed=" << rand_r(&state) << " eps_meth=" << (kind == "min" ? 1e-6 : 1e-1)
+        << "\n";
+      string data = line.str();
+      if (send(fd, data.data(), data.size(), MSG_NOSIGNAL) != (ssize_t) data.size()) {
+        std::cerr << "ERROR: send failed" << std::endl;
+        break;
+      }
+    }
+  });
+
+  // Lê as respostas.
+  string buffer;
+  char chunk[4096];
+  unsigned received = 0;
+  while (received < n) {
+    ssize_t r = recv(fd, chunk, sizeof(chunk), 0);
+    if (r <= 0) {
+      std::cerr << "ERROR: connection closed after " << received << " responses" << std::endl;
+      break;
+    }
+    buffer.append(chunk, r);
+    size_t end;
+    while ((end = buffer.find('\n')) != string::npos) {
+      std::map<string, string> fields;
+      string error;
+      parse_fields(buffer.substr(0, end), fields, error);
+      buffer.erase(0, end + 1);
+      unsigned id = atoi(fields["id"].c_str());
+      Clock::time_point now = Clock::now();
+      std::lock_guard<std::mutex> lock(mutex);
+      if (id < n)
+        latency.push_back(std::chrono::duration<double>(now - sent[id]).count());
+      ++statuses[fields["status"]];
+      --in_flight;
+      ++received;
+      window.notify_one();
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  sender.join();
+  close(fd);
+
+  std::sort(latency.begin(), latency.end());
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "jobs: " << received << " in " << seconds << "s" << std::endl;
+  std::cout << "throughput: " << received / seconds << " jobs/s" << std::endl;
+  if (!latency.empty()) {
+    std::cout << "latency (ms): p50=" << 1e3 * latency[latency.size() / 2]
+      << " p90=" << 1e3 * latency[latency.size() * 9 / 10]
+      << " p99=" << 1e3 * latency[latency.size() * 99 / 100]
+      << " max=" << 1e3 * latency.back() << std::endl;
+  }
+  for (std::map<string, unsigned>::const_iterator it = statuses.begin(); it != statuses.end(); ++it)
+    std::cout << "status " << it->first << ": " << it->second << std::endl;
+  return received == n ? 0 : 1;
+}
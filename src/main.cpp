@@ -37,7 +37,7 @@ int main(int argc, char **argv) {
       1e-7,
       1e-2,
       NEWTON
-      );
+      ).x;
   */
    
 
@@ -50,7 +50,7 @@ int main(int argc, char **argv) {
       1e-7,
       1e-2,
       NEWTONPURE
-      );
+      ).x;
    */
 
 
@@ -63,7 +63,7 @@ int main(int argc, char **argv) {
       1e-7,
       1e-2,
       GRADIENT
-      );
+      ).x;
    */
 
   // Exemplo com o método de Quasi Newton (BFGS)
@@ -75,7 +75,7 @@ int main(int argc, char **argv) {
       1e-7,
       1e-1,
       QUASINEWTON
-      );
+      ).x;
 
   std::cout << "Error #1: " << (ans - Matrix(vector<double>{0.0,1.0})).mod() << std::endl;
   std::cout << "Error #2: " << fa(ans) - fa(Matrix(vector<double>{0.0,1.0})) << std::endl;
@@ -0,0 +1,369 @@
+#ifndef _MULTISTART_HPP_
+#define _MULTISTART_HPP_
+
+#include <memory>
+#include "vecmath.hpp"
+
+/**
+ * Multi-start em lote: BATCH_LANES pontos iniciais independentes rodam o método
+ * do gradiente, o de newton (com Armijo ou puro, só para FA) ou o quasi-newton
+ * em passo único (lockstep), com o estado guardado como estrutura de arrays
+ * (x1[], x2[], B11[], ...), sem alocações durante a resolução. As avaliações de
+ * f e do gradiente usam os kernels vetoriais de vecmath.hpp; as de uma função
+ * registrada (plugin.hpp) são uma chamada de values/gradients para as lanes todas.
+ *
+ * Quando uma lane termina, ela recebe o próximo ponto da fila de pontos
+ * iniciais, de modo que o lote fica cheio até a fila acabar.
+ */
+
+// Número de pontos iniciais resolvidos ao mesmo tempo.
+#define BATCH_LANES (2 * VEC_WIDTH)
+
+/// Resultado de um ponto inicial do multi-start.
+struct StartResult {
+  double x1, x2;        // ponto final
+  double f;             // valor da função objetivo no ponto final
+  unsigned iterations;  // número de iterações do método
+  unsigned evaluations; // número de avaliações de f
+  Termination reason;   // motivo de parada
+
+  bool converged() const { return reason == CONVERGED; }
+};
+
+class BatchSolver {
+  public:
+    /**
+     * Resolve min f (lambdak = 0) ou o subproblema
+     * g = f + (lambdak / 2) d(., xkk), com f = FA, FB, FC ou uma função
+     * registrada de duas variáveis.
+     * method: GRADIENT, QUASINEWTON, ou NEWTON e NEWTONPURE (só com FA).
+     */
+    BatchSolver(int function, int method, double epsilon,
+        double lambdak = 0.0, double xkk1 = 0.0, double xkk2 = 0.0);
+
+    /**
+     * Limites: iterações e avaliações valem para cada ponto inicial; tempo e
+     * cancelamento, para o lote todo (os pontos que faltam terminam com o mesmo motivo).
+     * Sem limite de iterações, cada ponto para após 10000 iterações.
+     */
+    void setBudget(const Budget& budget);
+
+    /// Parâmetros da busca de Armijo; o padrão é armijo_params(function, method).
+    void setArmijo(const ArmijoParams& params) { armijo = params; }
+
+    /// Resolve a partir de cada ponto (x01[i], x02[i]).
+    vector<StartResult> solve(const vector<double>& x01, const vector<double>& x02);
+
+    /// O mesmo, sem cópias: lê n pontos de x01/x02 e escreve em results[0..n).
+    void solve(const double* x01, const double* x02, size_t n, StartResult* results);
+
+  private:
+    /// Avalia a função objetivo (e o gradiente e, no newton, a hessiana, se g1 != NULL) em todas as lanes.
+    void evaluate(const double* x1, const double* x2, double* fx, double* g1, double* g2);
+
+    /// Termina a lane e coloca nela o próximo ponto da fila.
+    void finish(unsigned lane, Termination reason);
+
+    /// Coloca na lane o próximo ponto da fila, se houver.
+    void refill(unsigned lane);
+
+    int function, method;
+    std::shared_ptr<const UserFunction> user;    // a função registrada, ou vazio
+    double epsilon, lambdak, xkk1, xkk2;
+    Budget budget;
+    ArmijoParams armijo;
+
+    // Fila de pontos iniciais.
+    const double* x01;
+    const double* x02;
+    size_t count;
+    size_t next;
+    StartResult* results;
+
+    // Estado das lanes.
+    long job[BATCH_LANES];        // índice do ponto inicial, -1 se vazia
+    bool fresh[BATCH_LANES];      // acabou de receber um ponto inicial
+    unsigned iter[BATCH_LANES];
+    unsigned evals[BATCH_LANES];  // avaliações de f
+    double x1[BATCH_LANES], x2[BATCH_LANES];
+    double fx[BATCH_LANES], g1[BATCH_LANES], g2[BATCH_LANES];
+    double xp1[BATCH_LANES], xp2[BATCH_LANES];     // x anterior
+    double gp1[BATCH_LANES], gp2[BATCH_LANES];     // gradiente anterior
+    double B11[BATCH_LANES], B12[BATCH_LANES], B22[BATCH_LANES];
+    double H11[BATCH_LANES], H12[BATCH_LANES], H22[BATCH_LANES];   // hessiana (newton)
+};
+
+inline BatchSolver::BatchSolver(int function, int method, double epsilon,
+    double lambdak, double xkk1, double xkk2) :
+  function(function),
+  method(method),
+  epsilon(epsilon),
+  lambdak(lambdak),
+  xkk1(xkk1),
+  xkk2(xkk2),
+  armijo(armijo_params(function, method)),
+  x01(NULL),
+  x02(NULL),
+  count(0),
+  next(0),
+  results(NULL) {
+  if (method != GRADIENT && method != QUASINEWTON && method != NEWTON && method != NEWTONPURE)
+    throw std::invalid_argument("ERROR: Unknown method");
+  if (const UserFunction* fn = user_function(function)) {
+    if (fn->dimension != 2)
+      throw std::invalid_argument("ERROR: BatchSolver supports only functions of two variables");
+    user = std::make_shared<const UserFunction>(*fn);
+  }
+  else if (function != FA && function != FB && function != FC)
+    throw std::invalid_argument("ERROR: BatchSolver supports only FA, FB, FC and registered functions");
+  if ((method == NEWTON || method == NEWTONPURE) && function != FA)
+    throw std::invalid_argument("ERROR: BatchSolver supports NEWTON only for FA");
+  budget.max_iterations = 10000;
+}
+
+inline void BatchSolver::setBudget(const Budget& budget) {
+  this->budget = budget;
+  if (this->budget.max_iterations == 0)
+    this->budget.max_iterations = 10000;
+}
+
+inline void BatchSolver::evaluate(const double* x1, const double* x2, double* fx, double* g1, double* g2) {
+  if (user) {
+    const double* x[] = {x1, x2};
+    double* g[] = {g1, g2};
+    if (g1 != NULL && user->gradients)
+      user->gradients(x, BATCH_LANES, fx, g);
+    else if (g1 == NULL && user->values)
+      user->values(x, BATCH_LANES, fx);
+    else
+      for (unsigned i = 0; i < BATCH_LANES; ++i) {
+        Matrix p(vector<double>{x1[i], x2[i]});
+        fx[i] = user->f(p);
+        if (g1 != NULL) {
+          Matrix d = user->gradf(p);
+          g1[i] = d.get(1);
+          g2[i] = d.get(2);
+        }
+      }
+    if (lambdak == 0.0)
+      return;
+    // O termo (lambdak / 2) d(., xkk) do subproblema.
+    for (unsigned i = 0; i < BATCH_LANES; i += VEC_WIDTH) {
+      vdouble a = vload(x1 + i), b = vload(x2 + i);
+      vstore(fx + i, vload(fx + i) + (lambdak / 2.0) * vd(a, b, xkk1, xkk2));
+      if (g1 != NULL) {
+        vdouble d1, d2;
+        vgradd(a, b, xkk1, xkk2, d1, d2);
+        vstore(g1 + i, vload(g1 + i) + (lambdak / 2.0) * d1);
+        vstore(g2 + i, vload(g2 + i) + (lambdak / 2.0) * d2);
+      }
+    }
+    return;
+  }
+  for (unsigned i = 0; i < BATCH_LANES; i += VEC_WIDTH) {
+    vdouble a = vload(x1 + i), b = vload(x2 + i);
+    vstore(fx + i, vg(function, lambdak, a, b, xkk1, xkk2));
+    if (g1 != NULL) {
+      vdouble d1, d2;
+      vgradg(function, lambdak, a, b, xkk1, xkk2, d1, d2);
+      vstore(g1 + i, d1);
+      vstore(g2 + i, d2);
+      if (method == NEWTON || method == NEWTONPURE) {
+        vdouble h11, h12, h22;
+        vhessg(lambdak, a, b, xkk1, xkk2, h11, h12, h22);
+        vstore(H11 + i, h11);
+        vstore(H12 + i, h12);
+        vstore(H22 + i, h22);
+      }
+    }
+  }
+}
+
+inline void BatchSolver::refill(unsigned lane) {
+  job[lane] = -1;
+  x1[lane] = x2[lane] = 0.0;
+  fx[lane] = NAN;   // ainda não avaliado
+  if (next >= count)
+    return;
+  job[lane] = next;
+  x1[lane] = x01[next];
+  x2[lane] = x02[next];
+  ++next;
+  fresh[lane] = true;
+  iter[lane] = 0;
+  evals[lane] = 0;
+  B11[lane] = 1.0;
+  B12[lane] = 0.0;
+  B22[lane] = 1.0;
+}
+
+inline void BatchSolver::finish(unsigned lane, Termination reason) {
+  StartResult& r = results[job[lane]];
+  r.x1 = x1[lane];
+  r.x2 = x2[lane];
+  r.f = fx[lane];
+  r.iterations = iter[lane];
+  r.evaluations = evals[lane];
+  r.reason = reason;
+  refill(lane);
+}
+
+inline vector<StartResult> BatchSolver::solve(const vector<double>& x01, const vector<double>& x02) {
+  if (x01.size() != x02.size())
+    throw std::invalid_argument("ERROR: BatchSolver::solve: x01 and x02 have different sizes");
+
+  vector<StartResult> results(x01.size());
+  solve(x01.data(), x02.data(), x01.size(), results.data());
+  return results;
+}
+
+inline void BatchSolver::solve(const double* x01, const double* x02, size_t n, StartResult* results) {
+  this->x01 = x01;
+  this->x02 = x02;
+  this->count = n;
+  this->results = results;
+  next = 0;
+  for (unsigned lane = 0; lane < BATCH_LANES; ++lane)
+    refill(lane);
+
+  double d1[BATCH_LANES], d2[BATCH_LANES];      // direção de descida
+  double slope[BATCH_LANES], t[BATCH_LANES];    // gradf(x)' d e passo de Armijo
+  bool stepping[BATCH_LANES], searching[BATCH_LANES];
+  double xt1[BATCH_LANES], xt2[BATCH_LANES], ft[BATCH_LANES];
+  BudgetTracker tracker(budget);
+  Termination stop;
+
+  while (true) {
+    bool any = false;
+    for (unsigned lane = 0; lane < BATCH_LANES; ++lane)
+      any = any || job[lane] >= 0;
+    if (!any)
+      break;
+
+    evaluate(x1, x2, fx, g1, g2);
+    for (unsigned lane = 0; lane < BATCH_LANES; ++lane)
+      ++evals[lane];
+
+    // Tempo ou cancelamento: todos os pontos que faltam param aqui.
+    if (tracker.exceeded(stop)) {
+      for (unsigned lane = 0; lane < BATCH_LANES; ++lane)
+        while (job[lane] >= 0)
+          finish(lane, stop);
+      break;
+    }
+
+    for (unsigned lane = 0; lane < BATCH_LANES; ++lane) {
+      stepping[lane] = searching[lane] = false;
+      if (job[lane] < 0)
+        continue;
+
+      // Atualização de posto 2, igual à de quasinewton_method.
+      if (method == QUASINEWTON && !fresh[lane]) {
+        double s1 = x1[lane] - xp1[lane], s2 = x2[lane] - xp2[lane];
+        double y1 = g1[lane] - gp1[lane], y2 = g2[lane] - gp2[lane];
+        double Bs1 = B11[lane] * s1 + B12[lane] * s2;
+        double Bs2 = B12[lane] * s1 + B22[lane] * s2;
+        double sBs = s1 * Bs1 + s2 * Bs2;
+        double ys = y1 * s1 + y2 * s2;
+        B11[lane] += y1 * y1 / ys - Bs1 * Bs1 / sBs;
+        B12[lane] += y1 * y2 / ys - Bs1 * Bs2 / sBs;
+        B22[lane] += y2 * y2 / ys - Bs2 * Bs2 / sBs;
+      }
+      fresh[lane] = false;
+
+      if (!std::isfinite(fx[lane]) || !std::isfinite(g1[lane]) || !std::isfinite(g2[lane])) {
+        finish(lane, NOT_FINITE);
+        continue;
+      }
+
+      // Critério de parada.
+      if (sqrt(g1[lane] * g1[lane] + g2[lane] * g2[lane]) < epsilon) {
+        finish(lane, CONVERGED);
+        continue;
+      }
+      if (iter[lane] >= budget.max_iterations) {
+        finish(lane, TOO_MANY_ITERATIONS);
+        continue;
+      }
+      if (budget.max_evaluations > 0 && evals[lane] >= budget.max_evaluations) {
+        finish(lane, TOO_MANY_EVALUATIONS);
+        continue;
+      }
+      ++iter[lane];
+
+      if (method == NEWTON || method == NEWTONPURE) {
+        double det = H11[lane] * H22[lane] - H12[lane] * H12[lane];
+        if (det == 0) {
+          finish(lane, SINGULAR_HESSIAN);
+          continue;
+        }
+        d1[lane] = -(H22[lane] * g1[lane] - H12[lane] * g2[lane]) / det;
+        d2[lane] = -(H11[lane] * g2[lane] - H12[lane] * g1[lane]) / det;
+      }
+      else {
+        d1[lane] = -(B11[lane] * g1[lane] + B12[lane] * g2[lane]);
+        d2[lane] = -(B12[lane] * g1[lane] + B22[lane] * g2[lane]);
+      }
+      if (!std::isfinite(d1[lane]) || !std::isfinite(d2[lane])) {
+        finish(lane, NOT_FINITE);
+        continue;
+      }
+      slope[lane] = g1[lane] * d1[lane] + g2[lane] * d2[lane];
+      t[lane] = method == NEWTONPURE ? 1.0 : armijo.s;
+      stepping[lane] = true;
+      // Newton puro: passo 1, sem busca.
+      searching[lane] = method != NEWTONPURE;
+      if (method == NEWTONPURE && sqrt(d1[lane] * d1[lane] + d2[lane] * d2[lane]) < EPSILON_ARMIJO_CALL) {
+        stepping[lane] = false;
+        finish(lane, STEP_TOO_SMALL);
+      }
+    }
+
+    // Regra de Armijo em todas as lanes ao mesmo tempo.
+    while (true) {
+      bool any_searching = false;
+      for (unsigned lane = 0; lane < BATCH_LANES; ++lane) {
+        any_searching = any_searching || searching[lane];
+        xt1[lane] = x1[lane] + (searching[lane] ? t[lane] * d1[lane] : 0.0);
+        xt2[lane] = x2[lane] + (searching[lane] ? t[lane] * d2[lane] : 0.0);
+      }
+      if (!any_searching)
+        break;
+
+      evaluate(xt1, xt2, ft, NULL, NULL);
+
+      for (unsigned lane = 0; lane < BATCH_LANES; ++lane) {
+        if (!searching[lane])
+          continue;
+        ++evals[lane];
+        if (fx[lane] - ft[lane] >= -armijo.sigma * t[lane] * slope[lane]) {
+          searching[lane] = false;
+          continue;
+        }
+        t[lane] *= armijo.beta;
+        // ak * dk muito pequeno: a lane para, sem convergir. hypot não estoura com
+        // |d| enorme (com inf, t * |d| viraria NaN quando t chega a 0 e a busca não pararia).
+        if (!(t[lane] * std::hypot(d1[lane], d2[lane]) >= EPSILON_ARMIJO_CALL)) {
+          searching[lane] = stepping[lane] = false;
+          finish(lane, STEP_TOO_SMALL);
+        }
+      }
+    }
+
+    // Atualização do xk.
+    for (unsigned lane = 0; lane < BATCH_LANES; ++lane) {
+      if (!stepping[lane])
+        continue;
+      xp1[lane] = x1[lane];
+      xp2[lane] = x2[lane];
+      gp1[lane] = g1[lane];
+      gp2[lane] = g2[lane];
+      x1[lane] += t[lane] * d1[lane];
+      x2[lane] += t[lane] * d2[lane];
+    }
+  }
+
+  this->results = NULL;
+}
+
+#endif // _MULTISTART_HPP_
@@ -0,0 +1,62 @@
+#ifndef _OTIM_PLUGIN_H_
+#define _OTIM_PLUGIN_H_
+
+/*
+ * Interface binária (C) dos plugins de funções objetivo. Um plugin é um .so
+ * que exporta a função OTIM_PLUGIN_ENTRY:
+ *
+ *    const otim_objective* otim_plugin_objectives(size_t* count);
+ *
+ * que retorna um vetor de *count objetivos, válido enquanto o .so estiver
+ * carregado. O otim carrega o .so com dlopen (opção -L), confere abi e
+ * registra cada objetivo pelo nome; depois, function=<nome> vale em qualquer
+ * lugar que aceita FA, FB ou FC.
+ *
+ * Pontos têm dimension coordenadas, x[0] é x1. As funções podem ser chamadas
+ * de várias threads ao mesmo tempo, sempre com o ponteiro data do objetivo.
+ *
+ * Mudanças incompatíveis nesta estrutura aumentam OTIM_PLUGIN_ABI; campos
+ * novos só entram no fim.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTIM_PLUGIN_ABI 1
+#define OTIM_PLUGIN_ENTRY "otim_plugin_objectives"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct otim_objective {
+  uint32_t abi;             /* OTIM_PLUGIN_ABI */
+  uint32_t dimension;
+  const char* name;         /* letras, dígitos e _; não pode ser FA, FB ou FC */
+  void* data;               /* passado de volta em cada chamada */
+
+  /* f(x). Obrigatória. */
+  double (*value)(void* data, const double* x);
+
+  /* g = grad f(x), dimension valores. NULL: diferenças finitas de value. */
+  void (*gradient)(void* data, const double* x, double* g);
+
+  /* h = hessiana de f em x, dimension x dimension, por linha. NULL: diferenças finitas do gradiente. */
+  void (*hessian)(void* data, const double* x, double* h);
+
+  /*
+   * Em lote: count pontos, x[i][k] é a coordenada i do ponto k; f[k] recebe
+   * f no ponto k e, em gradients, g[i][k] a derivada em relação a x(i + 1).
+   * NULL: o otim chama value/gradient ponto a ponto.
+   */
+  void (*values)(void* data, const double* const* x, size_t count, double* f);
+  void (*gradients)(void* data, const double* const* x, size_t count, double* f, double* const* g);
+} otim_objective;
+
+typedef const otim_objective* (*otim_plugin_entry)(size_t* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OTIM_PLUGIN_H_ */
@@ -0,0 +1,189 @@
+#ifndef _PLUGIN_HPP_
+#define _PLUGIN_HPP_
+
+#include <cctype>
+#include <dlfcn.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "lib.hpp"
+#include "otim_plugin.h"
+
+/**
+ * Carga de plugins de funções objetivo (a interface C está em otim_plugin.h).
+ *
+ * PluginObjective chama as funções do .so direto pelos ponteiros; os lotes vão
+ * inteiros para values/gradients do plugin, sem std::function no caminho.
+ * load_plugin() registra cada objetivo do .so (register_function), e daí em
+ * diante o nome vale como função em jobs, solve e run; o gradiente e a
+ * hessiana que o plugin não tiver saem de diferenças finitas. O BatchSolver (jobs
+ * kind=min) avalia as lanes dele com uma chamada a values/gradients. O .so fica carregado
+ * enquanto houver um PluginObjective (ou função registrada) dele.
+ */
+
+class PluginObjective {
+  public:
+    PluginObjective(const otim_objective* obj, std::shared_ptr<void> library) : obj(obj), library(library) {}
+
+    std::string name() const { return obj->name; }
+    unsigned dimension() const { return obj->dimension; }
+    bool hasGradient() const { return obj->gradient != NULL; }
+    bool hasHessian() const { return obj->hessian != NULL; }
+
+    double value(const Matrix& x) const {
+      std::vector<double> v = point(x);
+      return obj->value(obj->data, v.data());
+    }
+
+    Matrix gradient(const Matrix& x) const {
+      if (obj->gradient == NULL)
+        throw std::invalid_argument("ERROR: " + name() + " has no gradient");
+      std::vector<double> v = point(x), g(obj->dimension);
+      obj->gradient(obj->data, v.data(), g.data());
+      return Matrix(g);
+    }
+
+    Matrix hessian(const Matrix& x) const {
+      if (obj->hessian == NULL)
+        throw std::invalid_argument("ERROR: " + name() + " has no hessian");
+      const unsigned n = obj->dimension;
+      std::vector<double> v = point(x), h(n * n);
+      obj->hessian(obj->data, v.data(), h.data());
+      Matrix H(n, n);
+      for (unsigned i = 0; i < n; ++i)
+        for (unsigned j = 0; j < n; ++j)
+          H.set(i + 1, j + 1, h[i * n + j]);
+      return H;
+    }
+
+    /// f em count pontos (x[i][k]: coordenada i do ponto k).
+    void values(const double* const* x, size_t count, double* f) const {
+      if (obj->values != NULL) {
+        obj->values(obj->data, x, count, f);
+        return;
+      }
+      std::vector<double> v(obj->dimension);
+      for (size_t k = 0; k < count; ++k) {
+        for (unsigned i = 0; i < obj->dimension; ++i)
+          v[i] = x[i][k];
+        f[k] = obj->value(obj->data, v.data());
+      }
+    }
+
+    /// f e o gradiente em count pontos: g[i][k] é a derivada em relação a x(i + 1) no ponto k.
+    void gradients(const double* const* x, size_t count, double* f, double* const* g) const {
+      if (obj->gradients != NULL) {
+        obj->gradients(obj->data, x, count, f, g);
+        return;
+      }
+      if (obj->gradient == NULL)
+        throw std::invalid_argument("ERROR: " + name() + " has no gradient");
+      std::vector<double> v(obj->dimension), gk(obj->dimension);
+      for (size_t k = 0; k < count; ++k) {
+        for (unsigned i = 0; i < obj->dimension; ++i)
+          v[i] = x[i][k];
+        f[k] = obj->value(obj->data, v.data());
+        obj->gradient(obj->data, v.data(), gk.data());
+        for (unsigned i = 0; i < obj->dimension; ++i)
+          g[i][k] = gk[i];
+      }
+    }
+
+    std::function<double(Matrix)> f() const {
+      PluginObjective self(*this);
+      return [self](Matrix x) { return self.value(x); };
+    }
+    std::function<Matrix(Matrix)> gradf() const {
+      PluginObjective self(*this);
+      return [self](Matrix x) { return self.gradient(x); };
+    }
+    std::function<Matrix(Matrix)> hessf() const {
+      PluginObjective self(*this);
+      return [self](Matrix x) { return self.hessian(x); };
+    }
+
+    /// A função para register_function, que completa as derivadas que faltam por diferenças finitas.
+    UserFunction user() const {
+      UserFunction fn;
+      fn.name = name();
+      fn.dimension = dimension();
+      fn.f = f();
+      if (hasGradient())
+        fn.gradf = gradf();
+      if (hasHessian())
+        fn.hessf = hessf();
+      PluginObjective self(*this);
+      fn.values = [self](const double* const* x, size_t count, double* f) { self.values(x, count, f); };
+      if (hasGradient() || obj->gradients != NULL)
+        fn.gradients = [self](const double* const* x, size_t count, double* f, double* const* g) {
+          self.gradients(x, count, f, g);
+        };
+      return fn;
+    }
+
+  private:
+    std::vector<double> point(const Matrix& x) const {
+      if (x.length() != obj->dimension)
+        throw std::invalid_argument("ERROR: " + name() + " needs a point with " + std::to_string(obj->dimension) + " coordinates");
+      std::vector<double> v(obj->dimension);
+      for (unsigned i = 0; i < obj->dimension; ++i)
+        v[i] = x.get(i + 1);
+      return v;
+    }
+
+    const otim_objective* obj;
+    std::shared_ptr<void> library;
+};
+
+/// Nome válido para um objetivo de plugin: letras, dígitos e _, e nenhum de FA, FB e FC.
+inline bool valid_plugin_name(const char* name) {
+  if (name == NULL || *name == '\0')
+    return false;
+  for (const char* p = name; *p; ++p)
+    if (!isalnum((unsigned char) *p) && *p != '_')
+      return false;
+  std::string s = name;
+  return s != "FA" && s != "fa" && s != "FB" && s != "fb" && s != "FC" && s != "fc";
+}
+
+/**
+ * Carrega o plugin em path e retorna os objetivos dele. Lança std::runtime_error
+ * se o .so não carrega, não é um plugin, é de outra versão da interface ou
+ * tem um objetivo inválido.
+ */
+inline std::vector<PluginObjective> open_plugin(const std::string& path) {
+  void* p = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (p == NULL)
+    throw std::runtime_error("ERROR: can't load " + path + ": " + dlerror());
+  std::shared_ptr<void> library(p, dlclose);
+  otim_plugin_entry entry = (otim_plugin_entry) dlsym(p, OTIM_PLUGIN_ENTRY);
+  if (entry == NULL)
+    throw std::runtime_error("ERROR: " + path + " is not an otim plugin (no " OTIM_PLUGIN_ENTRY ")");
+
+  size_t count = 0;
+  const otim_objective* objs = entry(&count);
+  std::vector<PluginObjective> result;
+  for (size_t i = 0; i < count; ++i) {
+    const otim_objective& o = objs[i];
+    if (o.abi != OTIM_PLUGIN_ABI)
+      throw std::runtime_error("ERROR: " + path + " was built for plugin ABI " + std::to_string(o.abi) +
+          ", expected " + std::to_string(OTIM_PLUGIN_ABI));
+    if (!valid_plugin_name(o.name) || o.dimension == 0 || o.value == NULL)
+      throw std::runtime_error("ERROR: " + path + ": objective " + std::to_string(i) +
+          " needs a valid name, a dimension and a value");
+    result.push_back(PluginObjective(&o, library));
+  }
+  return result;
+}
+
+/// Carrega o plugin em path e registra os objetivos dele. Retorna os índices das funções.
+inline std::vector<int> load_plugin(const std::string& path) {
+  std::vector<PluginObjective> objs = open_plugin(path);
+  std::vector<int> functions;
+  for (size_t i = 0; i < objs.size(); ++i)
+    functions.push_back(register_function(objs[i].user()));
+  return functions;
+}
+
+#endif // _PLUGIN_HPP_
@@ -0,0 +1,204 @@
+#ifndef _POOL_HPP_
+#define _POOL_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fila bloqueante com retirada em lotes.
+ * Os consumidores pegam até max itens de uma vez, o que amortiza o custo
+ * de sincronização quando os itens são pequenos (ex.: um solve_it).
+ * Com capacity > 0, push espera enquanto a fila está cheia: um produtor mais
+ * rápido que os consumidores não faz a fila crescer sem limite.
+ */
+template <typename T>
+class BlockingQueue {
+  public:
+    explicit BlockingQueue(size_t capacity = 0) : capacity(capacity), closed(false) {}
+
+    /// Coloca um item na fila, esperando haver espaço. Retorna false se a fila foi fechada.
+    bool push(const T& item) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        space.wait(lock, [this]() { return closed || capacity == 0 || items.size() < capacity; });
+        if (closed)
+          return false;
+        items.push_back(item);
+      }
+      ready.notify_one();
+      return true;
+    }
+
+    /**
+     * Espera haver itens e retira até max deles para batch.
+     * Retorna false se a fila foi fechada e está vazia.
+     */
+    bool pop_batch(std::vector<T>& batch, size_t max) {
+      batch.clear();
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [this]() { return closed || !items.empty(); });
+      while (!items.empty() && batch.size() < max) {
+        batch.push_back(items.front());
+        items.pop_front();
+      }
+      lock.unlock();
+      if (!batch.empty() && capacity > 0)
+        space.notify_all();
+      return !batch.empty();
+    }
+
+    /// Acorda todos os consumidores e produtores; os itens restantes ainda são entregues.
+    void close() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+      }
+      ready.notify_all();
+      space.notify_all();
+    }
+
+    size_t size() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return items.size();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable ready, space;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+/**
+ * Pool de threads de tamanho fixo.
+ * Como usar:
+ *    ThreadPool pool(4);
+ *    pool.submit([]() { <tarefa> });
+ *    pool.wait();
+ */
+class ThreadPool {
+  public:
+    /// n = 0 usa o número de processadores.
+    explicit ThreadPool(unsigned n = 0) : pending(0) {
+      if (n == 0)
+        n = std::max(1u, std::thread::hardware_concurrency());
+      for (unsigned i = 0; i < n; ++i)
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+
+    ~ThreadPool() {
+      tasks.close();
+      for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+      }
+      tasks.push(task);
+    }
+
+    /// Espera todas as tarefas submetidas terminarem.
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      idle.wait(lock, [this]() { return pending == 0; });
+    }
+
+  private:
+    void work() {
+      std::vector<std::function<void()> > batch;
+      while (tasks.pop_batch(batch, 1)) {
+        batch[0]();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+          idle.notify_all();
+      }
+    }
+
+    BlockingQueue<std::function<void()> > tasks;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable idle;
+    size_t pending;
+};
+
+/**
+ * Executa body(begin, end) sobre [0, n) em blocos de tamanho chunk, com as
+ * threads do pool, e espera todos terminarem.
+ * A thread que chama também pega blocos, e só espera os blocos desta chamada:
+ * várias threads podem usar o mesmo pool ao mesmo tempo (e um body pode chamar
+ * parallel_for de novo) sem que uma espere pelo trabalho da outra.
+ * Uma exceção de body cancela os blocos que faltam e é relançada aqui.
+ */
+inline void parallel_for(ThreadPool& pool, size_t n, size_t chunk,
+    std::function<void(size_t begin, size_t end)> body) {
+  if (chunk == 0)
+    chunk = 1;
+  // Estado da chamada; as tarefas que chegam depois do fim só o encontram esgotado.
+  struct Blocks {
+    std::function<void(size_t, size_t)> body;
+    size_t n, chunk, count, next, running;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // Executa blocos até não sobrar nenhum. Uma exceção cancela os blocos restantes.
+    void run() {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (next < count) {
+        size_t k = next++;
+        ++running;
+        lock.unlock();
+        std::exception_ptr e;
+        try {
+          body(k * chunk, std::min(n, (k + 1) * chunk));
+        }
+        catch (...) {
+          e = std::current_exception();
+        }
+        lock.lock();
+        if (e) {
+          if (!error)
+            error = e;
+          next = count;
+        }
+        if (--running == 0 && next == count)
+          finished.notify_all();
+      }
+    }
+  };
+  std::shared_ptr<Blocks> blocks = std::make_shared<Blocks>();
+  blocks->body = body;
+  blocks->n = n;
+  blocks->chunk = chunk;
+  blocks->count = (n + chunk - 1) / chunk;
+  blocks->next = blocks->running = 0;
+  if (blocks->count == 0)
+    return;
+  size_t helpers = std::min((size_t) pool.size(), blocks->count - 1);
+  for (size_t i = 0; i < helpers; ++i)
+    pool.submit([blocks]() { blocks->run(); });
+  blocks->run();
+  std::unique_lock<std::mutex> lock(blocks->mutex);
+  blocks->finished.wait(lock, [&blocks]() { return blocks->running == 0; });
+  if (blocks->error)
+    std::rethrow_exception(blocks->error);
+}
+
+#endif // _POOL_HPP_
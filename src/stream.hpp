@@ -0,0 +1,146 @@
+#ifndef _STREAM_HPP_
+#define _STREAM_HPP_
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "columnar.hpp"
+#include "finitesum.hpp"
+#include "pool.hpp"
+
+/**
+ * Objetivos de soma finita sobre arquivos colunares maiores que a memória.
+ *
+ * StreamObjective lê as colunas dos registros em trechos de até chunk linhas,
+ * com dois buffers: enquanto os termos de um trecho são somados (sum_blocks,
+ * com as threads do pool), a thread de leitura copia o trecho seguinte do
+ * mapeamento para o outro buffer. Ela pede ao sistema as páginas do trecho
+ * depois desse (MADV_WILLNEED) e devolve as já copiadas (MADV_DONTNEED), então
+ * o processo só guarda os dois buffers, qualquer que seja o tamanho do arquivo.
+ *
+ * Os trechos têm um número inteiro de blocos de SUM_BLOCK: f e o gradiente
+ * são, bit a bit, os de SumObjective sobre os mesmos dados.
+ *
+ *    StreamObjective obj("dados.col", {"a1", "a2", "y"}, least_squares_chunk);
+ *    std::unique_ptr<Method> m(expr_method(obj, QUASINEWTON, x0, 1e-6));
+ */
+
+/// Linhas por trecho: 64k, 512 KiB por coluna em cada buffer.
+#define STREAM_CHUNK (16 * SUM_BLOCK)
+
+/// Os termos de um trecho: columns[c][i] é a coluna c (na ordem dada a StreamObjective) da linha i do trecho.
+typedef std::function<std::unique_ptr<FiniteSum>(const std::vector<const double*>& columns, size_t rows)> ChunkTerms;
+
+/// LeastSquares em um trecho: a última coluna é y, as outras são as coordenadas de ai.
+inline std::unique_ptr<FiniteSum> least_squares_chunk(const std::vector<const double*>& columns, size_t rows) {
+  std::vector<const double*> features(columns.begin(), columns.end() - 1);
+  return std::unique_ptr<FiniteSum>(new LeastSquares(features, columns.back(), rows));
+}
+
+/**
+ * Os termos de terms sobre as colunas names do arquivo em path, lidos em
+ * trechos a cada avaliação. As cópias (as de f(), gradf() e hessf()) dividem
+ * o arquivo, os buffers e as threads; as avaliações são feitas uma de cada vez.
+ */
+class StreamObjective : public SumMethods<StreamObjective> {
+  public:
+    /**
+     * threads = 0 usa o número de processadores; chunk é arredondado para um
+     * múltiplo de SUM_BLOCK. Lança std::runtime_error se o arquivo não abre e
+     * std::invalid_argument se falta uma coluna.
+     */
+    StreamObjective(const std::string& path, const std::vector<std::string>& names, ChunkTerms terms,
+        unsigned threads = 0, size_t chunk = STREAM_CHUNK)
+      : stream(std::make_shared<Stream>(path, names, terms, threads, chunk)) {}
+
+    unsigned dimension() const { return stream->dimension; }
+    size_t records() const { return stream->file.rows(); }
+    size_t chunk() const { return stream->chunk; }
+
+    /// f(x) e, se g não é NULL, o gradiente em g.
+    double evaluate(const std::vector<double>& x, std::vector<double>* g) const {
+      check(x);
+      Stream& s = *stream;
+      std::lock_guard<std::mutex> lock(s.mutex);
+      const size_t rows = s.file.rows(), chunks = (rows + s.chunk - 1) / s.chunk;
+      double f = 0.0;
+      if (g != NULL)
+        g->assign(dimension(), 0.0);
+      if (chunks == 0)
+        return f;
+
+      s.load(0, 0);
+      for (size_t k = 0; k < chunks; ++k) {
+        const unsigned b = k % 2;
+        if (k + 1 < chunks) {
+          Stream* p = &s;
+          s.reader.submit([p, k, b]() { p->load(k + 1, 1 - b); });
+        }
+        try {
+          std::unique_ptr<FiniteSum> terms = s.terms(s.columns(b), std::min(s.chunk, rows - k * s.chunk));
+          sum_blocks(*terms, x.data(), s.pool, f, g != NULL ? g->data() : NULL);
+        }
+        catch (...) {
+          s.reader.wait();
+          throw;
+        }
+        s.reader.wait();
+      }
+      return f;
+    }
+
+  private:
+    struct Stream {
+      ColumnFile file;
+      std::vector<unsigned> index;        // colunas do arquivo, na ordem de names
+      ChunkTerms terms;
+      size_t chunk;
+      unsigned dimension;
+      std::vector<double> buffer[2];      // coluna c da linha i do trecho: buffer[b][c * chunk + i]
+      ThreadPool pool, reader;
+      std::mutex mutex;
+
+      Stream(const std::string& path, const std::vector<std::string>& names, ChunkTerms terms,
+          unsigned threads, size_t chunk)
+        : file(path), terms(terms), chunk(std::max((size_t) 1, (chunk + SUM_BLOCK - 1) / SUM_BLOCK) * SUM_BLOCK),
+          pool(threads), reader(1) {
+        for (size_t c = 0; c < names.size(); ++c) {
+          int i = file.find(names[c]);
+          if (i < 0)
+            throw std::invalid_argument("ERROR: " + path + " has no column named '" + names[c] + "'");
+          index.push_back(i);
+        }
+        for (unsigned b = 0; b < 2; ++b)
+          buffer[b].resize(names.size() * this->chunk);
+        dimension = terms(columns(0), 0)->dimension();
+      }
+
+      std::vector<const double*> columns(unsigned b) const {
+        std::vector<const double*> p;
+        for (size_t c = 0; c < index.size(); ++c)
+          p.push_back(buffer[b].data() + c * chunk);
+        return p;
+      }
+
+      /// Copia o trecho k para o buffer b.
+      void load(size_t k, unsigned b) {
+        const size_t rows = file.rows(), begin = k * chunk, end = std::min(rows, begin + chunk);
+        for (size_t c = 0; c < index.size(); ++c) {
+          file.advise(index[c], end, std::min(rows, end + chunk), MADV_WILLNEED);
+#ifdef MADV_POPULATE_READ
+          // Mapeia o trecho todo de uma vez, sem uma falta de página por página no memcpy.
+          file.advise(index[c], begin, end, MADV_POPULATE_READ);
+#endif
+          memcpy(buffer[b].data() + c * chunk, file.column(index[c]) + begin, (end - begin) * sizeof(double));
+          file.advise(index[c], begin, end, MADV_DONTNEED);
+        }
+      }
+    };
+
+    std::shared_ptr<Stream> stream;
+};
+
+#endif // _STREAM_HPP_
@@ -0,0 +1,273 @@
+#ifndef _TUNE_HPP_
+#define _TUNE_HPP_
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "jobs.hpp"
+#include "multistart.hpp"
+#include "pool.hpp"
+
+/**
+ * Varredura dos parâmetros da regra de Armijo (s, beta, sigma) e autotuner.
+ *
+ * sweep() roda o BatchSolver com cada combinação de parâmetros sobre os mesmos
+ * pontos iniciais, em blocos de pontos distribuídos pelo pool, e soma as
+ * avaliações de f e o tempo das tarefas. autotune() escolhe a melhor combinação
+ * de cada (função, método) e gera um perfil.
+ *
+ * Perfil: texto, uma linha chave=valor por (função, método); # começa comentário.
+ *
+ *    function=FA method=GRADIENT s=1 beta=0.5 sigma=0.1
+ *
+ * load_profile() copia o perfil para ARMIJO_PROFILE, que subproblem_method e o
+ * BatchSolver consultam.
+ */
+
+/// Problema de uma varredura: min f a partir de pontos uniformes em [-limit, limit]^2.
+struct SweepSpec {
+  int function, method;
+  double epsilon;
+  size_t starts;
+  double limit;
+  unsigned seed;
+  Budget budget;      // por ponto inicial
+
+  // Os limites padrão impedem que uma combinação ruim (ou FB e FC, que às vezes
+  // não convergem) prenda a varredura.
+  SweepSpec() : function(FA), method(GRADIENT), epsilon(1e-6), starts(1000), limit(4.0), seed(1) {
+    budget.max_iterations = 10000;
+    budget.max_evaluations = 20000;
+  }
+};
+
+/// Resultado de uma combinação de parâmetros.
+struct SweepResult {
+  ArmijoParams params;
+  size_t converged;       // pontos iniciais que convergiram
+  uint64_t evaluations;   // avaliações de f, somadas
+  uint64_t iterations;
+  double fsum;            // f nos pontos finais, somado
+  double seconds;         // tempo das tarefas, somado
+
+  SweepResult() : converged(0), evaluations(0), iterations(0), fsum(0.0), seconds(0.0) {}
+
+  /**
+   * Melhor: mais pontos convergem; se nenhum convergiu, menor f nos pontos
+   * finais; senão, menos avaliações. O tempo não entra, para que a escolha
+   * não dependa da carga da máquina.
+   */
+  bool better(const SweepResult& o) const {
+    if (converged != o.converged)
+      return converged > o.converged;
+    if (converged == 0)
+      return fsum < o.fsum;
+    return evaluations < o.evaluations;
+  }
+};
+
+/// Parâmetros de Armijo de um (função, método).
+struct ProfileEntry {
+  int function, method;
+  ArmijoParams params;
+};
+
+/// Todas as combinações s x beta x sigma.
+inline std::vector<ArmijoParams> sweep_grid(
+    const std::vector<double>& s, const std::vector<double>& beta, const std::vector<double>& sigma) {
+  std::vector<ArmijoParams> params;
+  for (size_t i = 0; i < s.size(); ++i)
+    for (size_t j = 0; j < beta.size(); ++j)
+      for (size_t k = 0; k < sigma.size(); ++k) {
+        ArmijoParams p(s[i], beta[j], sigma[k]);
+        if (!p.valid())
+          throw std::invalid_argument("ERROR: Armijo parameters need s > 0, 0 < beta < 1 and 0 < sigma < 1");
+        params.push_back(p);
+      }
+  return params;
+}
+
+/// n combinações sorteadas: s em [0.25, 4] e sigma em [1e-4, 0.5] (escala log), beta em [0.1, 0.9].
+inline std::vector<ArmijoParams> sweep_random(size_t n, unsigned seed) {
+  std::vector<ArmijoParams> params;
+  for (size_t i = 0; i < n; ++i) {
+    double u = (double) rand_r(&seed) / RAND_MAX;
+    double v = (double) rand_r(&seed) / RAND_MAX;
+    double w = (double) rand_r(&seed) / RAND_MAX;
+    params.push_back(ArmijoParams(0.25 * pow(16.0, u), 0.1 + 0.8 * v, 1e-4 * pow(5000.0, w)));
+  }
+  return params;
+}
+
+/// Os pontos iniciais de spec; a mesma semente dá os mesmos pontos.
+inline void sweep_starts(const SweepSpec& spec, std::vector<double>& x01, std::vector<double>& x02) {
+  unsigned state = spec.seed;
+  x01.resize(spec.starts);
+  x02.resize(spec.starts);
+  for (size_t i = 0; i < spec.starts; ++i) {
+    x01[i] = spec.limit * (2.0 * rand_r(&state) / RAND_MAX - 1.0);
+    x02[i] = spec.limit * (2.0 * rand_r(&state) / RAND_MAX - 1.0);
+  }
+}
+
+/**
+ * Roda spec com cada combinação de params. Cada tarefa do pool resolve um bloco
+ * de até 256 pontos com uma combinação. Retorna um resultado por combinação,
+ * do melhor para o pior (empates na ordem de params).
+ */
+inline std::vector<SweepResult> sweep(const SweepSpec& spec, const std::vector<ArmijoParams>& params, ThreadPool& pool) {
+  BatchSolver check(spec.function, spec.method, spec.epsilon);
+  std::vector<double> x01, x02;
+  sweep_starts(spec, x01, x02);
+
+  const size_t block = 256;
+  const size_t blocks = (spec.starts + block - 1) / block;
+  std::vector<SweepResult> results(params.size());
+  for (size_t p = 0; p < params.size(); ++p)
+    results[p].params = params[p];
+  std::mutex mutex;
+
+  parallel_for(pool, params.size() * blocks, 1, [&](size_t begin, size_t end) {
+    std::vector<StartResult> r(block);
+    for (size_t k = begin; k < end; ++k) {
+      size_t p = k / blocks, first = (k % blocks) * block;
+      size_t n = std::min(block, spec.starts - first);
+      BatchSolver solver(spec.function, spec.method, spec.epsilon);
+      solver.setBudget(spec.budget);
+      solver.setArmijo(params[p]);
+      Timer timer;
+      solver.solve(&x01[first], &x02[first], n, r.data());
+      double seconds = timer.elapsed();
+
+      SweepResult partial;
+      for (size_t i = 0; i < n; ++i) {
+        partial.converged += r[i].converged();
+        partial.evaluations += r[i].evaluations;
+        partial.iterations += r[i].iterations;
+        partial.fsum += std::isfinite(r[i].f) ? r[i].f : INFINITY;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      results[p].converged += partial.converged;
+      results[p].evaluations += partial.evaluations;
+      results[p].iterations += partial.iterations;
+      results[p].fsum += partial.fsum;
+      results[p].seconds += seconds;
+    }
+  });
+
+  std::stable_sort(results.begin(), results.end(),
+      [](const SweepResult& a, const SweepResult& b) { return a.better(b); });
+  return results;
+}
+
+/**
+ * Para cada (função, método) válido (NEWTON só com FA), varre params e fica com
+ * a melhor combinação. Os parâmetros padrão vão na frente da lista: o perfil
+ * nunca fica pior que eles e, em caso de empate (NEWTONPURE não usa Armijo),
+ * fica com eles. Se log não for NULL, escreve nele uma linha por escolha.
+ */
+inline std::vector<ProfileEntry> autotune(const SweepSpec& base, const std::vector<int>& functions,
+    const std::vector<int>& methods, std::vector<ArmijoParams> params, ThreadPool& pool,
+    std::ostream* log = NULL) {
+  params.erase(std::remove(params.begin(), params.end(), ArmijoParams()), params.end());
+  params.insert(params.begin(), ArmijoParams());
+
+  std::vector<ProfileEntry> profile;
+  for (size_t i = 0; i < functions.size(); ++i)
+    for (size_t j = 0; j < methods.size(); ++j) {
+      if ((methods[j] == NEWTON || methods[j] == NEWTONPURE) && functions[i] != FA)
+        continue;
+      SweepSpec spec = base;
+      spec.function = functions[i];
+      spec.method = methods[j];
+      ProfileEntry e;
+      e.function = spec.function;
+      e.method = spec.method;
+      std::vector<SweepResult> results = sweep(spec, params, pool);
+      e.params = results.front().params;
+      profile.push_back(e);
+
+      if (log != NULL) {
+        const SweepResult& best = results.front();
+        const SweepResult& standard = *std::find_if(results.begin(), results.end(),
+            [](const SweepResult& r) { return r.params == ArmijoParams(); });
+        *log << "INFO: " << function_name(e.function) << " " << method_name(e.method)
+          << ": s=" << best.params.s << " beta=" << best.params.beta << " sigma=" << best.params.sigma
+          << ", " << best.converged << "/" << spec.starts << " converged, " << best.evaluations
+          << " evaluations (default: " << standard.converged << "/" << spec.starts << ", "
+          << standard.evaluations << ")" << std::endl;
+      }
+    }
+  return profile;
+}
+
+/// Grava o perfil em path.
+inline void save_profile(const std::string& path, const std::vector<ProfileEntry>& profile) {
+  std::ofstream out(path.c_str());
+  if (!out)
+    throw std::runtime_error("ERROR: can't create " + path);
+  out << "# otim Armijo profile (" << LIB_VERSION << ")" << std::endl << std::setprecision(17);
+  for (size_t i = 0; i < profile.size(); ++i)
+    out << "function=" << function_name(profile[i].function)
+      << " method=" << method_name(profile[i].method)
+      << " s=" << profile[i].params.s
+      << " beta=" << profile[i].params.beta
+      << " sigma=" << profile[i].params.sigma << std::endl;
+  if (!out)
+    throw std::runtime_error("ERROR: can't write " + path);
+}
+
+/**
+ * Lê o perfil de path; lança std::runtime_error se o arquivo não existe, tem
+ * erro de formato ou cita uma função fora de FA..FC (as de ARMIJO_PROFILE).
+ */
+inline std::vector<ProfileEntry> read_profile(const std::string& path) {
+  std::ifstream in(path.c_str());
+  if (!in)
+    throw std::runtime_error("ERROR: can't open " + path);
+
+  std::vector<ProfileEntry> profile;
+  std::string line;
+  for (unsigned n = 1; std::getline(in, line); ++n) {
+    size_t first = line.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    std::map<std::string, std::string> fields;
+    std::string error;
+    ProfileEntry e;
+    if (!parse_fields(line, fields, error))
+      throw std::runtime_error("ERROR: " + path + ":" + std::to_string(n) + ": " + error);
+    if (fields.size() != 5 || !fields.count("function") || !fields.count("method") ||
+        !fields.count("s") || !fields.count("beta") || !fields.count("sigma"))
+      error = "expected function, method, s, beta and sigma";
+    else if ((e.function = parse_function(fields["function"])) < 0)
+      error = "unknown function '" + fields["function"] + "'";
+    else if (e.function > FC)
+      error = "profiles only cover FA, FB and FC, not '" + fields["function"] + "'";
+    else if ((e.method = parse_method(fields["method"])) < 0)
+      error = "unknown method '" + fields["method"] + "'";
+    else {
+      e.params = ArmijoParams(atof(fields["s"].c_str()), atof(fields["beta"].c_str()), atof(fields["sigma"].c_str()));
+      if (!e.params.valid())
+        error = "Armijo parameters need s > 0, 0 < beta < 1 and 0 < sigma < 1";
+    }
+    if (!error.empty())
+      throw std::runtime_error("ERROR: " + path + ":" + std::to_string(n) + ": " + error);
+    profile.push_back(e);
+  }
+  return profile;
+}
+
+/// Lê o perfil de path e o aplica em ARMIJO_PROFILE. Retorna o número de entradas.
+inline size_t load_profile(const std::string& path) {
+  std::vector<ProfileEntry> profile = read_profile(path);
+  for (size_t i = 0; i < profile.size(); ++i)
+    ARMIJO_PROFILE[profile[i].function][profile[i].method] = profile[i].params;
+  return profile.size();
+}
+
+#endif // _TUNE_HPP_
@@ -0,0 +1,236 @@
+#include <cstring>
+#include "unrestricted.h"
+#include "expr.hpp"
+#include "jobs.hpp"
+#include "multistart.hpp"
+#include "plugin.hpp"
+
+/**
+ * Implementação da API C de unrestricted.h. Nenhuma exceção atravessa a API:
+ * cada função pega as exceções, guarda a mensagem para unr_last_error() e
+ * retorna NULL ou UNR_ERROR.
+ */
+
+static thread_local std::string LAST_ERROR;
+
+/// A biblioteca começa sem relatórios: quem a carrega não quer o log do otim na saída.
+static struct Quiet {
+  Quiet() { VERBOSE = false; }
+} QUIET;
+
+/// FA, FB, FC ou uma função registrada, com a interface de expr_method.
+struct NamedProblem {
+  int function;
+  unsigned n;
+  unsigned dimension() const { return n; }
+  std::function<double(Matrix)> f() const { return objective(function); }
+  std::function<Matrix(Matrix)> gradf() const { return gradient(function); }
+  std::function<Matrix(Matrix)> hessf() const { return hessian(function); }
+};
+
+static int fail(const std::exception& e) {
+  LAST_ERROR = e.what();
+  return UNR_ERROR;
+}
+
+struct unr_solver {
+  int function;                       // -1: objetivo do chamador
+  std::unique_ptr<PluginObjective> objective;
+  unsigned dimension;
+  unr_options options;
+  CancelToken cancel;
+  std::vector<StartResult> results;   // do último lote, reaproveitado
+
+  Budget budget() const {
+    Budget b;
+    b.max_iterations = options.max_iterations;
+    b.max_evaluations = options.max_evaluations;
+    b.max_seconds = options.max_seconds;
+    b.cancel = &cancel;
+    return b;
+  }
+
+  ArmijoParams armijo() const {
+    if (options.armijo_s > 0)
+      return ArmijoParams(options.armijo_s, options.armijo_beta, options.armijo_sigma);
+    return armijo_params(function, options.method);
+  }
+};
+
+/// Confere as opções e cria o solver; lança std::invalid_argument se não servem.
+static unr_solver* make_solver(int function, const otim_objective* obj, const unr_options* options) {
+  std::unique_ptr<unr_solver> s(new unr_solver);
+  s->function = function;
+  if (options != NULL)
+    s->options = *options;
+  else
+    unr_options_default(&s->options);
+  const unr_options& o = s->options;
+  if (o.method < UNR_GRADIENT || o.method > UNR_QUASINEWTON)
+    throw std::invalid_argument("ERROR: Unknown method");
+  if (!(o.epsilon > 0))
+    throw std::invalid_argument("ERROR: epsilon must be positive");
+  if (o.armijo_s > 0 && !s->armijo().valid())
+    throw std::invalid_argument("ERROR: invalid Armijo parameters");
+  bool newton = o.method == UNR_NEWTON || o.method == UNR_NEWTONPURE;
+
+  if (obj != NULL) {
+    if (obj->abi != OTIM_PLUGIN_ABI || obj->dimension == 0 || obj->value == NULL || obj->gradient == NULL)
+      throw std::invalid_argument("ERROR: the objective needs abi, a dimension, a value and a gradient");
+    s->objective.reset(new PluginObjective(obj, std::shared_ptr<void>()));
+    s->dimension = obj->dimension;
+    if (newton && !s->objective->hasHessian())
+      throw std::invalid_argument("ERROR: Newton's method needs an objective with a hessian");
+  }
+  else {
+    const UserFunction* user = user_function(function);
+    s->dimension = user != NULL ? user->dimension : 2;
+    if (newton && !has_hessian(function))
+      throw std::invalid_argument("ERROR: NEWTON is only implemented for FA and functions with a hessian");
+  }
+  if (newton && s->dimension != 2)
+    throw std::invalid_argument("ERROR: Newton's method needs an objective in x1 and x2");
+  return s.release();
+}
+
+static void fill_stats(unr_stats* stats, int status, double f, unsigned iterations, unsigned evaluations,
+    unsigned armijo_calls, double seconds) {
+  if (stats == NULL)
+    return;
+  stats->status = status;
+  stats->f = f;
+  stats->iterations = iterations;
+  stats->evaluations = evaluations;
+  stats->armijo_calls = armijo_calls;
+  stats->seconds = seconds;
+}
+
+extern "C" {
+
+const char* unr_version(void) {
+  return LIB_VERSION;
+}
+
+const char* unr_last_error(void) {
+  return LAST_ERROR.c_str();
+}
+
+void unr_set_verbose(int verbose) {
+  VERBOSE = verbose != 0;
+}
+
+void unr_options_default(unr_options* options) {
+  memset(options, 0, sizeof(*options));
+  options->method = UNR_GRADIENT;
+  options->epsilon = 1e-6;
+}
+
+int unr_load_plugin(const char* path) {
+  try {
+    return load_plugin(path).size();
+  }
+  catch (const std::exception& e) {
+    return fail(e);
+  }
+}
+
+unr_solver* unr_solver_new(const char* function, const unr_options* options) {
+  try {
+    int id = parse_function(function != NULL ? function : "");
+    if (id < 0)
+      throw std::invalid_argument(std::string("ERROR: unknown function '") + (function != NULL ? function : "") + "'");
+    return make_solver(id, NULL, options);
+  }
+  catch (const std::exception& e) {
+    fail(e);
+    return NULL;
+  }
+}
+
+unr_solver* unr_solver_new_objective(const otim_objective* objective, const unr_options* options) {
+  try {
+    if (objective == NULL)
+      throw std::invalid_argument("ERROR: no objective");
+    return make_solver(-1, objective, options);
+  }
+  catch (const std::exception& e) {
+    fail(e);
+    return NULL;
+  }
+}
+
+void unr_solver_free(unr_solver* solver) {
+  delete solver;
+}
+
+size_t unr_solver_dimension(const unr_solver* solver) {
+  return solver->dimension;
+}
+
+int unr_solve(unr_solver* solver, double* x, unr_stats* stats) {
+  try {
+    Timer timer;
+    solver->cancel.reset();
+    Matrix x0(std::vector<double>(x, x + solver->dimension));
+    std::unique_ptr<Method> m;
+    if (solver->objective)
+      m.reset(expr_method(*solver->objective, solver->options.method, x0, solver->options.epsilon, solver->budget()));
+    else {
+      NamedProblem problem = {solver->function, solver->dimension};
+      m.reset(expr_method(problem, solver->options.method, x0, solver->options.epsilon, solver->budget()));
+    }
+    m->setArmijo(solver->armijo());
+    SolveResult r = m->run();
+    for (unsigned i = 0; i < solver->dimension; ++i)
+      x[i] = r.x.get(i + 1);
+    fill_stats(stats, r.reason, r.fx, r.iterations, r.n_evaluations, r.n_call_armijo, timer.elapsed());
+    return r.reason;
+  }
+  catch (const std::exception& e) {
+    return fail(e);
+  }
+}
+
+int unr_solve_batch(unr_solver* solver, const double* x01, const double* x02, size_t count,
+    double* x1, double* x2, double* f, int* status, unr_stats* stats) {
+  try {
+    if (solver->function < FA || solver->function > FC)
+      throw std::invalid_argument("ERROR: batches support only FA, FB and FC");
+    Timer timer;
+    solver->cancel.reset();
+    BatchSolver batch(solver->function, solver->options.method, solver->options.epsilon);
+    batch.setBudget(solver->budget());
+    batch.setArmijo(solver->armijo());
+    solver->results.resize(count);
+    batch.solve(x01, x02, count, solver->results.data());
+
+    int all = UNR_CONVERGED;
+    double best = NAN;
+    unsigned iterations = 0, evaluations = 0;
+    for (size_t k = 0; k < count; ++k) {
+      const StartResult& r = solver->results[k];
+      x1[k] = r.x1;
+      x2[k] = r.x2;
+      f[k] = r.f;
+      if (status != NULL)
+        status[k] = r.reason;
+      if (all == UNR_CONVERGED && !r.converged())
+        all = r.reason;
+      if (std::isfinite(r.f) && !(r.f >= best))
+        best = r.f;
+      iterations += r.iterations;
+      evaluations += r.evaluations;
+    }
+    fill_stats(stats, all, best, iterations, evaluations, 0, timer.elapsed());
+    return all;
+  }
+  catch (const std::exception& e) {
+    return fail(e);
+  }
+}
+
+void unr_cancel(unr_solver* solver) {
+  solver->cancel.cancel();
+}
+
+}  // extern "C"
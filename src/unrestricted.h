@@ -0,0 +1,128 @@
+#ifndef _UNRESTRICTED_H_
+#define _UNRESTRICTED_H_
+
+/*
+ * API C da libunrestricted: o otim dentro do processo, sem jobs em texto.
+ *
+ *    unr_options o;
+ *    unr_options_default(&o);
+ *    o.method = UNR_QUASINEWTON;
+ *    unr_solver* s = unr_solver_new("FA", &o);
+ *    double x[2] = {2.0, 1.0};            // ponto inicial; recebe a solução
+ *    unr_stats st;
+ *    if (s == NULL || unr_solve(s, x, &st) == UNR_ERROR)
+ *      fprintf(stderr, "%s\n", unr_last_error());
+ *    unr_solver_free(s);
+ *
+ * Objetivos: FA, FB, FC, as funções de plugins carregados (unr_load_plugin) ou
+ * um otim_objective do chamador (otim_plugin.h), chamado direto pelos ponteiros.
+ *
+ * Os arrays são do chamador: unr_solve lê o ponto inicial e escreve a solução
+ * no mesmo x; unr_solve_batch resolve count pontos iniciais lidos direto de
+ * x01/x02 e escreve os resultados nos arrays de saída. Os resultados passam
+ * por um StartResult por ponto, guardado no unr_solver e reaproveitado entre
+ * as chamadas.
+ *
+ * Um unr_solver não pode ser usado por duas threads ao mesmo tempo (exceto
+ * unr_cancel); solvers diferentes podem. unr_load_plugin não pode correr junto
+ * com nenhuma outra chamada. A biblioteca não escreve nada na saída, a não ser
+ * com unr_set_verbose(1).
+ */
+
+#include <stddef.h>
+#include "otim_plugin.h"
+
+#define UNR_API_VERSION 1
+
+/* A biblioteca é compilada com -fvisibility=hidden: só o que tem UNR_API é exportado. */
+#define UNR_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Métodos (os mesmos valores de GRADIENT, ... em lib.hpp). */
+enum {UNR_GRADIENT, UNR_NEWTON, UNR_NEWTONPURE, UNR_QUASINEWTON};
+
+/* Motivos de parada (os mesmos valores de Termination em lib.hpp); UNR_ERROR: a chamada falhou. */
+enum {
+  UNR_CONVERGED,
+  UNR_STEP_TOO_SMALL,
+  UNR_TOO_MANY_ITERATIONS,
+  UNR_SINGULAR_HESSIAN,
+  UNR_NOT_FINITE,
+  UNR_TOO_MANY_EVALUATIONS,
+  UNR_TIME_LIMIT,
+  UNR_CANCELLED,
+  UNR_ERROR = -1
+};
+
+typedef struct unr_options {
+  int method;                   /* UNR_GRADIENT, ... */
+  double epsilon;               /* para quando |grad f| < epsilon */
+  unsigned max_iterations;      /* 0: sem limite (lote: 10000 por ponto) */
+  unsigned max_evaluations;     /* avaliações de f; 0: sem limite */
+  double max_seconds;           /* 0: sem limite */
+  double armijo_s, armijo_beta, armijo_sigma;   /* 0: os parâmetros padrão do objetivo e método */
+} unr_options;
+
+typedef struct unr_stats {
+  int status;                   /* motivo de parada; no lote, UNR_CONVERGED se todos convergiram */
+  double f;                     /* f na solução; no lote, a menor */
+  unsigned iterations;          /* no lote, a soma */
+  unsigned evaluations;         /* avaliações de f; no lote, a soma */
+  unsigned armijo_calls;        /* 0 no lote */
+  double seconds;
+} unr_stats;
+
+typedef struct unr_solver unr_solver;
+
+/* Versão do otim (LIB_VERSION). */
+UNR_API const char* unr_version(void);
+
+/* Mensagem do último erro desta thread ("" se não houve). */
+UNR_API const char* unr_last_error(void);
+
+/* Liga ou desliga os relatórios dos métodos na saída padrão (padrão: desligados). */
+UNR_API void unr_set_verbose(int verbose);
+
+/* Gradiente, epsilon 1e-6, sem limites, Armijo padrão. */
+UNR_API void unr_options_default(unr_options* options);
+
+/* Carrega um plugin e registra os objetivos dele. Retorna quantos, ou UNR_ERROR. */
+UNR_API int unr_load_plugin(const char* path);
+
+/* Solver para FA, FB, FC ou uma função registrada, pelo nome. NULL se houver erro. */
+UNR_API unr_solver* unr_solver_new(const char* function, const unr_options* options);
+
+/* Solver para um objetivo do chamador, que deve viver mais que o solver. NULL se houver erro. */
+UNR_API unr_solver* unr_solver_new_objective(const otim_objective* objective, const unr_options* options);
+
+UNR_API void unr_solver_free(unr_solver* solver);
+
+/* Número de coordenadas dos pontos. */
+UNR_API size_t unr_solver_dimension(const unr_solver* solver);
+
+/*
+ * Minimiza a partir de x (unr_solver_dimension valores), que recebe a solução
+ * (ou o melhor iterado, se não convergiu). stats pode ser NULL. Retorna o
+ * motivo de parada ou UNR_ERROR.
+ */
+UNR_API int unr_solve(unr_solver* solver, double* x, unr_stats* stats);
+
+/*
+ * Minimiza a partir de cada (x01[k], x02[k]), k < count, em lote (multistart.hpp):
+ * só FA, FB e FC. Escreve a solução em x1[k], x2[k] e f[k]; status pode ser NULL
+ * e recebe o motivo de parada de cada ponto. Retorna stats->status ou UNR_ERROR.
+ */
+UNR_API int unr_solve_batch(unr_solver* solver, const double* x01, const double* x02, size_t count,
+    double* x1, double* x2, double* f, int* status, unr_stats* stats);
+
+/* Interrompe a resolução em andamento no solver (com UNR_CANCELLED); pode vir de outra thread. */
+UNR_API void unr_cancel(unr_solver* solver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UNRESTRICTED_H_ */
@@ -0,0 +1,355 @@
+#ifndef _VECMATH_HPP_
+#define _VECMATH_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "lib.hpp"
+
+/**
+ * Kernels vetoriais de exp/log/sqrt e avaliação em lote das funções objetivo.
+ *
+ * Os kernels usam as extensões de vetor do GCC/Clang: cada operação em um
+ * vdouble processa VEC_WIDTH pontos de uma vez. Compilando com -mavx2 (ou
+ * -march=native) cada operação vira uma única instrução AVX; sem isso o
+ * compilador divide em pares SSE2.
+ *
+ * Precisão: vexp e vlog ficam em ~1 ulp (algoritmos do fdlibm), vsqrt é
+ * corretamente arredondada.
+ */
+
+// Número de doubles processados por vez.
+#define VEC_WIDTH 4
+
+typedef double vdouble __attribute__((vector_size(VEC_WIDTH * sizeof(double))));
+typedef int64_t vint64 __attribute__((vector_size(VEC_WIDTH * sizeof(int64_t))));
+typedef uint64_t vuint64 __attribute__((vector_size(VEC_WIDTH * sizeof(uint64_t))));
+
+/// Vetor com todas as posições iguais a value.
+inline vdouble vsplat(double value) {
+  vdouble v;
+  for (unsigned i = 0; i < VEC_WIDTH; ++i)
+    v[i] = value;
+  return v;
+}
+
+/// Carrega até n (<= VEC_WIDTH) elementos de p; o restante é preenchido com fill.
+inline vdouble vload(const double* p, unsigned n = VEC_WIDTH, double fill = 0.0) {
+  vdouble v = vsplat(fill);
+  if (n >= VEC_WIDTH)
+    memcpy(&v, p, sizeof(v));
+  else
+    memcpy(&v, p, n * sizeof(double));
+  return v;
+}
+
+/// Grava até n (<= VEC_WIDTH) elementos de v em p.
+inline void vstore(double* p, vdouble v, unsigned n = VEC_WIDTH) {
+  memcpy(p, &v, (n >= VEC_WIDTH ? VEC_WIDTH : n) * sizeof(double));
+}
+
+inline vuint64 vbits(vdouble v) {
+  vuint64 u;
+  memcpy(&u, &v, sizeof(u));
+  return u;
+}
+
+inline vdouble vfrombits(vuint64 u) {
+  vdouble v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/// Seleção por posição: mask ? a : b (mask vem de uma comparação de vetores).
+inline vdouble vselect(vint64 mask, vdouble a, vdouble b) {
+  return vfrombits((vbits(a) & (vuint64)mask) | (vbits(b) & ~(vuint64)mask));
+}
+
+/// 2^n para n inteiro em [-1022, 1023].
+inline vdouble vexp2i(vint64 n) {
+  return vfrombits((vuint64)(n + 1023) << 52);
+}
+
+/**
+ * exp vetorial.
+ * x = n ln2 + r, |r| <= ln2/2 (redução de Cody-Waite),
+ * exp(r) por polinômio de Taylor de grau 13 e escala por 2^n em duas metades
+ * para cobrir o intervalo subnormal.
+ */
+inline vdouble vexp(vdouble x) {
+  const double LOG2E = 1.44269504088896338700e+00;
+  const double LN2_HI = 6.93147180369123816490e-01;
+  const double LN2_LO = 1.90821492927058770002e-10;
+  const double SHIFTER = 6755399441055744.0;   // 1.5 * 2^52
+
+  x = vselect(x > 710.0, vsplat(710.0), x);
+  x = vselect(x < -746.0, vsplat(-746.0), x);
+
+  // Arredondamento para o inteiro mais próximo: os bits baixos de t guardam n.
+  vdouble t = x * LOG2E + SHIFTER;
+  vdouble n = t - SHIFTER;
+  vint64 ni = (vint64)(vbits(t) - vbits(vsplat(SHIFTER)));
+
+  vdouble r = (x - n * LN2_HI) - n * LN2_LO;
+
+  vdouble p = vsplat(1.0 / 6227020800.0);
+  p = p * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = (p * r) * r + r + 1.0;
+
+  // NaN: n lixo, mas p já é NaN.
+  ni = (vint64)(x == x) & ni;
+  vint64 n1 = ni >> 1;
+  vint64 n2 = ni - n1;
+  return p * vexp2i(n1) * vexp2i(n2);
+}
+
+/**
+ * log vetorial (e_log.c do fdlibm).
+ * x = 2^k m, m em [sqrt(2)/2, sqrt(2)), log(m) = f - hfsq + s (hfsq + R(s^2)).
+ */
+inline vdouble vlog(vdouble x) {
+  const double LN2_HI = 6.93147180369123816490e-01;
+  const double LN2_LO = 1.90821492927058770002e-10;
+  const double LG1 = 6.666666666666735130e-01;
+  const double LG2 = 3.999999999940941908e-01;
+  const double LG3 = 2.857142874366239149e-01;
+  const double LG4 = 2.222219843214978396e-01;
+  const double LG5 = 1.818357216161805012e-01;
+  const double LG6 = 1.531383769920937332e-01;
+  const double LG7 = 1.479819860511658591e-01;
+  const double SQRT2 = 1.41421356237309514547e+00;
+
+  // Subnormais: normaliza multiplicando por 2^54.
+  vint64 sub = x < std::numeric_limits<double>::min();
+  vdouble xs = vselect(sub, x * 18014398509481984.0, x);
+  vuint64 bits = vbits(xs);
+
+  vint64 k = (vint64)((bits >> 52) & 0x7ff) - 1023;
+  k = k - (sub & 54);
+  vdouble m = vfrombits((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+  vint64 big = m > SQRT2;
+  m = vselect(big, m * 0.5, m);
+  k = k - big;  // big vale -1 nas posições verdadeiras
+
+  vdouble f = m - 1.0;
+  vdouble hfsq = 0.5 * f * f;
+  vdouble s = f / (2.0 + f);
+  vdouble z = s * s;
+  vdouble w = z * z;
+  vdouble t1 = w * (LG2 + w * (LG4 + w * LG6));
+  vdouble t2 = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7)));
+  vdouble R = t2 + t1;
+  vdouble dk = __builtin_convertvector(k, vdouble);
+  vdouble y = dk * LN2_HI - ((hfsq - (s * (hfsq + R) + dk * LN2_LO)) - f);
+
+  const double inf = std::numeric_limits<double>::infinity();
+  y = vselect(x == 0.0, vsplat(-inf), y);
+  y = vselect(x == inf, vsplat(inf), y);
+  y = vselect((x < 0.0) | (x != x), vsplat(std::numeric_limits<double>::quiet_NaN()), y);
+  return y;
+}
+
+/// sqrt vetorial (corretamente arredondada).
+inline vdouble vsqrt(vdouble x) {
+#if defined(__AVX__) && VEC_WIDTH == 4
+  __m256d r = _mm256_sqrt_pd((__m256d)x);
+  return (vdouble)r;
+#else
+  vdouble r;
+  for (unsigned i = 0; i < VEC_WIDTH; ++i)
+    r[i] = sqrt(x[i]);
+  return r;
+#endif
+}
+
+/// fa em VEC_WIDTH pontos.
+inline vdouble vfa(vdouble x1, vdouble x2) {
+  vdouble e = vexp(x1) - x2;
+  return x1 * x1 + e * e;
+}
+
+/// gradiente de fa em VEC_WIDTH pontos.
+inline void vgradfa(vdouble x1, vdouble x2, vdouble& g1, vdouble& g2) {
+  vdouble ex = vexp(x1);
+  vdouble r = ex - x2;
+  g1 = 2.0 * x1 + 2.0 * r * ex;
+  g2 = -2.0 * r;
+}
+
+/// hessiana de fa em VEC_WIDTH pontos (h12 = h21).
+inline void vhessfa(vdouble x1, vdouble x2, vdouble& h11, vdouble& h12, vdouble& h22) {
+  vdouble ex = vexp(x1);
+  h11 = 2.0 + 4.0 * ex * ex - 2.0 * ex * x2;
+  h12 = -2.0 * ex;
+  h22 = vsplat(2.0);
+}
+
+/// d do subproblema em VEC_WIDTH pontos.
+inline vdouble vd(vdouble x1, vdouble x2, double xkk1, double xkk2) {
+  vdouble a = x1 - xkk1;
+  vdouble b = (x2 - xkk2) - (vexp(x1) - exp(xkk1));
+  return a * a + b * b;
+}
+
+/// gradiente de d em VEC_WIDTH pontos.
+inline void vgradd(vdouble x1, vdouble x2, double xkk1, double xkk2, vdouble& g1, vdouble& g2) {
+  vdouble ex = vexp(x1);
+  vdouble b = (x2 - xkk2) - (ex - exp(xkk1));
+  g1 = 2.0 * (x1 - xkk1) - 2.0 * ex * b;
+  g2 = 2.0 * b;
+}
+
+/// hessiana de d em VEC_WIDTH pontos (h12 = h21).
+inline void vhessd(vdouble x1, vdouble x2, double xkk1, double xkk2, vdouble& h11, vdouble& h12, vdouble& h22) {
+  vdouble ex = vexp(x1);
+  h11 = 2.0 + 4.0 * ex * ex - 2.0 * ex * (x2 - xkk2 + exp(xkk1));
+  h12 = -2.0 * ex;
+  h22 = vsplat(2.0);
+}
+
+/// f (FA, FB ou FC) em VEC_WIDTH pontos.
+inline vdouble vf(int function, vdouble x1, vdouble x2) {
+  vdouble a = vfa(x1, x2);
+  switch (function) {
+    case FB:
+      return vsqrt(a);
+    case FC:
+      return vlog(1.0 + a);
+    default:
+      return a;
+  }
+}
+
+/// gradiente de f (FA, FB ou FC) em VEC_WIDTH pontos.
+inline void vgradf(int function, vdouble x1, vdouble x2, vdouble& g1, vdouble& g2) {
+  vgradfa(x1, x2, g1, g2);
+  switch (function) {
+    case FB: {
+      vdouble c = 1.0 / (2.0 * vsqrt(vfa(x1, x2)));
+      g1 = c * g1;
+      g2 = c * g2;
+      break;
+    }
+    case FC: {
+      // Mesma expressão de gradfc.
+      vdouble c = 1.0 / vlog(1.0 + vfa(x1, x2));
+      g1 = c * g1;
+      g2 = c * g2;
+      break;
+    }
+  }
+}
+
+/// g = f + (lambdak / 2) d em VEC_WIDTH pontos.
+inline vdouble vg(int function, double lambdak, vdouble x1, vdouble x2, double xkk1, double xkk2) {
+  return vf(function, x1, x2) + (lambdak / 2.0) * vd(x1, x2, xkk1, xkk2);
+}
+
+/// hessiana de g em VEC_WIDTH pontos; só para FA, como hessg.
+inline void vhessg(double lambdak, vdouble x1, vdouble x2, double xkk1, double xkk2,
+    vdouble& h11, vdouble& h12, vdouble& h22) {
+  vdouble d11, d12, d22;
+  vhessfa(x1, x2, h11, h12, h22);
+  vhessd(x1, x2, xkk1, xkk2, d11, d12, d22);
+  h11 = h11 + (lambdak / 2.0) * d11;
+  h12 = h12 + (lambdak / 2.0) * d12;
+  h22 = h22 + (lambdak / 2.0) * d22;
+}
+
+/// gradiente de g em VEC_WIDTH pontos.
+inline void vgradg(int function, double lambdak, vdouble x1, vdouble x2, double xkk1, double xkk2,
+    vdouble& g1, vdouble& g2) {
+  vdouble d1, d2;
+  vgradf(function, x1, x2, g1, g2);
+  vgradd(x1, x2, xkk1, xkk2, d1, d2);
+  g1 = g1 + (lambdak / 2.0) * d1;
+  g2 = g2 + (lambdak / 2.0) * d2;
+}
+
+/// y[i] = exp(x[i]), i = 0..n-1
+inline void exp_batch(const double* x, double* y, unsigned n) {
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(y + i, vexp(vload(x + i, n - i)), n - i);
+}
+
+/// y[i] = log(x[i]), i = 0..n-1
+inline void log_batch(const double* x, double* y, unsigned n) {
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(y + i, vlog(vload(x + i, n - i, 1.0)), n - i);
+}
+
+/// y[i] = sqrt(x[i]), i = 0..n-1
+inline void sqrt_batch(const double* x, double* y, unsigned n) {
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(y + i, vsqrt(vload(x + i, n - i)), n - i);
+}
+
+/// out[i] = f(x1[i], x2[i]), f = FA, FB ou FC.
+inline void f_batch(int function, const double* x1, const double* x2, double* out, unsigned n) {
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(out + i, vf(function, vload(x1 + i, n - i), vload(x2 + i, n - i)), n - i);
+}
+
+/// (g1[i], g2[i]) = gradf(x1[i], x2[i]), f = FA, FB ou FC.
+inline void gradf_batch(int function, const double* x1, const double* x2, double* g1, double* g2, unsigned n) {
+  for (unsigned i = 0; i < n; i += VEC_WIDTH) {
+    vdouble a, b;
+    vgradf(function, vload(x1 + i, n - i), vload(x2 + i, n - i), a, b);
+    vstore(g1 + i, a, n - i);
+    vstore(g2 + i, b, n - i);
+  }
+}
+
+inline void fa_batch(const double* x1, const double* x2, double* out, unsigned n) {
+  f_batch(FA, x1, x2, out, n);
+}
+
+inline void fb_batch(const double* x1, const double* x2, double* out, unsigned n) {
+  f_batch(FB, x1, x2, out, n);
+}
+
+inline void fc_batch(const double* x1, const double* x2, double* out, unsigned n) {
+  f_batch(FC, x1, x2, out, n);
+}
+
+/// out[i] = d(x[i], xkk)
+inline void d_batch(const double* x1, const double* x2, const Matrix& xkk, double* out, unsigned n) {
+  double xkk1 = xkk.x1(), xkk2 = xkk.x2();
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(out + i, vd(vload(x1 + i, n - i), vload(x2 + i, n - i), xkk1, xkk2), n - i);
+}
+
+/// out[i] = g(x[i]) do subproblema de f com parâmetros lambdak e xkk.
+inline void g_batch(int function, double lambdak, const Matrix& xkk,
+    const double* x1, const double* x2, double* out, unsigned n) {
+  double xkk1 = xkk.x1(), xkk2 = xkk.x2();
+  for (unsigned i = 0; i < n; i += VEC_WIDTH)
+    vstore(out + i, vg(function, lambdak, vload(x1 + i, n - i), vload(x2 + i, n - i), xkk1, xkk2), n - i);
+}
+
+/// (g1[i], g2[i]) = gradg(x[i]) do subproblema de f com parâmetros lambdak e xkk.
+inline void gradg_batch(int function, double lambdak, const Matrix& xkk,
+    const double* x1, const double* x2, double* g1, double* g2, unsigned n) {
+  double xkk1 = xkk.x1(), xkk2 = xkk.x2();
+  for (unsigned i = 0; i < n; i += VEC_WIDTH) {
+    vdouble a, b;
+    vgradg(function, lambdak, vload(x1 + i, n - i), vload(x2 + i, n - i), xkk1, xkk2, a, b);
+    vstore(g1 + i, a, n - i);
+    vstore(g2 + i, b, n - i);
+  }
+}
+
+#endif // _VECMATH_HPP_
@@ -1,7 +1,29 @@
 #include "gtest/gtest.h"
 #include "lib.hpp"
+#include "vecmath.hpp"
+#include "multistart.hpp"
+#include "pool.hpp"
+#include "jobs.hpp"
+#include "columnar.hpp"
+#include "cache.hpp"
+#include "checkpoint.hpp"
+#include "landscape.hpp"
+#include "basin.hpp"
+#include "tune.hpp"
+#include "finitediff.hpp"
+#include "expr.hpp"
+#include "codegen.hpp"
+#include "plugin.hpp"
+#include "bench.hpp"
+#include "finitesum.hpp"
+#include "stream.hpp"
+#include "unrestricted.h"
 using namespace std;
 
+#ifndef OTIM_SOURCE_DIR
+#define OTIM_SOURCE_DIR "src"
+#endif
+
 TEST(MatrixTest, EmptyConstructor) {
   Matrix m;
   EXPECT_EQ(m.getRows(), 0);
@@ -245,6 +267,15 @@ TEST(MatrixTest, det2) {
   EXPECT_DOUBLE_EQ(m.det2(), -5);
 }
 
+TEST(MatrixTest, isFinite) {
+  Matrix m(2,1,1.0);
+  EXPECT_TRUE(m.isFinite());
+  m.set(2, NAN);
+  EXPECT_FALSE(m.isFinite());
+  m.set(2, INFINITY);
+  EXPECT_FALSE(m.isFinite());
+}
+
 TEST(MatrixTest, operatorMultScalar2) {
   Matrix m(2,1, 2.0);
   Matrix s = 2 * m;
@@ -354,3 +385,1452 @@ TEST(gradfcTest, values) {
   EXPECT_DOUBLE_EQ(gradfc(a1).x1(), (1.0/log(2.0)) * 2); 
   EXPECT_DOUBLE_EQ(gradfc(a1).x2(), (1.0/log(2.0)) * (-2));
 }
+
+// Distância em ulps entre dois doubles finitos de mesmo sinal.
+static int64_t ulps(double a, double b) {
+  int64_t ia, ib;
+  memcpy(&ia, &a, sizeof(a));
+  memcpy(&ib, &b, sizeof(b));
+  return ia > ib ? ia - ib : ib - ia;
+}
+
+TEST(vecmathTest, exp) {
+  vector<double> x, y(4001);
+  for (int i = -2000; i <= 2000; ++i)
+    x.push_back(i * 0.3527);
+  exp_batch(&x[0], &y[0], x.size());
+  for (unsigned i = 0; i < x.size(); ++i) {
+    if (std::exp(x[i]) == 0.0 || std::isinf(std::exp(x[i])))
+      EXPECT_EQ(y[i], std::exp(x[i]));
+    else
+      EXPECT_LE(ulps(y[i], std::exp(x[i])), 1) << "x = " << x[i];
+  }
+  EXPECT_TRUE(std::isnan(vexp(vsplat(NAN))[0]));
+}
+
+TEST(vecmathTest, log) {
+  vector<double> x, y(3001);
+  for (int i = 0; i <= 3000; ++i)
+    x.push_back(std::exp((i - 1500) * 0.4731) * 1.0001);
+  x.push_back(4.9e-320);
+  y.push_back(0.0);
+  log_batch(&x[0], &y[0], x.size());
+  for (unsigned i = 0; i < x.size(); ++i)
+    EXPECT_LE(ulps(y[i], std::log(x[i])), 1) << "x = " << x[i];
+  EXPECT_TRUE(std::isinf(vlog(vsplat(0.0))[0]));
+  EXPECT_TRUE(std::isnan(vlog(vsplat(-1.0))[0]));
+}
+
+TEST(vecmathTest, sqrt) {
+  double x[5] = {0.0, 1.0, 2.0, 9.0, 1e-300};
+  double y[5];
+  sqrt_batch(x, y, 5);
+  for (unsigned i = 0; i < 5; ++i)
+    EXPECT_EQ(y[i], std::sqrt(x[i]));
+}
+
+TEST(vecmathTest, fBatch) {
+  double x1[7] = {0.0, 2.0, 0.0, 1.0, -1.5, 0.3, 3.0};
+  double x2[7] = {0.0, 1.0, 2.0, 1.0, 2.5, -0.7, 1.0};
+  double fs[7], g1[7], g2[7];
+  int functions[3] = {FA, FB, FC};
+  std::function<double(Matrix)> f[3] = {fa, fb, fc};
+  std::function<Matrix(Matrix)> gradf[3] = {gradfa, gradfb, gradfc};
+  for (unsigned k = 0; k < 3; ++k) {
+    f_batch(functions[k], x1, x2, fs, 7);
+    gradf_batch(functions[k], x1, x2, g1, g2, 7);
+    for (unsigned i = 0; i < 7; ++i) {
+      Matrix x(vector<double>{x1[i], x2[i]});
+      EXPECT_NEAR(fs[i], f[k](x), 1e-13 * std::fabs(f[k](x)));
+      EXPECT_NEAR(g1[i], gradf[k](x).x1(), 1e-12 * (1 + std::fabs(gradf[k](x).x1())));
+      EXPECT_NEAR(g2[i], gradf[k](x).x2(), 1e-12 * (1 + std::fabs(gradf[k](x).x2())));
+    }
+  }
+}
+
+TEST(vecmathTest, gBatch) {
+  double x1[5] = {0.0, 2.0, -1.0, 0.5, 1.0};
+  double x2[5] = {0.0, 1.0, 0.5, 0.5, -2.0};
+  double gs[5], g1[5], g2[5];
+  Matrix xkk(vector<double>{1.0, 0.5});
+  g_batch(FA, 0.5, xkk, x1, x2, gs, 5);
+  gradg_batch(FA, 0.5, xkk, x1, x2, g1, g2, 5);
+  for (unsigned i = 0; i < 5; ++i) {
+    Matrix x(vector<double>{x1[i], x2[i]});
+    EXPECT_NEAR(gs[i], g(fa, 0.5, x, xkk), 1e-13 * g(fa, 0.5, x, xkk));
+    EXPECT_NEAR(g1[i], gradg(gradfa, 0.5, x, xkk).x1(), 1e-12);
+    EXPECT_NEAR(g2[i], gradg(gradfa, 0.5, x, xkk).x2(), 1e-12);
+  }
+}
+
+TEST(BatchSolverTest, gradient) {
+  vector<double> x01, x02;
+  for (unsigned i = 0; i < 37; ++i) {
+    x01.push_back(-2.0 + 0.1 * i);
+    x02.push_back(1.5 - 0.07 * i);
+  }
+  BatchSolver solver(FA, GRADIENT, 1e-6);
+  vector<StartResult> r = solver.solve(x01, x02);
+  ASSERT_EQ(r.size(), 37);
+  for (unsigned i = 0; i < r.size(); ++i) {
+    EXPECT_TRUE(r[i].converged());
+    EXPECT_NEAR(r[i].x1, 0.0, 1e-5);
+    EXPECT_NEAR(r[i].x2, 1.0, 1e-5);
+    EXPECT_GT(r[i].iterations, 0);
+  }
+}
+
+TEST(BatchSolverTest, quasinewtonSubproblem) {
+  vector<double> x01(11, 0.5), x02;
+  for (unsigned i = 0; i < 11; ++i)
+    x02.push_back(-1.0 + 0.3 * i);
+  Matrix xkk(vector<double>{1.0, 2.0});
+  BatchSolver solver(FA, QUASINEWTON, 1e-6, 0.5, xkk.x1(), xkk.x2());
+  vector<StartResult> r = solver.solve(x01, x02);
+  for (unsigned i = 0; i < r.size(); ++i) {
+    Matrix x(vector<double>{r[i].x1, r[i].x2});
+    EXPECT_TRUE(r[i].converged());
+    EXPECT_LT(gradg(gradfa, 0.5, x, xkk).mod(), 1e-6);
+    EXPECT_DOUBLE_EQ(r[i].f, g(fa, 0.5, x, xkk));
+  }
+}
+
+TEST(BatchSolverTest, invalidMethod) {
+  EXPECT_THROW(BatchSolver(FB, NEWTON, 1e-6), std::invalid_argument);
+}
+
+TEST(inv2Test, values) {
+  Matrix w(2,2);
+  w.set(1,1,4.0);
+  w.set(1,2,7.0);
+  w.set(2,1,2.0);
+  w.set(2,2,6.0);
+  Matrix inv;
+  EXPECT_TRUE(inv2(w, inv));
+  Matrix i = w * inv;
+  EXPECT_NEAR(i.get(1,1), 1.0, 1e-15);
+  EXPECT_NEAR(i.get(1,2), 0.0, 1e-15);
+  EXPECT_NEAR(i.get(2,1), 0.0, 1e-15);
+  EXPECT_NEAR(i.get(2,2), 1.0, 1e-15);
+
+  Matrix singular(2,2,1.0);
+  EXPECT_FALSE(inv2(singular, inv));
+}
+
+TEST(SolveResultTest, singularHessian) {
+  Matrix x0(vector<double>{1.0, 1.0});
+  SolveResult r = newton_method(
+      [](Matrix x) -> double { return x.x1() * x.x1() + x.x2(); },
+      [](Matrix x) -> Matrix { return Matrix(vector<double>{2 * x.x1(), 1.0}); },
+      [](Matrix x) -> Matrix { Matrix h(2,2); h.set(1,1,2.0); return h; },
+      x0,
+      1e-6);
+  EXPECT_EQ(r.reason, SINGULAR_HESSIAN);
+  EXPECT_FALSE(r.converged());
+  EXPECT_DOUBLE_EQ(r.x.x1(), 1.0);
+  EXPECT_DOUBLE_EQ(r.fx, 2.0);
+}
+
+TEST(SolveResultTest, notFinite) {
+  Matrix x0(vector<double>{1.0, 1.0});
+  SolveResult r = gradient_method(
+      [](Matrix x) -> double { return NAN; },
+      [](Matrix x) -> Matrix { return Matrix(2,1,1.0); },
+      x0,
+      1e-6);
+  EXPECT_EQ(r.reason, NOT_FINITE);
+}
+
+TEST(SolveResultTest, converged) {
+  Matrix x0(vector<double>{0.5, 0.5});
+  SolveResult r = quasinewton_method(fa, gradfa, x0, eye(2), 1e-6);
+  EXPECT_TRUE(r.converged());
+  EXPECT_NEAR(r.x.x1(), 0.0, 1e-5);
+  EXPECT_NEAR(r.x.x2(), 1.0, 1e-5);
+  EXPECT_DOUBLE_EQ(r.fx, fa(r.x));
+  EXPECT_GT(r.iterations, 0);
+}
+
+TEST(BudgetTest, maxIterations) {
+  Budget budget;
+  budget.max_iterations = 2;
+  SolveResult r = gradient_method(fa, gradfa, Matrix(vector<double>{2.0, -1.0}), 1e-9, budget);
+  EXPECT_EQ(r.reason, TOO_MANY_ITERATIONS);
+  EXPECT_EQ(r.iterations, 2);
+  EXPECT_LT(r.fx, fa(Matrix(vector<double>{2.0, -1.0})));
+}
+
+TEST(BudgetTest, maxEvaluations) {
+  Budget budget;
+  budget.max_evaluations = 10;
+  SolveResult r = quasinewton_method(fa, gradfa, Matrix(vector<double>{2.0, -1.0}), eye(2), 1e-12, budget);
+  EXPECT_EQ(r.reason, TOO_MANY_EVALUATIONS);
+  EXPECT_LE(r.n_evaluations, 12);
+}
+
+TEST(BudgetTest, cancelled) {
+  CancelToken cancel;
+  cancel.cancel();
+  Budget budget;
+  budget.cancel = &cancel;
+  SolveResult r = newton_method(fa, gradfa, hessfa, Matrix(vector<double>{1.0, 0.0}), 1e-9, false, budget);
+  EXPECT_EQ(r.reason, CANCELLED);
+
+  srand(1);
+  SolveResult s = solve_it(FA, Matrix(vector<double>{1.0, 0.0}), 4, 1e-7, 1e-2, GRADIENT, budget);
+  EXPECT_EQ(s.reason, CANCELLED);
+  EXPECT_EQ(s.iterations, 1);
+}
+
+TEST(BudgetTest, solveItEvaluations) {
+  Budget budget;
+  budget.max_evaluations = 50;
+  srand(1);
+  SolveResult r = solve_it(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-12, 1e-8, QUASINEWTON, budget);
+  EXPECT_EQ(r.reason, TOO_MANY_EVALUATIONS);
+  EXPECT_LE(r.n_evaluations, 60);
+}
+
+TEST(BudgetTest, batchCancelled) {
+  CancelToken cancel;
+  cancel.cancel();
+  Budget budget;
+  budget.cancel = &cancel;
+  BatchSolver solver(FA, GRADIENT, 1e-6);
+  solver.setBudget(budget);
+  vector<StartResult> r = solver.solve(vector<double>(20, 1.0), vector<double>(20, 0.0));
+  for (unsigned i = 0; i < r.size(); ++i)
+    EXPECT_EQ(r[i].reason, CANCELLED);
+}
+
+TEST(MethodTest, stepwise) {
+  GradientMethod m(fa, gradfa, Matrix(vector<double>{1.0, 0.0}), 1e-6);
+  EXPECT_FALSE(m.done());
+  EXPECT_EQ(m.iteration(), 0);
+  double last = fa(m.current());
+  while (m.step()) {
+    EXPECT_LT(m.value(), last);
+    EXPECT_DOUBLE_EQ(m.value(), fa(m.current()));
+    last = m.value();
+  }
+  EXPECT_TRUE(m.done());
+  EXPECT_FALSE(m.step());
+  SolveResult r = m.result();
+  EXPECT_TRUE(r.converged());
+  EXPECT_EQ(r.iterations, m.iteration());
+  EXPECT_NEAR(r.x.x1(), 0.0, 1e-5);
+  EXPECT_NEAR(r.x.x2(), 1.0, 1e-5);
+}
+
+TEST(MethodTest, cancel) {
+  QuasiNewtonMethod m(fa, gradfa, Matrix(vector<double>{2.0, -1.0}), eye(2), 1e-9);
+  EXPECT_TRUE(m.step());
+  m.cancel();
+  EXPECT_FALSE(m.step());
+  EXPECT_EQ(m.result().reason, CANCELLED);
+  EXPECT_EQ(m.result().iterations, 1);
+}
+
+TEST(MethodTest, interleavedSolveIt) {
+  srand(3);
+  SolveIt a(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-1, QUASINEWTON);
+  SolveIt b(FA, Matrix(vector<double>{-1.0, 3.0}), 4, 1e-7, 1e-2, GRADIENT);
+  bool more = true;
+  while (more) {
+    more = false;
+    if (a.step())
+      more = true;
+    if (b.step())
+      more = true;
+  }
+  EXPECT_EQ(a.result().reason, CONVERGED);
+  EXPECT_EQ(b.result().reason, CONVERGED);
+  EXPECT_NEAR(a.current().x1(), 0.0, 1e-3);
+  EXPECT_NEAR(b.current().x2(), 1.0, 1e-3);
+  EXPECT_THROW(SolveIt(FB, Matrix(2,1), 4, 1e-7, 1e-2, NEWTON), std::invalid_argument);
+}
+
+TEST(PoolTest, parallelFor) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.size(), 4u);
+  vector<int> v(1000, 0);
+  parallel_for(pool, v.size(), 64, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      v[i] += i;
+  });
+  for (size_t i = 0; i < v.size(); ++i)
+    EXPECT_EQ(v[i], (int) i);
+}
+
+TEST(PoolTest, parallelForShared) {
+  // Um pool de uma thread, usado por várias threads e por um body que chama parallel_for de novo.
+  ThreadPool pool(1);
+  vector<int> v(400, 0);
+  vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t)
+    threads.push_back(std::thread([&pool, &v, t]() {
+      parallel_for(pool, 10, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+          parallel_for(pool, 10, 3, [&](size_t b, size_t e) {
+            for (size_t j = b; j < e; ++j)
+              v[t * 100 + i * 10 + j] += 1;
+          });
+      });
+    }));
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+  EXPECT_EQ(std::count(v.begin(), v.end(), 1), 400);
+  EXPECT_THROW(parallel_for(pool, 100, 1, [](size_t begin, size_t) {
+    if (begin == 42)
+      throw std::runtime_error("ERROR: block 42");
+  }), std::runtime_error);
+}
+
+TEST(PoolTest, popBatch) {
+  BlockingQueue<int> q;
+  for (int i = 0; i < 5; ++i)
+    q.push(i);
+  vector<int> batch;
+  EXPECT_TRUE(q.pop_batch(batch, 3));
+  EXPECT_EQ(batch.size(), 3u);
+  q.close();
+  EXPECT_FALSE(q.push(9));
+  EXPECT_TRUE(q.pop_batch(batch, 3));
+  EXPECT_EQ(batch.size(), 2u);
+  EXPECT_FALSE(q.pop_batch(batch, 3));
+}
+
+TEST(PoolTest, boundedPushWaits) {
+  BlockingQueue<int> q(2);
+  EXPECT_TRUE(q.push(0));
+  EXPECT_TRUE(q.push(1));
+  std::thread producer([&q]() { q.push(2); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(q.size(), 2u);
+  vector<int> batch;
+  EXPECT_TRUE(q.pop_batch(batch, 1));
+  producer.join();
+  EXPECT_EQ(q.size(), 2u);
+
+  // close acorda um produtor esperando espaço.
+  bool pushed = true;
+  std::thread blocked([&q, &pushed]() { pushed = q.push(3); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  q.close();
+  blocked.join();
+  EXPECT_FALSE(pushed);
+}
+
+TEST(JobsTest, parse) {
+  Job job;
+  string error;
+  EXPECT_TRUE(parse_job("id=7 kind=min function=FB method=GRADIENT x1=-1 x2=3 eps_meth=1e-6 max_iterations=50", job, error));
+  EXPECT_EQ(job.id, "7");
+  EXPECT_EQ(job.kind, MINIMIZE);
+  EXPECT_EQ(job.function, FB);
+  EXPECT_EQ(job.method, GRADIENT);
+  EXPECT_DOUBLE_EQ(job.x1, -1.0);
+  EXPECT_DOUBLE_EQ(job.epsilonMeth, 1e-6);
+  EXPECT_EQ(job.budget.max_iterations, 50u);
+
+  EXPECT_FALSE(parse_job("  # comentário", job, error));
+  EXPECT_TRUE(error.empty());
+  EXPECT_FALSE(parse_job("id=1 function=FD", job, error));
+  EXPECT_FALSE(error.empty());
+  EXPECT_FALSE(parse_job("id=1 x1=abc", job, error));
+  EXPECT_FALSE(parse_job("id=1 kind=solve function=FB method=NEWTON", job, error));
+
+  // Valores que não cabem no campo são recusados, sem conversão truncada.
+  EXPECT_FALSE(parse_job("id=1 seed=-1", job, error));
+  EXPECT_EQ(error, "seed must be between 0 and 4294967295");
+  EXPECT_FALSE(parse_job("id=1 max_iterations=1e20", job, error));
+  EXPECT_FALSE(parse_job("id=1 max_evaluations=-5", job, error));
+  EXPECT_FALSE(parse_job("id=1 limit=1e20", job, error));
+  EXPECT_FALSE(parse_job("id=1 max_seconds=-1", job, error));
+  EXPECT_TRUE(parse_job("id=1 seed=4294967295 max_iterations=0", job, error));
+  EXPECT_EQ(job.seed, 4294967295u);
+}
+
+TEST(JobsTest, runJobs) {
+  VERBOSE = false;
+  vector<Job> jobs(3);
+  string error;
+  ASSERT_TRUE(parse_job("id=a kind=min function=FA method=QUASINEWTON x1=2 x2=-1 eps_meth=1e-6", jobs[0], error));
+  ASSERT_TRUE(parse_job("id=b kind=solve function=FA method=QUASINEWTON x1=2 x2=1 seed=5", jobs[1], error));
+  ASSERT_TRUE(parse_job("id=c kind=min function=FA method=QUASINEWTON x1=-3 x2=0 eps_meth=1e-6", jobs[2], error));
+  vector<JobResult> results;
+  run_jobs(jobs, results);
+  VERBOSE = true;
+  ASSERT_EQ(results.size(), 3u);
+  for (unsigned i = 0; i < 3; ++i) {
+    EXPECT_TRUE(results[i].result.converged());
+    EXPECT_NEAR(results[i].result.x.x1(), 0.0, 1e-2);
+    EXPECT_NEAR(results[i].result.x.x2(), 1.0, 1e-2);
+  }
+  string line = format_result(jobs[0], results[0]);
+  EXPECT_EQ(line.find("id=a status=converged "), 0u);
+}
+
+TEST(JobsTest, failingJobBecomesError) {
+  // Um job que passa por parse_job mas lança ao rodar não pode derrubar o lote.
+  vector<Job> jobs(2);
+  string error;
+  ASSERT_TRUE(parse_job("id=bad kind=solve function=FB x1=1 x2=1", jobs[0], error));
+  jobs[0].portfolio = {GRADIENT, NEWTON};
+  ASSERT_TRUE(parse_job("id=good kind=solve function=FA method=QUASINEWTON x1=2 x2=1 seed=5", jobs[1], error));
+  vector<JobResult> results;
+  VERBOSE = false;
+  run_jobs(jobs, results);
+  VERBOSE = true;
+  EXPECT_EQ(format_result(jobs[0], results[0]),
+      "id=bad status=error message=NEWTON is only implemented for FA and functions with a hessian");
+  EXPECT_TRUE(results[1].error.empty());
+  EXPECT_TRUE(results[1].result.converged());
+}
+
+TEST(JobsTest, seededSolveIsReproducible) {
+  VERBOSE = false;
+  Job job;
+  string error;
+  ASSERT_TRUE(parse_job("id=1 function=FC method=GRADIENT x1=1 x2=1 seed=42", job, error));
+  JobResult a = run_solve_job(job);
+  JobResult b = run_solve_job(job);
+  VERBOSE = true;
+  EXPECT_EQ(a.result.iterations, b.result.iterations);
+  EXPECT_DOUBLE_EQ(a.result.x.x1(), b.result.x.x1());
+  EXPECT_DOUBLE_EQ(a.result.x.x2(), b.result.x.x2());
+}
+
+TEST(JobsTest, processJobs) {
+  VERBOSE = false;
+  std::istringstream in(
+      "# comentário\n"
+      "id=1 kind=min function=FA method=GRADIENT x1=2 x2=-1 eps_meth=1e-6\n"
+      "id=2 function=FD\n"
+      "id=3 kind=min function=FA method=GRADIENT x1=-2 x2=3 eps_meth=1e-6\n"
+      "\n"
+      "id=4 kind=solve function=FA method=GRADIENT x1=1 x2=0 eps_meth=1e-2 seed=9\n");
+  std::ostringstream out;
+  ThreadPool pool(2);
+  JobStats stats = process_jobs(in, out, pool, 1, 2);
+  VERBOSE = true;
+  EXPECT_EQ(stats.jobs, 3u);
+  EXPECT_EQ(stats.errors, 1u);
+
+  std::istringstream lines(out.str());
+  vector<string> ids;
+  string line;
+  while (std::getline(lines, line)) {
+    std::map<string, string> fields;
+    string error;
+    ASSERT_TRUE(parse_fields(line.substr(0, line.find(" message=")), fields, error));
+    ids.push_back(fields["id"]);
+    EXPECT_EQ(fields["status"], fields["id"] == "2" ? "error" : "converged");
+  }
+  EXPECT_EQ(ids, (vector<string>{"1", "2", "3", "4"}));
+}
+
+// Grava value no offset do cabeçalho do arquivo path (para simular um arquivo corrompido).
+static void patch_header(const string& path, size_t offset, uint64_t value) {
+  std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(offset);
+  file.write((const char*) &value, sizeof(value));
+}
+
+TEST(ColumnarTest, writeAndRead) {
+  string path = "columnarTest.col";
+  {
+    ColumnWriter out(path, 1000, START_COLUMNS);
+    double* x1 = out.column("x1");
+    double* x2 = out.column(1);
+    for (unsigned i = 0; i < 1000; ++i) {
+      x1[i] = i;
+      x2[i] = -0.5 * i;
+    }
+  }
+  ColumnFile in(path);
+  EXPECT_EQ(in.rows(), 1000u);
+  EXPECT_EQ(in.cols(), 2u);
+  EXPECT_EQ(in.name(1), "x2");
+  EXPECT_EQ(in.find("f"), -1);
+  EXPECT_THROW(in.column("f"), std::invalid_argument);
+  EXPECT_EQ((uintptr_t) in.column(0) % 64, 0u);
+  EXPECT_DOUBLE_EQ(in.column("x1")[999], 999.0);
+  EXPECT_DOUBLE_EQ(in.column("x2")[10], -5.0);
+  // rows * cols * sizeof(double) dá a volta em 64 bits e cairia no tamanho certo.
+  patch_header(path, 8, 1000 + (1ull << 60));
+  EXPECT_THROW(ColumnFile("columnarTest.col"), std::runtime_error);
+  remove(path.c_str());
+  EXPECT_THROW(ColumnFile("columnarTest.missing"), std::runtime_error);
+}
+
+TEST(ColumnarTest, csvRoundTrip) {
+  {
+    std::ofstream csv("columnarTest.csv");
+    csv << "x1,x2\n0.25,-1\n3, 1e-3\n\n";
+  }
+  EXPECT_EQ(csv_to_columns("columnarTest.csv", "columnarTest.col"), 2u);
+  ColumnFile in("columnarTest.col");
+  EXPECT_DOUBLE_EQ(in.column("x2")[1], 1e-3);
+  std::ostringstream out;
+  EXPECT_EQ(columns_to_csv("columnarTest.col", out), 2u);
+  EXPECT_EQ(out.str(), "x1,x2\n0.25,-1\n3,0.001\n");
+  remove("columnarTest.csv");
+  remove("columnarTest.col");
+}
+
+TEST(BatchSolverTest, zeroCopy) {
+  vector<double> x01 = {2.0, -1.0, 0.5}, x02 = {-1.0, 3.0, 0.0};
+  StartResult r[3];
+  BatchSolver solver(FA, GRADIENT, 1e-6);
+  solver.solve(x01.data(), x02.data(), 3, r);
+  vector<StartResult> v = solver.solve(x01, x02);
+  for (unsigned i = 0; i < 3; ++i) {
+    EXPECT_TRUE(r[i].converged());
+    EXPECT_DOUBLE_EQ(r[i].x1, v[i].x1);
+    EXPECT_EQ(r[i].iterations, v[i].iterations);
+  }
+}
+
+TEST(CacheTest, storeAndGrow) {
+  remove("cacheTest.bin");
+  Budget budget;
+  uint64_t k1 = solve_key(SOLVE, FA, GRADIENT, Matrix(vector<double>{1.0, 2.0}), 4, 1e-7, 1e-2, 1, budget);
+  uint64_t k2 = solve_key(SOLVE, FA, GRADIENT, Matrix(vector<double>{1.0, 2.0}), 4, 1e-7, 1e-3, 1, budget);
+  EXPECT_NE(k1, k2);
+  SolveResult r;
+  r.x = Matrix(vector<double>{0.5, 1.5});
+  r.fx = 2.0;
+  r.reason = STEP_TOO_SMALL;
+  r.iterations = 7;
+  {
+    Cache cache("cacheTest.bin", 16);
+    EXPECT_FALSE(cache.lookup(k1, r));
+    cache.store(k1, r);
+    for (uint64_t k = 100; k < 140; ++k)
+      cache.store(k, r);
+    EXPECT_EQ(cache.size(), 41u);
+    EXPECT_GE(cache.capacity(), 82u);
+    SolveResult timed = r;
+    timed.reason = TIME_LIMIT;
+    cache.store(k2, timed);
+    EXPECT_EQ(cache.size(), 41u);
+  }
+  Cache cache("cacheTest.bin");
+  SolveResult s;
+  ASSERT_TRUE(cache.lookup(k1, s));
+  EXPECT_FALSE(cache.lookup(k2, s));
+  EXPECT_TRUE(cache.lookup(120, s));
+  EXPECT_EQ(cache.hits(), 2u);
+  EXPECT_EQ(cache.misses(), 1u);
+  EXPECT_DOUBLE_EQ(s.x.x2(), 1.5);
+  EXPECT_EQ(s.reason, STEP_TOO_SMALL);
+  EXPECT_EQ(s.iterations, 7u);
+  remove("cacheTest.bin");
+}
+
+TEST(CacheTest, runJobs) {
+  remove("cacheTest.bin");
+  VERBOSE = false;
+  vector<Job> jobs(2);
+  string error;
+  ASSERT_TRUE(parse_job("id=a kind=min function=FA method=GRADIENT x1=2 x2=-1 eps_meth=1e-6", jobs[0], error));
+  ASSERT_TRUE(parse_job("id=b kind=solve function=FA method=GRADIENT x1=1 x2=0 eps_meth=1e-2 seed=4", jobs[1], error));
+  Cache cache("cacheTest.bin");
+  vector<JobResult> first, second;
+  run_jobs(jobs, first, &cache);
+  run_jobs(jobs, second, &cache);
+  VERBOSE = true;
+  EXPECT_EQ(cache.misses(), 2u);
+  EXPECT_EQ(cache.hits(), 2u);
+  for (unsigned i = 0; i < 2; ++i) {
+    EXPECT_FALSE(first[i].cached);
+    EXPECT_TRUE(second[i].cached);
+    EXPECT_EQ(format_result(jobs[i], first[i]).substr(0, 60), format_result(jobs[i], second[i]).substr(0, 60));
+  }
+  remove("cacheTest.bin");
+}
+
+TEST(CheckpointTest, solveItResume) {
+  VERBOSE = false;
+  SolveIt full(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-2, GRADIENT);
+  full.setSeed(11);
+  SolveResult expected = full.run();
+
+  // Interrompe no meio de uma iteração externa e retoma a partir do arquivo.
+  SolveIt first(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-2, GRADIENT);
+  first.setSeed(11);
+  while (first.iteration() < 3 || first.inner() == NULL || first.inner()->iteration() < 2)
+    ASSERT_TRUE(first.step());
+  save_checkpoint("checkpointTest.ckp", first.checkpoint());
+
+  SolveItState state;
+  ASSERT_TRUE(load_checkpoint("checkpointTest.ckp", state));
+  EXPECT_EQ(state.iter, 2u);
+  SolveIt resumed(state);
+  SolveResult r = run_checkpointed(resumed, "checkpointTest.ckp", 0.0);
+  VERBOSE = true;
+  EXPECT_FALSE(load_checkpoint("checkpointTest.ckp", state));
+  EXPECT_EQ(r.reason, expected.reason);
+  EXPECT_EQ(r.iterations, expected.iterations);
+  EXPECT_EQ(r.n_evaluations, expected.n_evaluations);
+  EXPECT_DOUBLE_EQ(r.x.x1(), expected.x.x1());
+  EXPECT_DOUBLE_EQ(r.x.x2(), expected.x.x2());
+
+  // Um estado corrompido é recusado antes de virar índice ou enum.
+  SolveItState bad = first.checkpoint();
+  bad.function = 9;
+  EXPECT_THROW(SolveIt s(bad), std::runtime_error);
+  bad = first.checkpoint();
+  bad.method = -1;
+  EXPECT_THROW(SolveIt s(bad), std::runtime_error);
+  bad = first.checkpoint();
+  bad.reason = 1000;
+  EXPECT_THROW(SolveIt s(bad), std::runtime_error);
+  bad = first.checkpoint();
+  bad.limitx0 = 0;
+  EXPECT_THROW(SolveIt s(bad), std::runtime_error);
+}
+
+TEST(CheckpointTest, multiStartProgress) {
+  MultiStartProgress a(1000, 64, FA, GRADIENT, 1e-6);
+  EXPECT_EQ(a.chunks(), 16u);
+  EXPECT_FALSE(a.load("checkpointTest.ckp"));
+  a.mark(3);
+  a.mark(15);
+  a.save("checkpointTest.ckp");
+
+  MultiStartProgress b(1000, 64, FA, GRADIENT, 1e-6);
+  ASSERT_TRUE(b.load("checkpointTest.ckp"));
+  EXPECT_TRUE(b.done(3));
+  EXPECT_FALSE(b.done(4));
+  EXPECT_EQ(b.completed(), 2u);
+
+  MultiStartProgress other(1000, 64, FA, QUASINEWTON, 1e-6);
+  EXPECT_THROW(other.load("checkpointTest.ckp"), std::runtime_error);
+  SolveItState state;
+  EXPECT_THROW(load_checkpoint("checkpointTest.ckp", state), std::runtime_error);
+  remove("checkpointTest.ckp");
+}
+
+TEST(LandscapeTest, matchesScalar) {
+  LandscapeSpec spec;
+  spec.function = FB;
+  spec.lambdak = 0.5;
+  spec.xkk1 = 1.0;
+  spec.xkk2 = -1.0;
+  spec.gradient = true;
+  spec.nx = 37;
+  spec.ny = 21;
+  spec.tile = 16;
+  ThreadPool pool(3);
+  LandscapeHeader h = compute_landscape(spec, "landscapeTest.lnd", pool);
+  LandscapeFile in("landscapeTest.lnd");
+  EXPECT_EQ(in.tiles_x(), 3u);
+  EXPECT_EQ(in.tiles_y(), 2u);
+  Matrix xkk(vector<double>{1.0, -1.0});
+  float lo = INFINITY;
+  for (size_t j = 0; j < spec.ny; j += 5) {
+    for (size_t i = 0; i < spec.nx; i += 3) {
+      Matrix x(vector<double>{-4.0 + i * 8.0 / 36, -4.0 + j * 8.0 / 20});
+      double v = fb(x) + 0.25 * d(x, xkk);
+      Matrix g = gradfb(x) + 0.25 * gradd(x, xkk);
+      EXPECT_NEAR(in.value(0, i, j), v, 1e-5 * std::max(1.0, std::fabs(v)));
+      EXPECT_NEAR(in.value(1, i, j), g.mod(), 1e-5 * std::max(1.0, g.mod()));
+      lo = std::min(lo, in.value(0, i, j));
+    }
+  }
+  EXPECT_LE(h.vmin[0], lo);
+  EXPECT_EQ(in.header().vmin[0], h.vmin[0]);
+
+  landscape_to_pgm(in, 0, "landscapeTest.pgm", 2);
+  std::ifstream pgm("landscapeTest.pgm", std::ios::binary);
+  string magic;
+  size_t w, hgt;
+  pgm >> magic >> w >> hgt;
+  EXPECT_EQ(magic, "P5");
+  EXPECT_EQ(w, 19u);
+  EXPECT_EQ(hgt, 11u);
+  // tiles_y ganha 2^53 blocos e o produto dá a volta para o mesmo tamanho.
+  patch_header("landscapeTest.lnd", 16, spec.ny + (1ull << 57));
+  EXPECT_THROW(LandscapeFile("landscapeTest.lnd"), std::runtime_error);
+  remove("landscapeTest.lnd");
+  remove("landscapeTest.pgm");
+}
+
+TEST(BatchSolverTest, newtonMatchesScalar) {
+  VERBOSE = false;
+  vector<double> x01 = {1.0, -1.5, 0.3, 2.0, -3.0}, x02 = {0.0, 2.0, -1.0, 3.0, 0.5};
+  for (int method : {NEWTON, NEWTONPURE}) {
+    BatchSolver solver(FA, method, 1e-6);
+    vector<StartResult> r = solver.solve(x01, x02);
+    for (unsigned i = 0; i < r.size(); ++i) {
+      SolveResult s = newton_method(fa, gradfa, hessfa, Matrix(vector<double>{x01[i], x02[i]}), 1e-6,
+          method == NEWTONPURE);
+      EXPECT_EQ(r[i].reason, s.reason);
+      EXPECT_EQ(r[i].iterations, s.iterations);
+      if (s.converged()) {
+        EXPECT_NEAR(r[i].x1, s.x.x1(), 1e-9);
+        EXPECT_NEAR(r[i].x2, s.x.x2(), 1e-9);
+      }
+    }
+  }
+  VERBOSE = true;
+}
+
+TEST(BasinTest, newtonMap) {
+  BasinSpec spec;
+  spec.method = NEWTON;
+  spec.nx = 40;
+  spec.ny = 30;
+  spec.max_iterations = 200;
+  ThreadPool pool(2);
+  BasinHeader h = compute_basin(spec, "basinTest.bsn", pool);
+  uint64_t total = 0;
+  for (unsigned k = 0; k < BASIN_REASONS; ++k)
+    total += h.count[k];
+  EXPECT_EQ(total, 1200u);
+  EXPECT_GT(h.count[CONVERGED], 0u);
+
+  BasinFile in("basinTest.bsn");
+  EXPECT_EQ(in.header().count[CONVERGED], h.count[CONVERGED]);
+  BatchSolver solver(FA, NEWTON, 1e-6);
+  Budget budget;
+  budget.max_iterations = 200;
+  solver.setBudget(budget);
+  size_t i = 13, j = 17;
+  vector<StartResult> r = solver.solve(vector<double>{-4.0 + i * 8.0 / 39}, vector<double>{-4.0 + j * 8.0 / 29});
+  size_t c = j * spec.nx + i;
+  EXPECT_EQ(in.reason()[c], r[0].reason);
+  EXPECT_EQ(in.iterations()[c], r[0].iterations);
+  EXPECT_FLOAT_EQ(in.x1()[c], (float) r[0].x1);
+
+  basin_to_ppm(in, "basinTest.ppm");
+  std::ifstream ppm("basinTest.ppm", std::ios::binary);
+  string magic;
+  ppm >> magic;
+  EXPECT_EQ(magic, "P6");
+  // nx * (ny + 2^62) células dá a volta para nx * ny.
+  patch_header("basinTest.bsn", 16, spec.ny + (1ull << 62));
+  EXPECT_THROW(BasinFile("basinTest.bsn"), std::runtime_error);
+  remove("basinTest.bsn");
+  remove("basinTest.ppm");
+  spec.function = FC;
+  EXPECT_THROW(compute_basin(spec, "basinTest.bsn", pool), std::invalid_argument);
+}
+
+TEST(ArmijoParamsTest, batchMatchesScalar) {
+  VERBOSE = false;
+  ArmijoParams params(2.0, 0.3, 0.01);
+  vector<double> x01 = {1.0, -1.5, 0.3}, x02 = {0.0, 2.0, -1.0};
+  BatchSolver solver(FB, GRADIENT, 1e-6);
+  solver.setArmijo(params);
+  vector<StartResult> r = solver.solve(x01, x02);
+  for (unsigned i = 0; i < r.size(); ++i) {
+    GradientMethod method(fb, gradfb, Matrix(vector<double>{x01[i], x02[i]}), 1e-6);
+    method.setArmijo(params);
+    SolveResult s = method.run();
+    EXPECT_EQ(r[i].reason, s.reason);
+    EXPECT_EQ(r[i].iterations, s.iterations);
+    EXPECT_NEAR(r[i].x1, s.x.x1(), 1e-9);
+  }
+  VERBOSE = true;
+}
+
+TEST(TuneTest, sweepAndProfile) {
+  SweepSpec spec;
+  spec.function = FA;
+  spec.method = QUASINEWTON;
+  spec.starts = 300;
+  vector<ArmijoParams> params = sweep_grid({0.5, 1.0}, {0.5, 0.8}, {0.1});
+  EXPECT_EQ(params.size(), 4u);
+  EXPECT_THROW(sweep_grid({1.0}, {1.5}, {0.1}), std::invalid_argument);
+  EXPECT_EQ(sweep_random(5, 3).size(), 5u);
+
+  ThreadPool pool(3);
+  vector<SweepResult> results = sweep(spec, params, pool);
+  ASSERT_EQ(results.size(), 4u);
+  for (unsigned i = 1; i < results.size(); ++i)
+    EXPECT_FALSE(results[i].better(results[i - 1]));
+
+  // Os totais são os mesmos de uma execução serial com os mesmos pontos.
+  vector<double> x01, x02;
+  sweep_starts(spec, x01, x02);
+  BatchSolver solver(FA, QUASINEWTON, spec.epsilon);
+  solver.setBudget(spec.budget);
+  solver.setArmijo(results[0].params);
+  vector<StartResult> r = solver.solve(x01, x02);
+  uint64_t evaluations = 0;
+  for (unsigned i = 0; i < r.size(); ++i)
+    evaluations += r[i].evaluations;
+  EXPECT_EQ(results[0].evaluations, evaluations);
+
+  vector<ProfileEntry> profile = autotune(spec, {FA, FB}, {GRADIENT, NEWTON}, params, pool);
+  ASSERT_EQ(profile.size(), 3u);    // sem FB + NEWTON
+  save_profile("tuneTest.txt", profile);
+  EXPECT_EQ(load_profile("tuneTest.txt"), 3u);
+  EXPECT_TRUE(armijo_params(FA, NEWTON) == profile[1].params);
+  EXPECT_TRUE(armijo_params(FC, GRADIENT) == ArmijoParams());
+  remove("tuneTest.txt");
+  for (unsigned f = FA; f <= FC; ++f)
+    for (unsigned m = GRADIENT; m <= QUASINEWTON; ++m)
+      ARMIJO_PROFILE[f][m] = ArmijoParams();
+
+  std::ofstream("tuneTest.txt") << "function=FA method=GRADIENT s=1 beta=2 sigma=0.1" << std::endl;
+  EXPECT_THROW(load_profile("tuneTest.txt"), std::runtime_error);
+  remove("tuneTest.txt");
+  EXPECT_THROW(load_profile("tuneTest.txt"), std::runtime_error);
+}
+
+TEST(BatchSolverTest, hugeDirectionTerminates) {
+  // Com estes pontos, B cresce até |d| estourar; a busca de Armijo precisa parar mesmo assim.
+  SweepSpec spec;
+  spec.function = FC;
+  spec.method = QUASINEWTON;
+  spec.starts = 200;
+  vector<double> x01, x02;
+  sweep_starts(spec, x01, x02);
+  BatchSolver solver(FC, QUASINEWTON, spec.epsilon);
+  solver.setBudget(spec.budget);
+  vector<StartResult> r = solver.solve(x01, x02);
+  EXPECT_EQ(r.size(), 200u);
+}
+
+TEST(PortfolioTest, race) {
+  VERBOSE = false;
+  std::unique_ptr<Method> m(portfolio_method(FA, {GRADIENT, NEWTON, QUASINEWTON}, 0.5,
+        Matrix(vector<double>{1.0, 1.0}), Matrix(vector<double>{2.0, -1.0}), 1e-8));
+  EXPECT_TRUE(m->step());
+  EXPECT_FALSE(m->step());
+  SolveResult r = m->result();
+  int winner = dynamic_cast<PortfolioMethod&>(*m).winner();
+  EXPECT_TRUE(r.converged());
+  EXPECT_TRUE(winner == GRADIENT || winner == NEWTON || winner == QUASINEWTON);
+
+  // O vencedor chega ao mesmo ponto que o método sozinho.
+  std::unique_ptr<Method> alone(subproblem_method(FA, winner, 0.5,
+        Matrix(vector<double>{1.0, 1.0}), Matrix(vector<double>{2.0, -1.0}), 1e-8));
+  SolveResult s = alone->run();
+  EXPECT_EQ(r.iterations, s.iterations);
+  EXPECT_DOUBLE_EQ(r.x.x1(), s.x.x1());
+  EXPECT_GE(r.n_evaluations, s.n_evaluations);
+  VERBOSE = true;
+}
+
+TEST(PortfolioTest, membersAreQuietAndShareTheBudget) {
+  // Com VERBOSE, só o PortfolioMethod escreve; os métodos nas threads ficam em silêncio.
+  Budget budget;
+  budget.max_evaluations = 30;
+  std::unique_ptr<Method> m(portfolio_method(FA, {GRADIENT, QUASINEWTON}, 0.5,
+        Matrix(vector<double>{1.0, 1.0}), Matrix(vector<double>{2.0, -1.0}), 1e-14, budget));
+  std::ostringstream captured;
+  std::streambuf* old = std::cout.rdbuf(captured.rdbuf());
+  m->step();
+  std::cout.rdbuf(old);
+  EXPECT_EQ(captured.str().find("Beginning iteration"), string::npos);
+  EXPECT_NE(captured.str().find("INFO: portfolio"), string::npos);
+
+  // Cada método recebe metade das 30 avaliações.
+  SolveResult r = m->result();
+  EXPECT_FALSE(r.converged());
+  EXPECT_LE(r.n_evaluations, 2 * (15 + 10));
+}
+
+TEST(PortfolioTest, solveIt) {
+  VERBOSE = false;
+  Job job;
+  string error;
+  ASSERT_TRUE(parse_job("id=p function=FA method=GRADIENT x1=2 x2=1 seed=7 portfolio=GRADIENT,NEWTON,QUASINEWTON",
+        job, error));
+  ASSERT_EQ(job.portfolio.size(), 3u);
+  EXPECT_NE(job_key(job), job_key(Job()));
+  JobResult r = run_solve_job(job);
+  VERBOSE = true;
+  EXPECT_TRUE(r.result.converged());
+  EXPECT_NEAR(r.result.x.x1(), 0.0, 1e-3);
+  EXPECT_NEAR(r.result.x.x2(), 1.0, 1e-3);
+  ASSERT_EQ(r.wins.size(), 3u);
+  EXPECT_GT(r.wins[0] + r.wins[1] + r.wins[2], 0u);
+  EXPECT_LE(r.wins[0] + r.wins[1] + r.wins[2], r.result.iterations);
+  EXPECT_NE(format_result(job, r).find(" wins=GRADIENT:"), string::npos);
+
+  EXPECT_FALSE(parse_job("id=1 function=FB portfolio=GRADIENT,NEWTON", job, error));
+  EXPECT_FALSE(parse_job("id=1 kind=min portfolio=GRADIENT", job, error));
+  EXPECT_FALSE(parse_job("id=1 portfolio=GRADIENT,BFGS", job, error));
+  SolveIt s(FB, Matrix(vector<double>{1.0, 1.0}), 4, 1e-7, 1e-2, GRADIENT);
+  EXPECT_THROW(s.setPortfolio({GRADIENT, NEWTON}), std::invalid_argument);
+}
+
+TEST(AndersonTest, linearFixedPoint) {
+  // G(x) = A x + b, contração lenta (autovalores 0.95 e 0.9): o ponto fixo é (1, 2).
+  Matrix A(vector<vector<double> >{{0.95, 0.0}, {0.0, 0.9}});
+  Matrix b(vector<double>{0.05, 0.2});
+  Matrix fixed(vector<double>{1.0, 2.0});
+
+  Anderson plain(0), accelerated(2);
+  Matrix x(2, 1), y(2, 1);
+  unsigned iterations = 0;
+  while ((y - fixed).mod() > 1e-8 && iterations < 1000) {
+    y = accelerated.next(y, A * y + b);
+    ++iterations;
+  }
+  EXPECT_LE(iterations, 5u);
+  for (unsigned k = 0; k < iterations; ++k)
+    x = plain.next(x, A * x + b);
+  EXPECT_GT((x - fixed).mod(), 0.1);
+  EXPECT_EQ(plain.size(), 0u);
+  accelerated.restart();
+  EXPECT_EQ(accelerated.size(), 0u);
+}
+
+TEST(AndersonTest, solveIt) {
+  VERBOSE = false;
+  Job job;
+  string error;
+  ASSERT_TRUE(parse_job("id=1 function=FA method=GRADIENT x1=2 x2=1 seed=3 eps_meth=1e-3 anderson=3", job, error));
+  EXPECT_EQ(job.anderson, 3u);
+  EXPECT_NE(job_key(job), job_key(Job()));
+  SolveIt solver(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-3, GRADIENT);
+  solver.setSeed(3);
+  solver.setAnderson(3);
+  SolveResult r = solver.run();
+  VERBOSE = true;
+  EXPECT_TRUE(r.converged());
+  EXPECT_NEAR(r.x.x1(), 0.0, 1e-4);
+  EXPECT_NEAR(r.x.x2(), 1.0, 1e-4);
+  EXPECT_GT(solver.accelerated(), 0u);
+  EXPECT_FALSE(parse_job("id=1 kind=min anderson=2", job, error));
+  EXPECT_FALSE(parse_job("id=1 anderson=-1", job, error));
+}
+
+TEST(HessianReuseTest, shamanskii) {
+  VERBOSE = false;
+  NewtonMethod newton(fa, gradfa, hessfa, Matrix(vector<double>{2.0, -1.0}), 1e-10);
+  SolveResult a = newton.run();
+  EXPECT_EQ(newton.hessians(), a.iterations);
+
+  NewtonMethod chord(fa, gradfa, hessfa, Matrix(vector<double>{2.0, -1.0}), 1e-10);
+  chord.setHessianReuse(100);
+  SolveResult b = chord.run();
+  EXPECT_TRUE(b.converged());
+  EXPECT_NEAR(b.x.x1(), a.x.x1(), 1e-8);
+  EXPECT_NEAR(b.x.x2(), a.x.x2(), 1e-8);
+  EXPECT_LT(chord.hessians(), b.iterations);
+  EXPECT_LT(chord.hessians(), newton.hessians());
+
+  // Uma inversa dada vale para a primeira iteração.
+  NewtonMethod seeded(fa, gradfa, hessfa, Matrix(vector<double>{0.1, 0.9}), 1e-10);
+  seeded.setHessianReuse(2);
+  Matrix inv;
+  ASSERT_TRUE(inv2(hessfa(Matrix(vector<double>{0.0, 1.0})), inv));
+  seeded.setInverseHessian(inv);
+  EXPECT_TRUE(seeded.step());
+  EXPECT_EQ(seeded.hessians(), 0u);
+  VERBOSE = true;
+}
+
+TEST(HessianReuseTest, solveIt) {
+  VERBOSE = false;
+  Job job;
+  string error;
+  ASSERT_TRUE(parse_job("id=1 function=FA method=NEWTON x1=2 x2=1 seed=5 eps_meth=1e-6 hessian_reuse=3", job, error));
+  EXPECT_EQ(job.hessian_reuse, 3u);
+  EXPECT_FALSE(parse_job("id=1 kind=min function=FA method=NEWTON hessian_reuse=3", job, error));
+
+  SolveIt plain(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-6, NEWTON);
+  plain.setSeed(5);
+  SolveResult a = plain.run();
+  SolveIt reuse(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-6, NEWTON);
+  reuse.setSeed(5);
+  reuse.setHessianReuse(3);
+  SolveResult b = reuse.run();
+  // every = 1 é o Newton sem reuso: uma hessiana por iteração, nenhuma herdada do subproblema anterior.
+  SolveIt one(FA, Matrix(vector<double>{2.0, 1.0}), 4, 1e-7, 1e-6, NEWTON);
+  one.setSeed(5);
+  one.setHessianReuse(1);
+  SolveResult c = one.run();
+  VERBOSE = true;
+  EXPECT_EQ(one.hessians(), plain.hessians());
+  EXPECT_EQ(c.iterations, a.iterations);
+  EXPECT_DOUBLE_EQ(c.x.x1(), a.x.x1());
+  EXPECT_TRUE(b.converged());
+  EXPECT_NEAR(b.x.x1(), 0.0, 1e-4);
+  EXPECT_NEAR(b.x.x2(), 1.0, 1e-4);
+  EXPECT_GT(plain.hessians(), 0u);
+  EXPECT_LT(reuse.hessians(), plain.hessians());
+}
+
+TEST(FiniteDiffTest, gradient) {
+  ThreadPool pool(3);
+  Objective f = [](const vector<double>& x) { return fa(Matrix(x)); };
+  vector<double> x{0.5, -1.5};
+  Matrix g = gradfa(Matrix(x));
+  size_t evaluations = 0;
+  vector<double> forward = fd_gradient(f, x, FD_FORWARD, pool, NAN, &evaluations);
+  EXPECT_EQ(evaluations, 3u);
+  EXPECT_NEAR(forward[0], g.x1(), 1e-6);
+  EXPECT_NEAR(forward[1], g.x2(), 1e-6);
+  vector<double> central = fd_gradient(f, x, FD_CENTRAL, pool, NAN, &evaluations);
+  EXPECT_EQ(evaluations, 7u);
+  EXPECT_NEAR(central[0], g.x1(), 1e-9);
+  EXPECT_NEAR(central[1], g.x2(), 1e-9);
+
+  vector<double> y(200);
+  for (size_t i = 0; i < y.size(); ++i)
+    y[i] = sin(i);
+  vector<double> a = gradfan(y), b = fd_gradient(fan, y, FD_CENTRAL, pool);
+  for (size_t i = 0; i < y.size(); ++i)
+    EXPECT_NEAR(b[i], a[i], 1e-7 * max(1.0, fabs(a[i])));
+}
+
+TEST(FiniteDiffTest, sparseHessian) {
+  ThreadPool pool(2);
+  vector<double> x{0.5, -1.5};
+  SparseHessian H = fd_hessian(gradfan, x, SparsityPattern::dense(2), FD_CENTRAL, pool);
+  Matrix exact = hessfa(Matrix(x));
+  for (unsigned i = 0; i < 2; ++i)
+    for (unsigned j = 0; j < 2; ++j)
+      EXPECT_NEAR(H.at(i, j), exact.get(i + 1, j + 1), 1e-7);
+
+  // Tridiagonal: 3 cores, 4 gradientes (progressivas), para qualquer n.
+  vector<double> y(500);
+  for (size_t i = 0; i < y.size(); ++i)
+    y[i] = 0.5 * cos(i);
+  SparseHessian T = fd_hessian(gradfan, y, SparsityPattern::band(y.size(), 1), FD_FORWARD, pool);
+  EXPECT_EQ(T.colors, 3u);
+  EXPECT_EQ(T.gradients, 4u);
+  for (size_t i = 0; i + 1 < y.size(); ++i) {
+    double e = exp(y[i]);
+    EXPECT_NEAR(T.at(i, i + 1), -2 * e, 1e-5);
+    EXPECT_NEAR(T.at(i + 1, i), -2 * e, 1e-5);
+    EXPECT_NEAR(T.at(i, i), 2 + 4 * e * e - 2 * e * y[i + 1] + (i > 0 ? 2 : 0), 1e-5);
+  }
+  EXPECT_EQ(T.at(0, 2), 0.0);
+  EXPECT_EQ(color_columns(SparsityPattern::dense(4)).back(), 3u);
+}
+
+TEST(FiniteDiffTest, registeredFunctionWithoutDerivatives) {
+  // Só f: register_function completa o gradiente e a hessiana por diferenças finitas.
+  UserFunction fn;
+  fn.name = "fd_fa";
+  fn.dimension = 2;
+  fn.f = fa;
+  int id = register_function(fn);
+  EXPECT_TRUE(user_function(id)->numeric_gradient);
+  EXPECT_TRUE(user_function(id)->numeric_hessian);
+  EXPECT_TRUE(has_hessian(id));
+  Matrix x(vector<double>{0.5, -1.5});
+  for (unsigned i = 1; i <= 2; ++i) {
+    EXPECT_NEAR(gradient(id)(x).get(i), gradfa(x).get(i), 1e-8);
+    for (unsigned j = 1; j <= 2; ++j)
+      EXPECT_NEAR(hessian(id)(x).get(i, j), hessfa(x).get(i, j), 1e-4);
+  }
+
+  srand(3);
+  VERBOSE = false;
+  SolveIt s(id, Matrix(vector<double>{1.0, 1.0}), 4, 1e-7, 1e-5, NEWTON);
+  SolveResult r = s.run();
+  VERBOSE = true;
+  EXPECT_TRUE(r.converged());
+  EXPECT_NEAR(r.x.x1(), 0.0, 1e-3);
+  EXPECT_NEAR(r.x.x2(), 1.0, 1e-3);
+
+  fn.f = std::function<double(Matrix)>();
+  EXPECT_THROW(register_function(fn), std::invalid_argument);
+}
+
+TEST(ExprTest, matchesFa) {
+  ExprObjective e("x1^2 + (exp(x1) - x2)^2");
+  EXPECT_EQ(e.dimension(), 2u);
+  vector<Matrix> points{Matrix(vector<double>{0.5, -1.5}), Matrix(vector<double>{-2.0, 3.0}), Matrix(vector<double>{0.0, 1.0})};
+  for (size_t p = 0; p < points.size(); ++p) {
+    EXPECT_NEAR(e.value(points[p]), fa(points[p]), 1e-12);
+    Matrix g = e.gradient(points[p]), h = e.hessian(points[p]);
+    Matrix G = gradfa(points[p]), H = hessfa(points[p]);
+    for (unsigned i = 1; i <= 2; ++i) {
+      EXPECT_NEAR(g.get(i), G.get(i), 1e-12);
+      for (unsigned j = 1; j <= 2; ++j)
+        EXPECT_NEAR(h.get(i, j), H.get(i, j), 1e-12);
+    }
+  }
+
+  // Lote maior que um bloco do interpretador.
+  const size_t n = 200;
+  vector<double> x1(n), x2(n), f(n), g1(n), g2(n);
+  for (size_t i = 0; i < n; ++i) {
+    x1[i] = -2.0 + 0.02 * i;
+    x2[i] = 1.0 - 0.01 * i;
+  }
+  const double* x[] = {x1.data(), x2.data()};
+  double* g[] = {g1.data(), g2.data()};
+  e.gradients(x, n, f.data(), g);
+  for (size_t i = 0; i < n; ++i) {
+    Matrix p(vector<double>{x1[i], x2[i]});
+    EXPECT_NEAR(f[i], fa(p), 1e-12);
+    EXPECT_NEAR(g1[i], gradfa(p).x1(), 1e-12);
+    EXPECT_NEAR(g2[i], gradfa(p).x2(), 1e-12);
+  }
+
+  std::unique_ptr<Method> m(expr_method(e, NEWTON, Matrix(vector<double>{1.0, 1.0}), 1e-8));
+  SolveResult r = m->run();
+  EXPECT_TRUE(r.converged());
+  EXPECT_NEAR(r.x.x1(), 0.0, 1e-6);
+  EXPECT_NEAR(r.x.x2(), 1.0, 1e-6);
+}
+
+TEST(ExprTest, dagAndErrors) {
+  // exp(x1) aparece uma vez no grafo e f e o gradiente a compartilham.
+  ExprGraph graph;
+  int a = ExprParser("exp(x1) * exp(x1) + 0 * x2", graph).parse();
+  int b = ExprParser("(exp(x1))^2", graph).parse();
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(graph.size(), 6u);    // x1, exp, mul, 0, x2 e 2; 0 * x2 e a soma foram simplificados
+  EXPECT_EQ(ExprParser("2 * 3 - 6 / 2 ^ 1", graph).parse(), graph.constant(3));
+  EXPECT_EQ(graph.derivative(graph.variable(1), 0), graph.constant(0));
+
+  ExprObjective e("-x1^2 + 2^x2 + sqrt(x1) * log(x1) / sin(x1) + cos(pi * x2)");
+  Matrix p(vector<double>{0.7, 0.3});
+  double f = -0.49 + pow(2, 0.3) + sqrt(0.7) * log(0.7) / sin(0.7) + cos(M_PI * 0.3);
+  EXPECT_NEAR(e.value(p), f, 1e-12);
+  Matrix g = e.gradient(p);
+  for (unsigned i = 1; i <= 2; ++i) {
+    Matrix q = p, r = p;
+    q.set(i, p.get(i) + 1e-6);
+    r.set(i, p.get(i) - 1e-6);
+    EXPECT_NEAR(g.get(i), (e.value(q) - e.value(r)) / 2e-6, 1e-6);
+  }
+  EXPECT_LE(e.gradientProgram().registers(), 20u);
+
+  EXPECT_THROW(ExprObjective("x1 +"), std::invalid_argument);
+  EXPECT_THROW(ExprObjective("foo(x1)"), std::invalid_argument);
+  EXPECT_THROW(ExprObjective("(x1"), std::invalid_argument);
+  EXPECT_THROW(ExprObjective("x0"), std::invalid_argument);
+  EXPECT_THROW(ExprObjective("x1 x2"), std::invalid_argument);
+  EXPECT_THROW(e.value(Matrix(3, 1)), std::invalid_argument);
+}
+
+TEST(CodegenTest, nativeMatchesInterpreter) {
+  char dir[] = "/tmp/otim-jit-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ExprObjective e("x1^2 + (exp(x1) - x2)^2 + 0.25 * sin(x1 * x2) / (1 + x2^2)");
+  NativeObjective a(e, dir);
+  EXPECT_FALSE(a.cached());
+  NativeObjective b(e, dir);
+  EXPECT_TRUE(b.cached());
+  EXPECT_EQ(a.path(), b.path());
+  EXPECT_NE(NativeObjective(ExprObjective("x1^2 + x2^2"), dir).path(), a.path());
+
+  vector<Matrix> points{Matrix(vector<double>{0.5, -1.5}), Matrix(vector<double>{-2.0, 3.0})};
+  for (size_t p = 0; p < points.size(); ++p) {
+    EXPECT_DOUBLE_EQ(b.value(points[p]), e.value(points[p]));
+    Matrix g = b.gradient(points[p]), G = e.gradient(points[p]);
+    Matrix h = b.hessian(points[p]), H = e.hessian(points[p]);
+    for (unsigned i = 1; i <= 2; ++i) {
+      EXPECT_NEAR(g.get(i), G.get(i), 1e-12);
+      for (unsigned j = 1; j <= 2; ++j)
+        EXPECT_NEAR(h.get(i, j), H.get(i, j), 1e-12);
+    }
+  }
+
+  std::unique_ptr<Method> m(expr_method(b, NEWTON, Matrix(vector<double>{1.0, 1.0}), 1e-8));
+  EXPECT_TRUE(m->run().converged());
+  EXPECT_EQ(cpp_literal(2), "2.0");
+  EXPECT_EQ(cpp_literal(-0.1), "(-0.10000000000000001)");
+  EXPECT_THROW(NativeObjective(e, "/nonexistent/dir"), std::runtime_error);
+  EXPECT_EQ(system(("rm -rf " + string(dir)).c_str()), 0);
+}
+
+TEST(CodegenTest, privateCache) {
+  char dir[] = "/tmp/otim-jit-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ExprObjective e("x1^2 + x2^2");
+
+  // A fonte vai em um comentário //: quebras de linha e '\' não podem escapar dele.
+  EXPECT_EQ(comment_text("x1 \\\nx2 ?\?/\n"), "x1   x2   / ");
+  string source = native_source(e);
+  EXPECT_EQ(source.substr(0, source.find('\n')).find('\\'), string::npos);
+
+  // Um cache em que outros podem escrever e um .so plantado são recusados.
+  string shared = string(dir) + "/shared";
+  ASSERT_EQ(mkdir(shared.c_str(), 0700), 0);
+  ASSERT_EQ(chmod(shared.c_str(), 0777), 0);
+  EXPECT_THROW(NativeObjective(e, shared), std::runtime_error);
+  string cache = string(dir) + "/cache";
+  NativeObjective a(e, cache);
+  struct stat st;
+  ASSERT_EQ(stat(cache.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0700u);
+  ASSERT_EQ(chmod(a.path().c_str(), 0666), 0);
+  EXPECT_THROW(NativeObjective(e, cache), std::runtime_error);
+  EXPECT_EQ(system(("rm -rf " + string(dir)).c_str()), 0);
+}
+
+TEST(PluginTest, loadAndSolve) {
+  char dir[] = "/tmp/otim-plugin-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  string cpp = string(dir) + "/fa.cpp", so = string(dir) + "/fa.so";
+  {
+    std::ofstream out(cpp.c_str());
+    out << "#include <math.h>\n#include \"otim_plugin.h\"\n"
+      << "static double value(void*, const double* x) {\n"
+      << "  double r = exp(x[0]) - x[1]; return x[0] * x[0] + r * r; }\n"
+      << "static void gradient(void*, const double* x, double* g) {\n"
+      << "  double e = exp(x[0]), r = e - x[1]; g[0] = 2 * x[0] + 2 * r * e; g[1] = -2 * r; }\n"
+      << "static void hessian(void*, const double* x, double* h) {\n"
+      << "  double e = exp(x[0]); h[0] = 2 + 4 * e * e - 2 * x[1] * e; h[1] = h[2] = -2 * e; h[3] = 2; }\n"
+      << "static const otim_objective objectives[] = {\n"
+      << "  {OTIM_PLUGIN_ABI, 2, \"plugin_fa\", 0, value, gradient, hessian, 0, 0},\n"
+      << "  {OTIM_PLUGIN_ABI, 2, \"plugin_fa_value\", 0, value, 0, 0, 0, 0}};\n"
+      << "extern \"C\" const otim_objective* otim_plugin_objectives(size_t* count) {\n"
+      << "  *count = 2; return objectives; }\n";
+  }
+  string command = "c++ -shared -fPIC -I" OTIM_SOURCE_DIR " -o " + so + " " + cpp;
+  ASSERT_EQ(system(command.c_str()), 0);
+
+  vector<int> ids = load_plugin(so);
+  ASSERT_EQ(ids.size(), 2u);
+  EXPECT_EQ(parse_function("plugin_fa"), ids[0]);
+  EXPECT_EQ(string(function_name(ids[0])), "plugin_fa");
+  EXPECT_TRUE(has_hessian(ids[0]));
+  Matrix x(vector<double>{0.5, -1.5});
+  EXPECT_DOUBLE_EQ(objective(ids[0])(x), fa(x));
+  EXPECT_DOUBLE_EQ(gradient(ids[0])(x).get(1), gradfa(x).get(1));
+  EXPECT_DOUBLE_EQ(hessian(ids[0])(x).get(1, 2), hessfa(x).get(1, 2));
+
+  vector<PluginObjective> objs = open_plugin(so);
+  const double xs[] = {0.5, -2.0}, ys[] = {-1.5, 3.0};
+  const double* points[] = {xs, ys};
+  double f[2];
+  objs[0].values(points, 2, f);
+  EXPECT_DOUBLE_EQ(f[1], fa(Matrix(vector<double>{-2.0, 3.0})));
+
+  srand(3);
+  VERBOSE = false;
+  SolveIt s(ids[0], Matrix(vector<double>{1.0, 1.0}), 4, 1e-7, 1e-6, NEWTON);
+  SolveResult r = s.run();
+  VERBOSE = true;
+  EXPECT_TRUE(r.converged());
+
+  Job job;
+  string error;
+  EXPECT_TRUE(parse_job("id=1 kind=solve function=plugin_fa method=NEWTON", job, error));
+  EXPECT_FALSE(parse_job("id=2 kind=min function=plugin_fa method=NEWTON", job, error));
+
+  // O BatchSolver avalia as lanes com values/gradients do plugin.
+  vector<Job> mins(2);
+  ASSERT_TRUE(parse_job("id=4 kind=min function=plugin_fa method=QUASINEWTON x1=1 x2=1", mins[0], error));
+  ASSERT_TRUE(parse_job("id=5 kind=min function=FA method=QUASINEWTON x1=1 x2=1", mins[1], error));
+  vector<JobResult> minimized;
+  run_jobs(mins, minimized);
+  ASSERT_TRUE(minimized[0].error.empty());
+  EXPECT_TRUE(minimized[0].result.converged());
+  EXPECT_NEAR(minimized[0].result.x.x1(), minimized[1].result.x.x1(), 1e-6);
+  EXPECT_NEAR(minimized[0].result.x.x2(), minimized[1].result.x.x2(), 1e-6);
+  BatchSolver sub(ids[0], GRADIENT, 1e-6, 2.0, 0.5, 0.5), subfa(FA, GRADIENT, 1e-6, 2.0, 0.5, 0.5);
+  vector<StartResult> a = sub.solve({1.0, -1.0}, {1.0, 2.0}), b = subfa.solve({1.0, -1.0}, {1.0, 2.0});
+  for (unsigned i = 0; i < a.size(); ++i) {
+    EXPECT_TRUE(a[i].converged());
+    EXPECT_NEAR(a[i].x1, b[i].x1, 1e-6);
+    EXPECT_NEAR(a[i].x2, b[i].x2, 1e-6);
+  }
+  ASSERT_TRUE(parse_job("id=3 kind=solve function=plugin_fa x1=1 x2=1 seed=3 portfolio=GRADIENT,NEWTON", job, error));
+  VERBOSE = false;
+  JobResult portfolio = run_solve_job(job);
+  VERBOSE = true;
+  EXPECT_TRUE(portfolio.result.converged());
+
+  // Os perfis de Armijo só têm lugar para FA..FC.
+  string profile = string(dir) + "/profile.txt";
+  std::ofstream(profile.c_str()) << "# perfil\nfunction=plugin_fa method=GRADIENT s=1 beta=0.5 sigma=0.1" << std::endl;
+  try {
+    load_profile(profile);
+    ADD_FAILURE() << "a profile for a plugin function was accepted";
+  }
+  catch (const std::runtime_error& e) {
+    EXPECT_NE(string(e.what()).find("profile.txt:2: "), string::npos) << e.what();
+  }
+
+  // Sem gradiente nem hessiana no plugin: diferenças finitas, com os mesmos métodos.
+  EXPECT_TRUE(user_function(ids[1])->numeric_gradient);
+  EXPECT_NEAR(gradient(ids[1])(x).get(1), gradfa(x).get(1), 1e-8);
+  ASSERT_TRUE(parse_job("id=6 kind=solve function=plugin_fa_value method=NEWTON x1=1 x2=1 eps_meth=1e-5 seed=3", job, error));
+  VERBOSE = false;
+  JobResult numeric = run_solve_job(job);
+  VERBOSE = true;
+  EXPECT_TRUE(numeric.result.converged());
+  EXPECT_THROW(open_plugin(cpp), std::runtime_error);
+  EXPECT_FALSE(valid_plugin_name("FA"));
+  EXPECT_FALSE(valid_plugin_name("a-b"));
+  EXPECT_EQ(system(("rm -rf " + string(dir)).c_str()), 0);
+}
+
+static double c_fa(void*, const double* x) {
+  double r = exp(x[0]) - x[1];
+  return x[0] * x[0] + r * r;
+}
+
+static void c_gradfa(void* data, const double* x, double* g) {
+  ++*(unsigned*) data;
+  double e = exp(x[0]), r = e - x[1];
+  g[0] = 2 * x[0] + 2 * r * e;
+  g[1] = -2 * r;
+}
+
+TEST(LibraryTest, cApi) {
+  EXPECT_STREQ(unr_version(), LIB_VERSION);
+  unr_options o;
+  unr_options_default(&o);
+  o.method = UNR_QUASINEWTON;
+  unr_solver* s = unr_solver_new("FA", &o);
+  ASSERT_TRUE(s != NULL);
+  EXPECT_EQ(unr_solver_dimension(s), 2u);
+  double x[2] = {2.0, 1.0};
+  unr_stats st;
+  EXPECT_EQ(unr_solve(s, x, &st), UNR_CONVERGED);
+  EXPECT_NEAR(x[0], 0.0, 1e-4);
+  EXPECT_NEAR(x[1], 1.0, 1e-4);
+  EXPECT_GT(st.iterations, 0u);
+  EXPECT_GE(st.evaluations, st.iterations);
+
+  double x01[10], x02[10], x1[10], x2[10], f[10];
+  int status[10];
+  for (int k = 0; k < 10; ++k) {
+    x01[k] = -2.0 + 0.4 * k;
+    x02[k] = 3.0 - 0.5 * k;
+  }
+  EXPECT_EQ(unr_solve_batch(s, x01, x02, 10, x1, x2, f, status, &st), UNR_CONVERGED);
+  for (int k = 0; k < 10; ++k) {
+    EXPECT_EQ(status[k], UNR_CONVERGED);
+    EXPECT_NEAR(x2[k], 1.0, 1e-3);
+  }
+  EXPECT_NEAR(st.f, 0.0, 1e-6);
+  unr_solver_free(s);
+
+  unsigned gradients = 0;
+  otim_objective obj = {OTIM_PLUGIN_ABI, 2, "c_fa", &gradients, c_fa, c_gradfa, NULL, NULL, NULL};
+  o.method = UNR_GRADIENT;
+  s = unr_solver_new_objective(&obj, &o);
+  ASSERT_TRUE(s != NULL);
+  x[0] = -1.0;
+  x[1] = 3.0;
+  EXPECT_EQ(unr_solve(s, x, &st), UNR_CONVERGED);
+  EXPECT_NEAR(x[1], 1.0, 1e-4);
+  EXPECT_GT(gradients, st.iterations);
+  EXPECT_EQ(unr_solve_batch(s, x01, x02, 10, x1, x2, f, NULL, NULL), UNR_ERROR);
+  EXPECT_STREQ(unr_last_error(), "ERROR: batches support only FA, FB and FC");
+  unr_solver_free(s);
+
+  o.method = UNR_NEWTON;
+  EXPECT_TRUE(unr_solver_new_objective(&obj, &o) == NULL);
+  EXPECT_TRUE(unr_solver_new("FB", &o) == NULL);
+  EXPECT_TRUE(unr_solver_new("FD", NULL) == NULL);
+  EXPECT_STREQ(unr_last_error(), "ERROR: unknown function 'FD'");
+  EXPECT_EQ(unr_load_plugin("/nonexistent.so"), UNR_ERROR);
+}
+
+TEST(BenchTest, formatAndLoad) {
+  BenchResult r;
+  r.build = "O2+PGO";
+  r.rounds = 3;
+  r.solves = 128;
+  r.evaluations = 738247;
+  r.seconds = 1.5;
+  r.throughput = 85.25;
+  std::ofstream("benchTest.txt") << "INFO: something else" << std::endl << format_bench(r) << std::endl;
+  BenchResult s = load_bench("benchTest.txt");
+  EXPECT_EQ(s.build, "O2+PGO");
+  EXPECT_EQ(s.rounds, 3u);
+  EXPECT_EQ(s.solves, 128u);
+  EXPECT_EQ(s.evaluations, 738247u);
+  EXPECT_DOUBLE_EQ(s.seconds, 1.5);
+  EXPECT_DOUBLE_EQ(s.throughput, 85.25);
+
+  std::ofstream("benchTest.txt") << "INFO: no result" << std::endl;
+  EXPECT_THROW(load_bench("benchTest.txt"), std::runtime_error);
+  remove("benchTest.txt");
+  EXPECT_THROW(load_bench("benchTest.txt"), std::runtime_error);
+  EXPECT_THROW(run_bench(0), std::invalid_argument);
+}
+
+TEST(FiniteSumTest, deterministicAndSolvable) {
+  // y = 1.5 a1 - 2 a2 + 0.5 a3 em linhas que não completam o último bloco.
+  const size_t rows = 3 * SUM_BLOCK + 123;
+  vector<double> a1(rows), a2(rows), a3(rows), y(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    a1[i] = sin(1.1 * i);
+    a2[i] = cos(0.37 * i);
+    a3[i] = sin(2.9 * i + 1.0);
+    y[i] = 1.5 * a1[i] - 2.0 * a2[i] + 0.5 * a3[i];
+  }
+  LeastSquares terms({a1.data(), a2.data(), a3.data()}, y.data(), rows);
+  SumObjective one(terms, 1), four(terms, 4);
+  EXPECT_EQ(four.dimension(), 3u);
+
+  // A redução na ordem dos blocos dá o mesmo resultado, bit a bit, com qualquer número de threads.
+  vector<double> x{0.3, -0.7, 2.0}, g1, g4, gs(3, 0.0);
+  double f1 = one.evaluate(x, &g1), f4 = four.evaluate(x, &g4);
+  EXPECT_EQ(f1, f4);
+  EXPECT_TRUE(g1 == g4);
+  double fs = terms.sum(x.data(), 0, rows, gs.data());
+  EXPECT_NEAR(f1, fs, 1e-9 * fs);
+  for (unsigned j = 0; j < 3; ++j)
+    EXPECT_NEAR(g1[j], gs[j], 1e-9 * std::fabs(gs[j]));
+  EXPECT_EQ(four.value(Matrix(x)), f1);
+
+  const int methods[] = {GRADIENT, QUASINEWTON};
+  for (int method : methods) {
+    std::unique_ptr<Method> m(expr_method(four, method, Matrix(vector<double>{0.0, 0.0, 0.0}), 1e-6));
+    SolveResult r = m->run();
+    EXPECT_TRUE(r.converged()) << method;
+    EXPECT_NEAR(r.x.get(1), 1.5, 1e-6);
+    EXPECT_NEAR(r.x.get(2), -2.0, 1e-6);
+    EXPECT_NEAR(r.x.get(3), 0.5, 1e-6);
+  }
+
+  // Newton, com a hessiana por diferenças do gradiente, em duas variáveis.
+  LeastSquares two({a1.data(), a2.data()}, y.data(), rows);
+  SumObjective obj(two, 2);
+  std::unique_ptr<Method> m(expr_method(obj, NEWTON, Matrix(vector<double>{0.0, 0.0}), 1e-6));
+  SolveResult r = m->run();
+  EXPECT_TRUE(r.converged());
+  EXPECT_LT(r.iterations, 5u);
+  EXPECT_THROW(obj.evaluate(x, NULL), std::invalid_argument);
+}
+
+TEST(StreamTest, matchesInMemory) {
+  const size_t rows = 5 * SUM_BLOCK + 77;
+  {
+    ColumnWriter out("streamTest.col", rows, {"a1", "a2", "y"});
+    double *a1 = out.column("a1"), *a2 = out.column("a2"), *y = out.column("y");
+    for (size_t i = 0; i < rows; ++i) {
+      a1[i] = sin(1.1 * i);
+      a2[i] = cos(0.37 * i);
+      y[i] = 3.0 * a1[i] - 0.25 * a2[i];
+    }
+  }
+  ColumnFile data("streamTest.col");
+  LeastSquares terms({data.column("a1"), data.column("a2")}, data.column("y"), rows);
+  SumObjective memory(terms, 3);
+  // Trechos de 2 blocos (arredondado para cima), o último incompleto.
+  StreamObjective stream("streamTest.col", {"a1", "a2", "y"}, least_squares_chunk, 2, SUM_BLOCK + 1);
+  EXPECT_EQ(stream.chunk(), 2u * SUM_BLOCK);
+  EXPECT_EQ(stream.records(), rows);
+  EXPECT_EQ(stream.dimension(), 2u);
+
+  vector<double> x{0.5, -1.0}, gm, gs;
+  EXPECT_EQ(stream.evaluate(x, &gs), memory.evaluate(x, &gm));
+  EXPECT_TRUE(gs == gm);
+
+  const int methods[] = {GRADIENT, QUASINEWTON};
+  for (int method : methods) {
+    std::unique_ptr<Method> m(expr_method(stream, method, Matrix(vector<double>{0.0, 0.0}), 1e-6));
+    SolveResult r = m->run();
+    EXPECT_TRUE(r.converged()) << method;
+    EXPECT_NEAR(r.x.get(1), 3.0, 1e-6);
+    EXPECT_NEAR(r.x.get(2), -0.25, 1e-6);
+  }
+
+  EXPECT_THROW(StreamObjective("streamTest.col", {"a1", "b", "y"}, least_squares_chunk), std::invalid_argument);
+  remove("streamTest.col");
+  EXPECT_THROW(StreamObjective("streamTest.col", {"a1", "y"}, least_squares_chunk), std::runtime_error);
+}